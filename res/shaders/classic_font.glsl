@@ -24,12 +24,23 @@ layout(location = 1) in vec4 v_color;
 out vec4 color;
 
 uniform sampler2D u_texture;
+uniform int u_sdf;
 
-void main() {
+// coverage of the glyph, the atlas is either plain coverage or a signed
+// distance field with the outline at 0.5
+float coverage() {
     float r = texture(u_texture, v_tex_coords).r;
-    if (r == 0.) {
+    if (u_sdf == 1) {
+        float w = fwidth(r);
+        return smoothstep(0.5 - w, 0.5 + w, r);
+    }
+    return r;
+}
+
+void main() {
+    float a = coverage();
+    if (a == 0.) {
         discard;
-    } else {
-        color = vec4(vec3(r), 1.) * v_color;
     }
+    color = vec4(v_color.rgb, v_color.a * a);
 }
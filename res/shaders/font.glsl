@@ -28,22 +28,32 @@ out vec4 color;
 
 uniform sampler2D u_texture;
 uniform float u_time;
+uniform int u_sdf;
 
-void main() {
+// coverage of the glyph, the atlas is either plain coverage or a signed
+// distance field with the outline at 0.5
+float coverage() {
     float r = texture(u_texture, v_tex_coords).r;
-    if (r == 0.) {
+    if (u_sdf == 1) {
+        float w = fwidth(r);
+        return smoothstep(0.5 - w, 0.5 + w, r);
+    }
+    return r;
+}
+
+void main() {
+    float a = coverage();
+    if (a == 0.) {
         discard;
-    } else {
-        float sin_t = sin(u_time + v_uv.x * 10.0);
-        float cos_t = cos(u_time + v_uv.y * 10.0);
-        color = vec4(vec3(r), 1.) * v_color;
-        if (v_color == vec4(1.0)) {
-            color.rgb = vec3(
-                0.3 + sin_t * 0.5 + 0.5,
-                0.4 + cos_t * 0.5 + 0.5,
-                0.4 + cos_t * sin_t
-            );
-            color.a = 1.0;
-        }
+    }
+    float sin_t = sin(u_time + v_uv.x * 10.0);
+    float cos_t = cos(u_time + v_uv.y * 10.0);
+    color = vec4(v_color.rgb, v_color.a * a);
+    if (v_color == vec4(1.0)) {
+        color.rgb = vec3(
+            0.3 + sin_t * 0.5 + 0.5,
+            0.4 + cos_t * 0.5 + 0.5,
+            0.4 + cos_t * sin_t
+        );
     }
 }
@@ -0,0 +1,28 @@
+#shader vertex
+#version 450
+layout(location = 0) in vec2 a_pos;
+layout(location = 1) in vec2 a_tex_coords;
+layout(location = 2) in vec4 a_color;
+
+layout(location = 0) out vec2 v_tex_coords;
+
+uniform mat4 u_view_proj;
+
+void main() {
+    gl_Position = u_view_proj * vec4(a_pos, 0., 1.);
+    v_tex_coords = a_tex_coords;
+}
+
+#shader fragment
+#version 450
+
+layout(location = 0) in vec2 v_tex_coords;
+
+out vec4 color;
+
+uniform sampler2D u_texture;
+
+// opaque textures, cached document tiles and the minimap
+void main() {
+    color = vec4(texture(u_texture, v_tex_coords).rgb, 1.);
+}
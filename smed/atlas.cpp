@@ -0,0 +1,164 @@
+#include "atlas.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <omega/gfx/gl.hpp>
+
+SkylinePacker::SkylinePacker(u32 width, u32 height)
+    : width(width), height(height) {
+    reset();
+}
+
+void SkylinePacker::reset() {
+    skyline.clear();
+    skyline.push_back({0, 0, width});
+}
+
+i32 SkylinePacker::fit(u32 i, u32 w, u32 h) const {
+    u32 x = skyline[i].x;
+    if (x + w > width) {
+        return -1;
+    }
+    // the rect rests on the highest segment underneath it
+    u32 y = 0;
+    i32 remaining = w;
+    while (remaining > 0) {
+        y = omega::math::max(y, skyline[i].y);
+        if (y + h > height) {
+            return -1;
+        }
+        remaining -= (i32)skyline[i].width;
+        i++;
+    }
+    return y;
+}
+
+bool SkylinePacker::pack(u32 w, u32 h, omega::math::ivec2 &pos) {
+    i32 best = -1;
+    u32 best_y = height;
+    u32 best_width = width;
+    for (u32 i = 0; i < skyline.size(); ++i) {
+        i32 y = fit(i, w, h);
+        if (y == -1) {
+            continue;
+        }
+        // prefer the lowest spot, then the narrowest segment
+        if ((u32)y < best_y ||
+            ((u32)y == best_y && skyline[i].width < best_width)) {
+            best = i;
+            best_y = y;
+            best_width = skyline[i].width;
+        }
+    }
+    if (best == -1) {
+        return false;
+    }
+    pos = {(i32)skyline[best].x, (i32)best_y};
+
+    // raise the skyline where the rect was placed
+    skyline.insert(skyline.begin() + best, {skyline[best].x, best_y + h, w});
+    u32 i = best + 1;
+    while (i < skyline.size()) {
+        const Node &prev = skyline[i - 1];
+        Node &node = skyline[i];
+        if (node.x >= prev.x + prev.width) {
+            break;
+        }
+        // shrink the segments that are now covered
+        u32 shrink = prev.x + prev.width - node.x;
+        if (shrink < node.width) {
+            node.x += shrink;
+            node.width -= shrink;
+            break;
+        }
+        skyline.erase(skyline.begin() + i);
+    }
+    // merge neighbouring segments of equal height
+    for (i = 0; i + 1 < skyline.size();) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        } else {
+            i++;
+        }
+    }
+    return true;
+}
+
+AtlasPage::AtlasPage(u32 width, u32 height, const u8 *pixels)
+    : packer(width, height), width(width), height(height) {
+    if (pixels != nullptr) {
+        this->pixels.assign(pixels, pixels + width * height);
+    } else {
+        this->pixels.resize(width * height, 0);
+    }
+    u32 id = 0;
+    glGenTextures(1, &id);
+    texture = omega::gfx::texture::Texture::create_wrapper(id, width, height);
+    texture->bind(0);
+    // upload from the source, it may be mapped straight from disk
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 GL_RED,
+                 width,
+                 height,
+                 0,
+                 GL_RED,
+                 GL_UNSIGNED_BYTE,
+                 pixels != nullptr ? pixels : this->pixels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+void AtlasPage::clear() {
+    packer.reset();
+    std::fill(pixels.begin(), pixels.end(), 0);
+    dirty_min = {0, 0};
+    dirty_max = {(i32)width, (i32)height};
+    flush();
+}
+
+void AtlasPage::blit(const omega::math::ivec2 &pos,
+                     u32 w,
+                     u32 h,
+                     const u8 *src) {
+    if (w == 0 || h == 0) {
+        return;
+    }
+    for (u32 y = 0; y < h; ++y) {
+        std::memcpy(&pixels[(pos.y + y) * width + pos.x], src + y * w, w);
+    }
+    // grow the dirty region
+    if (dirty_max.x <= dirty_min.x) {
+        dirty_min = pos;
+        dirty_max = {pos.x + (i32)w, pos.y + (i32)h};
+    } else {
+        dirty_min = {omega::math::min(dirty_min.x, pos.x),
+                     omega::math::min(dirty_min.y, pos.y)};
+        dirty_max = {omega::math::max(dirty_max.x, pos.x + (i32)w),
+                     omega::math::max(dirty_max.y, pos.y + (i32)h)};
+    }
+}
+
+void AtlasPage::flush() {
+    if (dirty_max.x <= dirty_min.x || dirty_max.y <= dirty_min.y) {
+        return;
+    }
+    texture->bind(0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+    glTexSubImage2D(GL_TEXTURE_2D,
+                    0,
+                    dirty_min.x,
+                    dirty_min.y,
+                    dirty_max.x - dirty_min.x,
+                    dirty_max.y - dirty_min.y,
+                    GL_RED,
+                    GL_UNSIGNED_BYTE,
+                    &pixels[dirty_min.y * width + dirty_min.x]);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    dirty_min = dirty_max = {0, 0};
+}
@@ -0,0 +1,75 @@
+#ifndef SMED_ATLAS_HPP
+#define SMED_ATLAS_HPP
+
+#include <omega/gfx/texture/texture.hpp>
+#include <omega/math/math.hpp>
+#include <omega/util/std.hpp>
+#include <omega/util/types.hpp>
+#include <utility>
+#include <vector>
+
+/**
+ * Bottom-left skyline rectangle packer: the used area of the page is tracked
+ * as a list of horizontal segments and new rects are dropped onto the lowest
+ * spot they fit in
+ * */
+class SkylinePacker {
+  public:
+    SkylinePacker(u32 width, u32 height);
+
+    void reset();
+    // finds a spot for a w x h rect, returns false when the page is full
+    bool pack(u32 w, u32 h, omega::math::ivec2 &pos);
+
+    struct Node {
+        u32 x, y, width;
+    };
+    // the skyline is the whole packer state, so it can be saved and restored
+    const std::vector<Node> &get_skyline() const {
+        return skyline;
+    }
+    void set_skyline(std::vector<Node> nodes) {
+        skyline = std::move(nodes);
+    }
+
+  private:
+    // height the rect would rest at when placed at node i, or -1 if it
+    // doesn't fit
+    i32 fit(u32 i, u32 w, u32 h) const;
+
+    std::vector<Node> skyline;
+    u32 width, height;
+};
+
+// single R8 texture of the glyph atlas, with its own packer and a cpu copy of
+// the pixels so batches of glyphs can be uploaded at once
+struct AtlasPage {
+    // the texture starts out empty unless pixels are given
+    AtlasPage(u32 width, u32 height, const u8 *pixels = nullptr);
+
+    // wipe the texture and packer, so the page can be reused
+    void clear();
+    // copy a block into the cpu copy, it reaches the texture on flush
+    void blit(const omega::math::ivec2 &pos, u32 w, u32 h, const u8 *src);
+    // upload everything blitted since the last flush in one call
+    void flush();
+    void upload(const omega::math::ivec2 &pos,
+                u32 w,
+                u32 h,
+                const u8 *src) {
+        blit(pos, w, h, src);
+        flush();
+    }
+
+    omega::util::sptr<omega::gfx::texture::Texture> texture = nullptr;
+    SkylinePacker packer;
+    std::vector<u8> pixels;
+    u64 last_used = 0; // frame the page was last sampled from
+
+  private:
+    u32 width, height;
+    // dirty region waiting for the next flush
+    omega::math::ivec2 dirty_min{0, 0}, dirty_max{0, 0};
+};
+
+#endif // SMED_ATLAS_HPP
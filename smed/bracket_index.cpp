@@ -0,0 +1,69 @@
+#include "bracket_index.hpp"
+
+#include <algorithm>
+
+void BracketIndex::add(u32 idx, Kind kind, bool is_open) {
+    u32 self = brackets.size();
+    u32 parent = open.empty() ? none : open.back();
+    if (is_open) {
+        brackets.push_back({idx, none, parent, (u32)open.size(), kind, true});
+        open.push_back(self);
+        return;
+    }
+    if (parent != none && brackets[parent].kind == kind) {
+        // the pair shares the depth and the parent of its open bracket
+        const Bracket &partner = brackets[parent];
+        brackets.push_back(
+            {idx, parent, partner.parent, partner.depth, kind, false});
+        brackets[parent].match = self;
+        open.pop_back();
+        return;
+    }
+    brackets.push_back({idx, none, parent, (u32)open.size(), kind, false});
+}
+
+const BracketIndex::Bracket *BracketIndex::at(u32 idx) const {
+    auto it = std::lower_bound(
+        brackets.begin(),
+        brackets.end(),
+        idx,
+        [](const Bracket &b, u32 i) { return b.idx < i; });
+    return it != brackets.end() && it->idx == idx ? &*it : nullptr;
+}
+
+u32 BracketIndex::match(u32 idx) const {
+    const Bracket *bracket = at(idx);
+    if ((bracket == nullptr || bracket->match == none) && idx > 0) {
+        bracket = at(idx - 1);
+    }
+    if (bracket == nullptr || bracket->match == none) {
+        return none;
+    }
+    return brackets[bracket->match].idx;
+}
+
+bool BracketIndex::enclosing(u32 begin, u32 end, u32 &open, u32 &close) const {
+    // the last bracket before begin is either the innermost open one around
+    // it, or closes a pair inside of that
+    auto it = std::lower_bound(
+        brackets.begin(),
+        brackets.end(),
+        begin,
+        [](const Bracket &b, u32 i) { return b.idx < i; });
+    if (it == brackets.begin()) {
+        return false;
+    }
+    const Bracket &last = *(it - 1);
+    u32 current = last.open ? it - 1 - brackets.begin() : last.parent;
+    // outwards until a pair also covers end, unclosed brackets are skipped
+    while (current != none) {
+        const Bracket &bracket = brackets[current];
+        if (bracket.match != none && brackets[bracket.match].idx >= end) {
+            open = bracket.idx;
+            close = brackets[bracket.match].idx;
+            return true;
+        }
+        current = bracket.parent;
+    }
+    return false;
+}
@@ -0,0 +1,62 @@
+#ifndef SMED_BRACKETINDEX_HPP
+#define SMED_BRACKETINDEX_HPP
+
+#include <omega/util/types.hpp>
+#include <vector>
+
+/**
+ * Every paren, curly brace and square bracket outside of strings and
+ * comments, recorded while lexing with its depth, its partner and the pair
+ * it's nested in. Finding the bracket matching the one at the cursor or the
+ * innermost pair around it is a binary search, no text is scanned.
+ *
+ * It's filled again on every relex rather than patched: one bracket typed
+ * or deleted changes the depth, partner or parent of every bracket after
+ * it, so a patch would rewrite that tail anyway, and clear keeps the
+ * vectors' capacity, so refilling is one push per bracket
+ * */
+class BracketIndex {
+  public:
+    enum class Kind : u8 {
+        PAREN = 0,
+        CURLY,
+        SQUARE
+    };
+
+    static constexpr u32 none = UINT32_MAX;
+
+    struct Bracket {
+        u32 idx;
+        u32 match;  // index into the brackets of the partner, none if missing
+        u32 parent; // index of the open bracket around the pair, or none
+        u32 depth;  // 0 for the outermost pairs
+        Kind kind;
+        bool open;
+    };
+
+    void clear() {
+        brackets.clear();
+        open.clear();
+    }
+    // brackets have to be added in text order. A closing bracket matches the
+    // innermost open one if it's the same kind, else it stays unmatched
+    void add(u32 idx, Kind kind, bool is_open);
+
+    // the bracket at idx, nullptr for none
+    const Bracket *at(u32 idx) const;
+    // text index of the partner of the bracket at idx, or of the one right
+    // before idx, none when there is no matched bracket there
+    u32 match(u32 idx) const;
+    /**
+     * Innermost matched pair whose brackets are outside of [begin, end),
+     * returns false at the top level. open and close are the brackets'
+     * text indices
+     * */
+    bool enclosing(u32 begin, u32 end, u32 &open, u32 &close) const;
+
+  private:
+    std::vector<Bracket> brackets; // sorted by idx
+    std::vector<u32> open;         // unmatched open brackets while adding
+};
+
+#endif // SMED_BRACKETINDEX_HPP
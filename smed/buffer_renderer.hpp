@@ -1,266 +1,384 @@
 #ifndef SMED_BUFFERRENDERER_HPP
 #define SMED_BUFFERRENDERER_HPP
 
+#include <algorithm>
 #include <cstring>
-#include <omega/core/platform.hpp>
-#include <omega/gfx/gl.hpp>
 #include <omega/gfx/shader.hpp>
-#include <omega/gfx/shape_renderer.hpp>
-#include <omega/gfx/vertex_array.hpp>
-#include <omega/gfx/vertex_buffer.hpp>
-#include <omega/gfx/vertex_buffer_layout.hpp>
 #include <omega/util/color.hpp>
-#include <omega/util/std.hpp>
 #include <omega/util/time.hpp>
 #include <vector>
 
 #include "smed/font.hpp"
+#include "smed/frame_stats.hpp"
 #include "smed/gap_buffer.hpp"
+#include "smed/layout.hpp"
 #include "smed/lexer.hpp"
+#include "smed/render_batch.hpp"
+#include "smed/utf8.hpp"
 
 class BufferRenderer {
   public:
-    BufferRenderer(omega::gfx::Shader *shader) : shader(shader) {
-        // create the Vertex buffer and array
-        vbo = omega::util::create_uptr<omega::gfx::VertexBuffer>(
-            sizeof(Vertex) * 6 * quad_count);
-        vao = omega::util::create_uptr<omega::gfx::VertexArray>();
+    BufferRenderer(omega::gfx::Shader *shader) : shader(shader) {}
 
-        omega::gfx::VertexBufferLayout layout;
-        layout.push(OMEGA_GL_FLOAT, 2);
-        layout.push(OMEGA_GL_FLOAT, 2);
-        layout.push(OMEGA_GL_FLOAT, 4);
-        vao->add_buffer(*vbo, layout);
+    // the default text color is animated by u_time, otherwise it's frozen
+    void set_animated(bool animate) {
+        animated = animate;
     }
 
-    void begin() {
-        quads_rendered = 0;
-    }
+    /**
+     * Emits the glyphs of the visual rows [first_row, last_row] whose pen
+     * position falls into [x_min, x_max]
+     * */
+    void render(RenderBatch &batch,
+                Font *font,
+                GapBuffer &gap_buffer,
+                const std::vector<Token> &tokens,
+                const Layout &layout,
+                omega::math::vec2 origin,
+                f32 height,
+                const omega::math::vec4 &color,
+                u32 first_row,
+                u32 last_row,
+                f32 x_min,
+                f32 x_max) {
+        // uniforms stick to the program, so the time is set once per frame
+        shader->bind();
+        shader->set_uniform_1f(
+            "u_time", animated ? omega::util::time::get_time<f32>() : 0.0f);
+        shader->unbind();
 
-    omega::math::vec2 render(Font *font,
-                             const omega::math::mat4 &view_proj,
-                             GapBuffer &gap_buffer,
-                             const std::vector<Token> &tokens,
-                             omega::math::vec2 origin,
-                             omega::math::vec2 pos,
-                             f32 height,
-                             const omega::math::vec4 &color) {
         // TODO: add more fonts
-        font->get_texture()->bind(0);
-        Vertex vertices[6];
+        RenderBatch::Quad quad;
         f32 scale_factor = height / font->get_font_size();
+        f32 line_height = font->get_font_height() * scale_factor;
+        bool mono = font->is_monospace();
+        f32 mono_advance = font->get_mono_advance() * scale_factor;
+        const auto &wraps = layout.wraps;
 
-        // track the space width, so pos.x can be increased appropriately
-        u32 space_width = font->get_glyph('a').advance.x;
+        // render the text
+        for (u32 row = first_row; row <= last_row; ++row) {
+            u32 row_start = wraps.row_start(row);
+            u32 row_end = wraps.row_end(row);
+            f32 row_x = wraps.row_x(row);
+            // wrapped rows pick up the tokens their line started
+            u32 line_start = layout.lines.line_start(
+                layout.lines.line_of(row_start));
+            // long rows skip straight to the first visible column
+            f32 view_x = (x_min - origin.x) / scale_factor + row_x;
+            auto checkpoint =
+                layout.widths.before_x(row_start, row_end, view_x, row_x);
+            f32 y = origin.y - row * line_height;
 
-        // WARN: Messy solution to rendering each character without a separate
-        // helper function
-        const auto token_render = [&](const Token &token) {
-            auto col = color;
-            switch (token.type) {
-                case TokenType::KEYWORD:
-                    col = {0.9f, 0.2f, 0.3f, 1.0f};
-                    break;
-                case TokenType::STRING:
-                    col = {0.4f, 0.8f, 0.2f, 1.0f};
-                    break;
-                case TokenType::TYPE:
-                    col = {1.0f, 0.85f, 0.2f, 1.0f};
-                    break;
-                case TokenType::NUMBER:
-                    col = {1.0f, 0.4f, 1.0f, 1.0f};
-                    break;
-                case TokenType::PREPROCESSOR:
-                    col = {0.7f, 0.6f, 0.7f, 1.0f};
-                    break;
-                case TokenType::COMMENT:
-                    col = {0.5f, 0.5f, 0.5f, 1.0f};
-                    break;
-                case TokenType::CLOSE_PAREN:
-                case TokenType::OPEN_PAREN:
-                case TokenType::OPEN_CURLY:
-                case TokenType::CLOSE_CURLY:
-                    col = {0.6f, 0.7f, 0.7f, 1.0f};
-                    break;
-                case TokenType::EQUALS:
-                case TokenType::LT:
-                case TokenType::GT:
-                case TokenType::ASSIGNMENT:
-                case TokenType::GOT:
-                case TokenType::LOT:
-                case TokenType::NOT_EQUAL:
-                case TokenType::NOT:
-                case TokenType::PLUS:
-                case TokenType::MINUS:
-                case TokenType::MUL:
-                case TokenType::DIV:
-                case TokenType::MOD:
-                case TokenType::SCOPE:
-                case TokenType::AND:
-                case TokenType::OR:
-                    col = {0.4f, 0.6f, 0.85f, 1.0f};
+            for (u32 t = first_token(tokens, gap_buffer, checkpoint.idx);
+                 t < tokens.size();
+                 ++t) {
+                const Token &token = tokens[t];
+                // get adjusted start index
+                u32 start_idx = gap_buffer.get_index_from_pointer(token.text);
+                if (start_idx >= row_end) {
                     break;
-                default:
-                    col = color;
+                }
+                // tokens spanning lines are drawn with the line they start on
+                if (start_idx < line_start) {
+                    continue;
+                }
+                f32 x = origin.x + (token.pos.x - row_x) * scale_factor;
+                if (x > x_max) {
                     break;
+                }
+                // a token has at most len columns, so it can be skipped whole
+                if (mono && x + token.len * mono_advance < x_min) {
+                    continue;
+                }
+                // tokens cut by a wrap or long tokens resume at the
+                // checkpoint
+                u32 i = 0;
+                if (start_idx < checkpoint.idx) {
+                    i = checkpoint.idx - start_idx;
+                    x = origin.x + (checkpoint.x - row_x) * scale_factor;
+                }
+                auto col = token_color(token.type, color);
+                if (is_bracket(token.type)) {
+                    col = bracket_color(layout.brackets.at(start_idx), col);
+                }
+                omega::math::vec2 pen{x, y};
+                while (i < token.len && start_idx + i < row_end &&
+                       pen.x <= x_max) {
+                    u32 len = 1;
+                    u32 c = gap_buffer.codepoint_at(start_idx + i, len);
+                    i += len;
+                    const Glyph &glyph = font->get_glyph(c);
+                    f32 advance =
+                        mono ? mono_advance : glyph.advance.x * scale_factor;
+                    if (pen.x + advance >= x_min &&
+                        batch.make_glyph(quad,
+                                         RenderBatch::Layer::DOCUMENT,
+                                         shader,
+                                         font,
+                                         glyph,
+                                         pen,
+                                         scale_factor,
+                                         col)) {
+                        batch.push(quad);
+                        FrameStats::get().count(FrameStats::Counter::GLYPHS);
+                    }
+                    pen.x += advance;
+                }
             }
+        }
+    }
 
-            for (u32 i = 0; i < token.len; ++i) {
-                // get adjusted start index
-                u32 start_idx = gap_buffer.get_index_from_pointer(token.text);
-                char c = gap_buffer.get(start_idx + i);
-                const Glyph &glyph = font->get_glyph(c);
-
-                // actual render pos
-                omega::math::rectf src{(f32)glyph.tex_coords.x,
-                                       (f32)glyph.tex_coords.y,
-                                       (f32)glyph.size.x,
-                                       (f32)glyph.size.y};
-                // normalize the src rectangle (texture coordinates)
-                src.x = src.x / font->get_texture()->get_width();
-                src.y = src.y / font->get_texture()->get_height();
-                src.w = src.w / font->get_texture()->get_width();
-                src.h = src.h / font->get_texture()->get_height();
-
-                // compute the destination rectangle
-                omega::math::rectf dest{
-                    origin.x +
-                        (token.pos.x + i * glyph.advance.x) * scale_factor +
-                        glyph.offset.x * scale_factor,
-                    origin.y - (token.pos.y * scale_factor) -
-                        (glyph.size.y - glyph.offset.y) * scale_factor,
-                    glyph.size.x * scale_factor,
-                    glyph.size.y * scale_factor};
+    // position of the cursor, found from its row rather than the whole text
+    omega::math::vec2 cursor_pos(Font *font,
+                                 GapBuffer &gap_buffer,
+                                 const Layout &layout,
+                                 omega::math::vec2 origin,
+                                 f32 height) {
+        return index_pos(
+            font, gap_buffer, layout, gap_buffer.cursor(), origin, height);
+    }
+    // position of the character at idx, which must not be folded away
+    omega::math::vec2 index_pos(Font *font,
+                                GapBuffer &gap_buffer,
+                                const Layout &layout,
+                                u32 idx,
+                                omega::math::vec2 origin,
+                                f32 height) {
+        f32 scale_factor = height / font->get_font_size();
+        u32 row = layout.wraps.row_of(idx);
+        f32 x = row_x(font, gap_buffer, layout, row, idx);
+        return {origin.x + x * scale_factor,
+                origin.y - row * font->get_font_height() * scale_factor};
+    }
 
-                // create the vertices, inverting y up
-                vertices[0] = {{dest.x, dest.y}, {src.x, src.y + src.h}, col};
-                vertices[1] = {{dest.x + dest.w, dest.y},
-                               {src.x + src.w, src.y + src.h},
-                               col};
-                vertices[2] = {{dest.x + dest.w, dest.y + dest.h},
-                               {src.x + src.w, src.y},
-                               col};
-                vertices[3] = vertices[2];
-                vertices[4] = {{dest.x, dest.y + dest.h}, {src.x, src.y}, col};
-                vertices[5] = vertices[0];
+    // syntax highlighting color of a token type, color is the default
+    static omega::math::vec4 token_color(TokenType type,
+                                         const omega::math::vec4 &color) {
+        switch (type) {
+            case TokenType::KEYWORD:
+                return {0.9f, 0.2f, 0.3f, 1.0f};
+            case TokenType::STRING:
+                return {0.4f, 0.8f, 0.2f, 1.0f};
+            case TokenType::TYPE:
+                return {1.0f, 0.85f, 0.2f, 1.0f};
+            case TokenType::NUMBER:
+                return {1.0f, 0.4f, 1.0f, 1.0f};
+            case TokenType::PREPROCESSOR:
+                return {0.7f, 0.6f, 0.7f, 1.0f};
+            case TokenType::COMMENT:
+                return {0.5f, 0.5f, 0.5f, 1.0f};
+            case TokenType::CLOSE_PAREN:
+            case TokenType::OPEN_PAREN:
+            case TokenType::OPEN_CURLY:
+            case TokenType::CLOSE_CURLY:
+            case TokenType::OPEN_SQUARE:
+            case TokenType::CLOSE_SQUARE:
+                return {0.6f, 0.7f, 0.7f, 1.0f};
+            case TokenType::EQUALS:
+            case TokenType::LT:
+            case TokenType::GT:
+            case TokenType::ASSIGNMENT:
+            case TokenType::GOT:
+            case TokenType::LOT:
+            case TokenType::NOT_EQUAL:
+            case TokenType::NOT:
+            case TokenType::PLUS:
+            case TokenType::MINUS:
+            case TokenType::MUL:
+            case TokenType::DIV:
+            case TokenType::MOD:
+            case TokenType::SCOPE:
+            case TokenType::AND:
+            case TokenType::OR:
+                return {0.4f, 0.6f, 0.85f, 1.0f};
+            default:
+                return color;
+        }
+    }
 
-                // send the new Quad to the gpu
-                vbo->bind();
-                vbo->sub_data(sizeof(Vertex) * 6 * quads_rendered,
-                              sizeof(Vertex) * 6,
-                              vertices);
-                vbo->unbind();
-                quads_rendered++;
-                if (quads_rendered == quad_count) {
-                    end(view_proj);
-                    begin();
-                }
-            }
-        };
+    static bool is_bracket(TokenType type) {
+        return type == TokenType::OPEN_PAREN ||
+               type == TokenType::CLOSE_PAREN ||
+               type == TokenType::OPEN_CURLY ||
+               type == TokenType::CLOSE_CURLY ||
+               type == TokenType::OPEN_SQUARE ||
+               type == TokenType::CLOSE_SQUARE;
+    }
 
-        // render the text
-        for (const auto &token : tokens) {
-            // TODO: only render what will actually be rendered
-            token_render(token);
+    // brackets cycle through colors by depth, unmatched ones stand out
+    static omega::math::vec4 bracket_color(
+        const BracketIndex::Bracket *bracket,
+        const omega::math::vec4 &color) {
+        static const omega::math::vec4 depths[] = {{1.0f, 0.85f, 0.2f, 1.0f},
+                                                   {0.85f, 0.45f, 0.9f, 1.0f},
+                                                   {0.3f, 0.7f, 1.0f, 1.0f}};
+        if (bracket == nullptr) {
+            return color;
         }
-
-        // calculate cursor pos
-        omega::math::vec2 cursor = pos;
-        for (u32 i = 0; i < gap_buffer.cursor(); ++i) {
-            char c = gap_buffer.get(i);
-            if (c == '\n') {
-                cursor.y -= font->get_font_height() * scale_factor;
-                cursor.x = origin.x;
-                continue;
-            }
-            const auto &glyph = font->get_glyph(c);
-            cursor.x += glyph.advance.x * scale_factor;
+        if (bracket->match == BracketIndex::none) {
+            return {1.0f, 0.25f, 0.25f, 1.0f};
         }
-        return cursor;
+        return depths[bracket->depth % 3];
     }
 
-    void end(const omega::math::mat4 &view_proj) {
-        // render the character batch
-        shader->bind();
-        vbo->bind();
-        vao->bind();
-        shader->set_uniform_mat4f("u_view_proj", view_proj);
-        shader->set_uniform_1i("u_texture", 0);
-        shader->set_uniform_1f("u_time", omega::util::time::get_time<f32>());
-        omega::gfx::draw_arrays(OMEGA_GL_TRIANGLES, 0, quads_rendered * 6);
-
-        vao->unbind();
-        vbo->unbind();
-        shader->unbind();
+    // index of the first token that ends after idx
+    static u32 first_token(const std::vector<Token> &tokens,
+                           const GapBuffer &gap_buffer,
+                           u32 idx) {
+        auto it = std::lower_bound(
+            tokens.begin(),
+            tokens.end(),
+            idx,
+            [&](const Token &token, u32 i) {
+                return gap_buffer.get_index_from_pointer(token.text) +
+                           token.len <=
+                       i;
+            });
+        return it - tokens.begin();
     }
 
-    void render_selected(omega::gfx::ShapeRenderer &shape,
+    void render_selected(RenderBatch &batch,
                          Font *font,
                          GapBuffer &gap_buffer,
+                         const Layout &layout,
                          i32 selection_start,
+                         u32 cursor,
                          const omega::math::vec2 &pos,
-                         f32 height) {
-        auto origin = pos;
+                         f32 height,
+                         u32 first_row,
+                         u32 last_row,
+                         const omega::math::vec4 &color) {
+        if (selection_start < 0 || (u32)selection_start == cursor) {
+            return;
+        }
+        // order the selection regardless of which side the cursor is on
+        render_range(batch,
+                     font,
+                     gap_buffer,
+                     layout,
+                     omega::math::min((u32)selection_start, cursor),
+                     omega::math::max((u32)selection_start, cursor),
+                     pos,
+                     height,
+                     first_row,
+                     last_row,
+                     color);
+    }
 
+    // highlights the text in [begin, end) on the rows in [first_row,
+    // last_row], one rect per row
+    void render_range(RenderBatch &batch,
+                      Font *font,
+                      GapBuffer &gap_buffer,
+                      const Layout &layout,
+                      u32 begin,
+                      u32 end,
+                      const omega::math::vec2 &pos,
+                      f32 height,
+                      u32 first_row,
+                      u32 last_row,
+                      const omega::math::vec4 &color) {
         f32 scale_factor = height / font->get_font_size();
-        // render the highlighted bits
-        omega::math::vec2 render_pos = pos;
-        if (selection_start > -1) {
-            i32 cursor_idx = gap_buffer.cursor();
-            // cursor is after selection start
-            if (cursor_idx > selection_start) {
-                for (i32 i = 0; i < cursor_idx; i++) {
-                    char c = gap_buffer.get(i);
-                    if (c == '\n') {
-                        render_pos.y -= font->get_font_height() * scale_factor;
-                        render_pos.x = origin.x;
-                        continue;
-                    }
-                    const auto &glyph = font->get_glyph(c);
-                    if (i >= selection_start) {
-                        shape.rect(
-                            {render_pos.x,
-                             render_pos.y -
-                                 font->get_font_height() * 0.2f * scale_factor,
-                             glyph.advance.x * scale_factor,
-                             (f32)font->get_font_height() * scale_factor});
-                    }
-                    render_pos.x += glyph.advance.x * scale_factor;
-                }
-            } else if (cursor_idx < selection_start) {
-                for (i32 i = 0; i < selection_start; i++) {
-                    char c = gap_buffer.get(i);
-                    if (c == '\n') {
-                        render_pos.y -= font->get_font_height() * scale_factor;
-                        render_pos.x = origin.x;
-                        continue;
-                    }
-                    const auto &glyph = font->get_glyph(c);
-                    if (i >= cursor_idx) {
-                        shape.rect(
-                            {render_pos.x,
-                             render_pos.y -
-                                 font->get_font_height() * 0.2f * scale_factor,
-                             glyph.advance.x * scale_factor,
-                             (f32)font->get_font_height() * scale_factor});
-                    }
-                    render_pos.x += glyph.advance.x * scale_factor;
-                }
+        f32 line_height = font->get_font_height() * scale_factor;
+        const auto &wraps = layout.wraps;
+        u32 begin_row = wraps.row_of(begin);
+        u32 end_row = wraps.row_of(end);
+        // folded away entirely
+        if (begin_row == end_row && begin > wraps.row_end(begin_row)) {
+            return;
+        }
+
+        first_row = omega::math::max(first_row, begin_row);
+        last_row = omega::math::min(last_row, end_row);
+        for (u32 row = first_row; row <= last_row; ++row) {
+            // either end can be hidden by a fold
+            f32 x0 = 0.0f;
+            if (row == begin_row) {
+                x0 = row_x(font,
+                           gap_buffer,
+                           layout,
+                           row,
+                           omega::math::min(begin, wraps.row_end(row)));
+            }
+            u32 x1_idx = wraps.row_end(row);
+            if (row == end_row) {
+                x1_idx = omega::math::min(end, x1_idx);
             }
+            f32 x1 = row_x(font, gap_buffer, layout, row, x1_idx);
+            if (x1 <= x0) {
+                continue;
+            }
+            batch.rect(RenderBatch::Layer::DOCUMENT_OVERLAY,
+                       {pos.x + x0 * scale_factor,
+                        pos.y - row * line_height -
+                            font->get_font_height() * 0.2f * scale_factor,
+                        (x1 - x0) * scale_factor,
+                        line_height},
+                       color);
         }
     }
 
   private:
-    struct Vertex {
-        omega::math::vec2 pos;
-        omega::math::vec2 tex_coords;
-        omega::math::vec4 color;
-    };
-    u32 quad_count = 500; // so we can draw lots of chars
-    u32 quads_rendered = 0;
+    // unscaled x of idx within row
+    f32 row_x(Font *font,
+              GapBuffer &gap_buffer,
+              const Layout &layout,
+              u32 row,
+              u32 idx) {
+        u32 row_start = layout.wraps.row_start(row);
+        u32 line_start =
+            layout.lines.line_start(layout.lines.line_of(row_start));
+        return line_x(font, gap_buffer, layout.widths, line_start, idx) -
+               layout.wraps.row_x(row);
+    }
+
+    // unscaled x of idx on the line starting at line_start
+    f32 line_x(Font *font,
+               GapBuffer &gap_buffer,
+               const WidthIndex &widths,
+               u32 line_start,
+               u32 idx) {
+        auto checkpoint = widths.before(line_start, idx);
+        return checkpoint.x + text_width(font, gap_buffer, checkpoint.idx, idx);
+    }
+
+    // unscaled width of the characters in [start, end) on a single line
+    f32 text_width(Font *font, GapBuffer &gap_buffer, u32 start, u32 end) {
+        if (font->is_monospace()) {
+            return columns(gap_buffer, start, end) * font->get_mono_advance();
+        }
+        f32 width = 0.0f;
+        for (u32 i = start; i < end; ++i) {
+            width += char_advance(font, gap_buffer, i);
+        }
+        return width;
+    }
+
+    // characters in [start, end), continuation bytes don't count
+    static u32 columns(const GapBuffer &gap_buffer, u32 start, u32 end) {
+        u32 count = end - start;
+        for (u32 i = start; i < end; ++i) {
+            count -= utf8::is_continuation(gap_buffer.get(i));
+        }
+        return count;
+    }
+
+    // advance of the byte at i, continuation bytes of UTF-8 characters take
+    // no space of their own
+    f32 char_advance(Font *font, GapBuffer &gap_buffer, u32 i) {
+        u8 c = gap_buffer.get(i);
+        if (c < 0x80) {
+            return font->get_advance(c);
+        }
+        if (utf8::is_continuation(c)) {
+            return 0.0f;
+        }
+        u32 len = 1;
+        return font->get_advance(gap_buffer.codepoint_at(i, len));
+    }
+
+    bool animated = true;
 
-    omega::util::uptr<omega::gfx::VertexBuffer> vbo = nullptr;
-    omega::util::uptr<omega::gfx::VertexArray> vao = nullptr;
     omega::gfx::Shader *shader = nullptr;
 };
 
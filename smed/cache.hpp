@@ -0,0 +1,64 @@
+#ifndef SMED_CACHE_HPP
+#define SMED_CACHE_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <omega/util/types.hpp>
+#include <string>
+
+/**
+ * Path of a file in smed's cache directory, named by a hash of key with the
+ * given extension. Empty when there is no cache directory
+ * */
+inline std::string cache_file(const std::string &key, const char *extension) {
+    std::filesystem::path dir;
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME")) {
+        dir = xdg;
+    } else if (const char *home = std::getenv("HOME")) {
+        dir = std::filesystem::path(home) / ".cache";
+    } else {
+        return "";
+    }
+    char name[48];
+    std::snprintf(name,
+                  sizeof(name),
+                  "%016zx.%s",
+                  std::hash<std::string>{}(key),
+                  extension);
+    return (dir / "smed" / name).string();
+}
+
+// bounds checked reads out of a mapped cache file
+struct CacheReader {
+    const char *data;
+    size_t size;
+    size_t offset = 0;
+
+    bool read(void *dest, size_t n) {
+        if (offset + n > size) {
+            return false;
+        }
+        std::memcpy(dest, data + offset, n);
+        offset += n;
+        return true;
+    }
+    // pointer into the mapping, so large blocks aren't copied
+    const char *view(size_t n) {
+        if (offset + n > size) {
+            return nullptr;
+        }
+        const char *ptr = data + offset;
+        offset += n;
+        return ptr;
+    }
+    // whether n elements of elem_size bytes are left, checked before sizing
+    // anything by a count read from the file
+    bool fits(size_t n, size_t elem_size) const {
+        return n <= (size - offset) / elem_size;
+    }
+};
+
+#endif // SMED_CACHE_HPP
@@ -1,10 +1,14 @@
 #include "editor.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <omega/core/error.hpp>
 #include <omega/events/event.hpp>
+#include <omega/gfx/gl.hpp>
 #include <omega/gfx/shader.hpp>
 #include <omega/gfx/sprite_batch.hpp>
 #include <omega/ui/font.hpp>
@@ -13,9 +17,11 @@
 #include <omega/util/time.hpp>
 
 #include "smed/buffer_renderer.hpp"
+#include "smed/frame_stats.hpp"
 #include "smed/gap_buffer.hpp"
 #include "smed/key_lag.hpp"
 #include "smed/lexer.hpp"
+#include "smed/utf8.hpp"
 
 bool ctrl_char(omega::events::KeyManager &keys, omega::events::Key k) {
     using namespace omega::events;
@@ -25,14 +31,27 @@ bool ctrl_char(omega::events::KeyManager &keys, omega::events::Key k) {
 
 Editor::Editor(omega::gfx::Shader *shader,
                omega::gfx::Shader *shader_search,
+               omega::gfx::Shader *shader_tile,
                Font *font,
                std::string path)
     : text(""),
-      lexer(&this->text, font),
+      lexer(&this->text,
+            font,
+            &layout.widths,
+            &layout.wraps,
+            &layout.brackets),
       buffer_renderer(shader),
+      project_search(project_pool),
       font_renderer(shader_search),
-      file_explorer(".") {
+      render_batch(shader_search),
+      tile_cache(shader_tile),
+      shader_solid(shader_search),
+      shader_tile(shader_tile),
+      file_explorer("."),
+      file_finder(project_pool),
+      symbols(project_pool) {
     using namespace omega::events;
+    views.push_back(omega::util::create_uptr<View>(shader_solid, shader_tile));
 
     // add a ./ if there isn't already one
     if (path != "." && !path.starts_with("./")) {
@@ -46,6 +65,7 @@ Editor::Editor(omega::gfx::Shader *shader,
         root = path;
     }
     file_explorer.set_root(root);
+    symbols.build(root);
     std::string out; // unused
     file_explorer.open(path, out);
 
@@ -55,8 +75,7 @@ Editor::Editor(omega::gfx::Shader *shader,
         std::ifstream ifs(path);
         std::string text((std::istreambuf_iterator<char>(ifs)),
                          (std::istreambuf_iterator<char>()));
-        this->text.open(text.c_str());
-        retokenize();
+        load(text, path);
     } else {
         // otherwise set the mode to FILE_EXPLORER
         mode = Mode::FILE_EXPLORER;
@@ -69,13 +88,40 @@ Editor::Editor(omega::gfx::Shader *shader,
             if (selection_start > -1) {
                 backspace();
             } else {
-                this->text.backspace_char();
+                u32 from = this->text.prev_char(this->text.cursor());
+                while (this->text.cursor() > from) {
+                    this->text.backspace_char();
+                }
             }
             retokenize();
         } else if (mode == Mode::SEARCHING) {
-            if (search_text.length() > 0) search_text.pop_back();
+            if (search_text.length() > 0) {
+                utf8::pop_back(search_text);
+                update_search();
+            }
+        } else if (mode == Mode::REPLACING ||
+                   mode == Mode::PROJECT_REPLACE) {
+            if (replace_text.length() > 0) {
+                utf8::pop_back(replace_text);
+                update_project_replacer();
+            }
+        } else if (mode == Mode::PROJECT_SEARCH) {
+            if (project_query.length() > 0) {
+                utf8::pop_back(project_query);
+                update_project_search();
+            }
+        } else if (mode == Mode::FILE_FINDER) {
+            if (finder_query.length() > 0) {
+                utf8::pop_back(finder_query);
+                update_file_finder();
+            }
+        } else if (mode == Mode::SYMBOL_SEARCH) {
+            if (symbol_query.length() > 0) {
+                utf8::pop_back(symbol_query);
+                symbol_selected = 0;
+            }
         } else if (mode == Mode::NEW_FILE) {
-            if (new_file_text.length() > 0) new_file_text.pop_back();
+            if (new_file_text.length() > 0) utf8::pop_back(new_file_text);
         }
     });
 
@@ -85,7 +131,11 @@ Editor::Editor(omega::gfx::Shader *shader,
         if (selection_start > -1) {
             backspace();
         } else {
-            this->text.delete_char();
+            u32 n = this->text.next_char(this->text.cursor()) -
+                    this->text.cursor();
+            for (u32 i = 0; i < n; ++i) {
+                this->text.delete_char();
+            }
         }
         retokenize();
     });
@@ -101,16 +151,34 @@ Editor::Editor(omega::gfx::Shader *shader,
             open(file_explorer.get_cwd_ls()[selected_idx]);
 
         } else if (mode == Mode::SEARCHING) {
-            i32 s = this->text.search(this->text.cursor(), search_text);
-            // re-search if it's the 2nd time we're searching
-            if (s == this->text.cursor() &&
-                this->text.cursor() < this->text.length()) {
-                s = this->text.search(this->text.cursor() + 1, search_text);
-            }
-            if (s != -1) {
-                this->text.move_cursor_to(s);
+            // jump to the next match after the cursor
+            const auto &matches = search.get_matches();
+            if (!matches.empty()) {
+                u32 next = search.next(this->text.cursor() + 1);
+                this->text.move_cursor_to(matches[next].begin);
                 retokenize();
             }
+        } else if (mode == Mode::REPLACING) {
+            if (input.key_manager[Key::k_l_ctrl]) {
+                replace_all();
+            } else {
+                replace_current();
+            }
+        } else if (mode == Mode::PROJECT_REPLACE &&
+                   input.key_manager[Key::k_l_ctrl]) {
+            replace_in_files();
+        } else if (mode == Mode::PROJECT_SEARCH ||
+                   mode == Mode::PROJECT_REPLACE) {
+            open_project_result();
+        } else if (mode == Mode::FILE_FINDER) {
+            const auto &matches = file_finder.get_matches();
+            if (finder_selected < matches.size()) {
+                open(file_finder.get_path(matches[finder_selected]));
+            }
+        } else if (mode == Mode::SYMBOL_SEARCH) {
+            if (symbol_selected < symbol_results.size()) {
+                open_symbol(symbol_results[symbol_selected]);
+            }
         } else if (mode == Mode::NEW_FILE) {
             new_file();
         }
@@ -131,7 +199,8 @@ Editor::Editor(omega::gfx::Shader *shader,
                 this->text.move_cursor_to(res);
             }
         } else if (this->text.cursor() > 0) {
-            this->text.move_buffer(false);
+            this->text.move_cursor_to(
+                this->text.prev_char(this->text.cursor()));
         }
 
         retokenize();
@@ -150,11 +219,18 @@ Editor::Editor(omega::gfx::Shader *shader,
                 this->text.move_cursor_to(res);
             }
         } else if (this->text.buff2() < this->text.tail()) {
-            this->text.move_buffer(true);
+            this->text.move_cursor_to(
+                this->text.next_char(this->text.cursor()));
         }
         retokenize();
     });
     register_key(Key::k_up, [&](InputManager &input) {
+        if (is_completing()) {
+            if (completion_selected >= 1) {
+                completion_selected--;
+            }
+            return;
+        }
         if (mode == Mode::FILE_EXPLORER) {
             selected_idx++;
             if (selected_idx >= file_explorer.get_cwd_size()) {
@@ -162,27 +238,36 @@ Editor::Editor(omega::gfx::Shader *shader,
             }
             return;
         }
-        // calcute the current line start and the previous line start
-        u32 line_start = this->text.find_line_start(this->text.cursor());
-        u32 prev_line_start = line_start; // both are 0 when line_start = 0
-        if (line_start > 0) {
-            prev_line_start = this->text.find_line_start(line_start - 1);
-        }
-        // calculate the current column and previous column
-        u32 current_col = this->text.cursor() - line_start;
-        // ensures that if the previous vertical_pos > current_col, the cursor
-        // should move there
-        u32 prev_col_idx =
-            prev_line_start + omega::math::max((i32)current_col, vertical_pos);
-
-        // if this doesn't cause the cursor to overflow into this current line
-        if (prev_col_idx < line_start) {
-            this->text.move_cursor_to(prev_col_idx);
-        } // when the previous line is shorter
-        else if (line_start > 0) {
-            this->text.move_cursor_to(line_start - 1);
-        } else if (line_start == 0) {
+        // results are listed from the top
+        if (mode == Mode::PROJECT_SEARCH || mode == Mode::PROJECT_REPLACE) {
+            if (project_selected >= 1) {
+                project_selected--;
+            }
+            return;
+        }
+        if (mode == Mode::FILE_FINDER) {
+            if (finder_selected >= 1) {
+                finder_selected--;
+            }
+            return;
+        }
+        if (mode == Mode::SYMBOL_SEARCH) {
+            if (symbol_selected >= 1) {
+                symbol_selected--;
+            }
+            return;
+        }
+        // move by visual rows, which are lines when nothing wraps
+        const auto &wraps = layout.wraps;
+        u32 row = wraps.row_of(this->text.cursor());
+        u32 current_col = this->text.cursor() - wraps.row_start(row);
+        if (row == 0) {
             this->text.move_cursor_to(0);
+        } else {
+            // ensures that if the previous vertical_pos > current_col, the
+            // cursor should move there
+            this->text.move_cursor_to(row_column_index(
+                row - 1, omega::math::max((i32)current_col, vertical_pos)));
         }
 
         // track the vertical position, if this is the first up/down keystroke
@@ -196,29 +281,45 @@ Editor::Editor(omega::gfx::Shader *shader,
         retokenize();
     });
     register_key(Key::k_down, [&](InputManager &input) {
+        if (is_completing()) {
+            if (completion_selected + 1 < completions.size()) {
+                completion_selected++;
+            }
+            return;
+        }
         if (mode == Mode::FILE_EXPLORER) {
             if (selected_idx >= 1) {
                 selected_idx--;
             }
             return;
         }
-        u32 idx = this->text.find_line_end(this->text.cursor());
-        if (idx == text.length()) {
-            this->text.move_cursor_to(idx);
+        if (mode == Mode::PROJECT_SEARCH || mode == Mode::PROJECT_REPLACE) {
+            if (project_selected + 1 < project_results.size()) {
+                project_selected++;
+            }
             return;
         }
-        u32 next_line_end = this->text.find_line_end(idx + 1);
-        // calculate current column
-        u32 line_start = this->text.find_line_start(this->text.cursor());
-        u32 current_col = this->text.cursor() - line_start;
-
-        u32 next_col_idx =
-            idx + 1 + omega::math::max((i32)current_col, vertical_pos);
-        if (next_col_idx <= next_line_end) {
-            this->text.move_cursor_to(next_col_idx);
-        } else {
-            this->text.move_cursor_to(next_line_end);
+        if (mode == Mode::FILE_FINDER) {
+            if (finder_selected + 1 < file_finder.get_matches().size()) {
+                finder_selected++;
+            }
+            return;
+        }
+        if (mode == Mode::SYMBOL_SEARCH) {
+            if (symbol_selected + 1 < symbol_results.size()) {
+                symbol_selected++;
+            }
+            return;
         }
+        const auto &wraps = layout.wraps;
+        u32 row = wraps.row_of(this->text.cursor());
+        if (row + 1 >= wraps.row_count()) {
+            this->text.move_cursor_to(text.length());
+            return;
+        }
+        u32 current_col = this->text.cursor() - wraps.row_start(row);
+        this->text.move_cursor_to(row_column_index(
+            row + 1, omega::math::max((i32)current_col, vertical_pos)));
         // track the vertical position, if this is the first up/down keystroke
         if (vertical_pos == -1) {
             vertical_pos = current_col;
@@ -231,6 +332,10 @@ Editor::Editor(omega::gfx::Shader *shader,
         retokenize();
     });
     register_key(Key::k_tab, [&](InputManager &input) {
+        if (is_completing()) {
+            accept_completion();
+            return;
+        }
         for (u32 i = 0; i < 4; ++i) {
             this->text.insert_char(' ');
         }
@@ -238,123 +343,537 @@ Editor::Editor(omega::gfx::Shader *shader,
     });
 }
 
-void Editor::render(Font *font,
-                    omega::scene::OrthographicCamera &camera,
-                    omega::gfx::SpriteBatch &batch,
-                    omega::gfx::ShapeRenderer &shape) {
-    f32 height = font_render_height;
-    f32 scale_factor = height / font->get_font_size();
+Editor::~Editor() {
+    // the background jobs reference the components, every one of them is
+    // cancelled and the pool drained before any goes away
+    project_search.cancel();
+    project_search.cancel_index();
+    file_finder.cancel();
+    symbols.cancel();
+    project_pool.wait();
+}
+
+void Editor::render(Font *font, omega::scene::OrthographicCamera &camera) {
+    FrameStats::Scope scope(FrameStats::Phase::VERTEX_BUILD);
+    render_batch.begin();
+    font_renderer.begin();
+    render_batch.set_view_proj(RenderBatch::Layer::UI,
+                               camera.get_projection_matrix());
+    render_batch.set_view_proj(RenderBatch::Layer::POPUP_BACKGROUND,
+                               camera.get_projection_matrix());
+    render_batch.set_view_proj(RenderBatch::Layer::POPUP,
+                               camera.get_projection_matrix());
 
-    static omega::math::vec2 pos;
     if (mode == Mode::FILE_EXPLORER || mode == Mode::NEW_FILE) {
-        font_renderer.set_view_proj_matrix(camera.get_projection_matrix());
-        font_renderer.begin();
-        i32 i = 0;
-        for (auto path : file_explorer.get_cwd_ls()) {
-            f32 render_height = height;
-            omega::math::vec4 color{0.9f, 0.9f, 0.9f, 1.0f};
-            if (selected_idx == i) {
-                color = omega::util::color::white;
-                render_height *= 1.3f;
-            }
-            if (std::filesystem::is_directory(path)) {
-                path += "/";
-            }
-            font_renderer.render(
-                font, path, {20.0f, 100 + 30.0f * i++}, render_height, color);
-        }
-        font_renderer.end();
-        if (mode == Mode::NEW_FILE) {
-            auto corner = omega::math::vec2{camera.get_width() - 300.0f,
-                                            camera.get_height() - 40.0f};
-            shape.begin();
-            shape.set_view_projection_matrix(camera.get_projection_matrix());
-            shape.color = omega::util::color::black;
-            shape.rect({corner.x, corner.y, 300.0f, 60.0f});
-            shape.end();
-
-            font_renderer.set_view_proj_matrix(camera.get_projection_matrix());
-            font_renderer.begin();
-            font_renderer.render(font,
-                                 "New File: ",
-                                 {corner.x - 75.0f, corner.y + 10.0f},
-                                 15.0f,
-                                 {0.5f, 0.5f, 0.5f, 1.0f});
-            font_renderer.render(font,
-                                 new_file_text,
-                                 {corner.x + 10.0f, corner.y + 10.0f},
-                                 20.0f,
-                                 omega::util::color::white);
-            font_renderer.end();
+        // the explorer doesn't pan, so nothing is left to animate
+        for (auto &view : views) {
+            view->camera_settled = true;
+        }
+        render_file_explorer(font, camera);
+    } else if (mode == Mode::PROJECT_SEARCH ||
+               mode == Mode::PROJECT_REPLACE) {
+        for (auto &view : views) {
+            view->camera_settled = true;
+        }
+        render_project_search(font, camera);
+    } else if (mode == Mode::FILE_FINDER) {
+        for (auto &view : views) {
+            view->camera_settled = true;
+        }
+        render_file_finder(font, camera);
+    } else if (mode == Mode::SYMBOL_SEARCH) {
+        for (auto &view : views) {
+            view->camera_settled = true;
+        }
+        render_symbol_search(font, camera);
+    } else {
+        render_views(font, camera);
+    }
+
+    // the views are drawn already, the ui goes on top of them at once
+    font_renderer.end();
+    render_batch.end();
+}
+
+void Editor::render_views(Font *font,
+                          omega::scene::OrthographicCamera &camera) {
+    // soft wrap at the views' width, clear of the minimap. The width only
+    // changes with the zoom, so this relexes once rather than every frame
+    f32 height = font_render_height;
+    f32 view_width = camera.get_width() / views.size();
+    if (wrap) {
+        f32 width = (view_width - views[0]->minimap.get_width() - wrap_margin) /
+                    (height / font->get_font_size());
+        if (width != layout.wraps.get_width()) {
+            layout.wraps.set_width(width);
+            retokenize();
+        }
+    }
+
+    // every view draws into its own slice of the screen
+    i32 viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    tile_cache.begin_frame();
+    for (u32 i = 0; i < views.size(); ++i) {
+        View &view = *views[i];
+        if (view.camera == nullptr ||
+            view.camera->get_width() != view_width ||
+            view.camera->get_height() != camera.get_height()) {
+            auto position = view.camera ? view.camera->position
+                                        : omega::math::vec3{0.0f};
+            view.camera = omega::util::create_uptr<
+                omega::scene::OrthographicCamera>(
+                0.0f, view_width, 0.0f, camera.get_height(), -1.0f, 1.0f);
+            view.camera->position = position;
+        }
+        i32 left = viewport[0] + viewport[2] * i / (i32)views.size();
+        i32 right = viewport[0] + viewport[2] * (i + 1) / (i32)views.size();
+        glViewport(left, viewport[1], right - left, viewport[3]);
+        render_document(font, view, i == active_view);
+
+        // separate the views
+        if (i > 0) {
+            render_batch.rect(RenderBatch::Layer::UI,
+                              {view_width * i - 1.0f,
+                               0.0f,
+                               2.0f,
+                               camera.get_height()},
+                              {0.3f, 0.3f, 0.4f, 1.0f});
         }
-        return;
     }
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
 
+    // render the file name
+    font_renderer.render(render_batch,
+                         font,
+                         file_explorer.get_current_file(),
+                         {10.0f, 10.0f},
+                         20.0f);
+
+    // render find/replace box, with the number of the match at the cursor
+    if (mode == Mode::SEARCHING) {
+        const auto &matches = search.get_matches();
+        std::string count = std::to_string(matches.size());
+        u32 current = search.next(text.cursor());
+        if (current < matches.size() &&
+            matches[current].begin == text.cursor()) {
+            count = std::to_string(current + 1) + "/" + count;
+        }
+        if (!search.is_valid()) {
+            count = "invalid";
+        }
+        render_input_box(font,
+                         camera,
+                         search.is_regex() ? "Regex: " : "Search: ",
+                         search_text,
+                         count);
+    } else if (mode == Mode::REPLACING) {
+        render_input_box(font,
+                         camera,
+                         "Replace: ",
+                         replace_text,
+                         std::to_string(search.get_matches().size()));
+    }
+}
+
+void Editor::render_document(Font *font, View &view, bool active) {
+    f32 height = font_render_height;
+    auto &camera = *view.camera;
+    auto &batch = view.batch;
+    // the active view's cursor is in the gap buffer
+    u32 cursor = active ? text.cursor() : view.cursor;
+    i32 selection = active ? selection_start : view.selection_start;
+
+    batch.begin();
     // some camera panning action! Recalculate the vp from the last frame pos
+    omega::math::vec2 &pos = view.cursor_pos;
     omega::math::vec3 target_cam{0.0f};
-    target_cam.x = pos.x - camera.get_width() * 0.25f;
+    target_cam.x = camera_target_x(pos, camera);
     target_cam.y = pos.y - camera.get_height() * 0.5f;
     camera.position += (target_cam - camera.position) * 0.025f;
     camera.recalculate_view_matrix();
+    batch.set_view_proj(RenderBatch::Layer::DOCUMENT,
+                        camera.get_view_projection_matrix());
+    batch.set_view_proj(RenderBatch::Layer::DOCUMENT_OVERLAY,
+                        camera.get_view_projection_matrix());
+    batch.set_view_proj(RenderBatch::Layer::MINIMAP,
+                        camera.get_projection_matrix());
+    batch.set_view_proj(RenderBatch::Layer::UI,
+                        camera.get_projection_matrix());
+    batch.set_view_proj(RenderBatch::Layer::POPUP_BACKGROUND,
+                        camera.get_view_projection_matrix());
+    batch.set_view_proj(RenderBatch::Layer::POPUP,
+                        camera.get_view_projection_matrix());
 
-    buffer_renderer.begin();
-    pos = buffer_renderer.render(font,
-                                 camera.get_view_projection_matrix(),
-                                 text,
-                                 tokens,
-                                 {0, 0},
-                                 {0, 0},
-                                 height,
-                                 omega::util::color::white);
-    // calculate cursor pos
-    omega::math::vec2 cursor_pos_bottom = {pos.x, pos.y};
-    omega::math::vec2 cursor_pos_top = {pos.x, pos.y + height * 0.8};
+    auto [first_row, last_row] = visible_rows(font, camera, height);
+    // panning only moves the cached tiles around, views too large for the
+    // cache are drawn directly
+    if (!use_tiles || !tile_cache.render(batch,
+                                         buffer_renderer,
+                                         font,
+                                         text,
+                                         tokens,
+                                         layout,
+                                         camera,
+                                         height,
+                                         omega::util::color::white,
+                                         background,
+                                         text_version)) {
+        buffer_renderer.render(batch,
+                               font,
+                               text,
+                               tokens,
+                               layout,
+                               {0, 0},
+                               height,
+                               omega::util::color::white,
+                               first_row,
+                               last_row,
+                               camera.position.x,
+                               camera.position.x + camera.get_width());
+    }
+    pos = buffer_renderer.index_pos(font, text, layout, cursor, {0, 0}, height);
+
+    // check if the camera still has to ease towards the new cursor pos
+    target_cam.x = camera_target_x(pos, camera);
+    target_cam.y = pos.y - camera.get_height() * 0.5f;
+    view.camera_settled = std::abs(target_cam.x - camera.position.x) < 0.5f &&
+                          std::abs(target_cam.y - camera.position.y) < 0.5f;
+
+    // render cursor, dimmed in the views without focus
+    batch.rect(RenderBatch::Layer::DOCUMENT_OVERLAY,
+               {pos.x, pos.y, 2.0f, height * 0.8f},
+               active ? omega::util::color::white
+                      : omega::math::vec4{0.5f, 0.5f, 0.5f, 1.0f});
+
+    // mark the collapsed folds on screen at the end of their header
+    const auto &lines = layout.lines;
+    u32 first_line = lines.line_of(layout.wraps.row_start(first_row));
+    u32 last_line = lines.line_of(layout.wraps.row_start(last_row));
+    const auto &hidden = layout.folds.get_hidden();
+    auto fold = std::lower_bound(
+        hidden.begin(),
+        hidden.end(),
+        first_line,
+        [](const FoldIndex::Fold &f, u32 line) { return f.header < line; });
+    for (; fold != hidden.end() && fold->header <= last_line; ++fold) {
+        auto marker = buffer_renderer.index_pos(
+            font, text, layout, lines.line_end(fold->header), {0, 0}, height);
+        font_renderer.render(batch,
+                             font,
+                             " ...",
+                             marker,
+                             height,
+                             {0.5f, 0.5f, 0.6f, 1.0f},
+                             RenderBatch::Layer::DOCUMENT_OVERLAY);
+    }
+
+    view.minimap.render(batch,
+                        text,
+                        tokens,
+                        layout.wraps,
+                        camera,
+                        first_row,
+                        last_row,
+                        {0.05f, 0.05f, 0.08f, 1.0f},
+                        text_version);
 
-    // render the text batch finally
-    buffer_renderer.end(camera.get_view_projection_matrix());
+    // highlight the visible search matches, the one at the cursor brighter
+    const auto &matches = search.get_matches();
+    u32 view_begin = layout.wraps.row_start(first_row);
+    u32 view_end = layout.wraps.row_end(last_row);
+    auto match = std::lower_bound(
+        matches.begin(),
+        matches.end(),
+        view_begin,
+        [](const SearchIndex::Match &m, u32 idx) { return m.end <= idx; });
+    for (; match != matches.end() && match->begin <= view_end; ++match) {
+        omega::math::vec4 color{0.9f, 0.7f, 0.2f, 0.25f};
+        if (match->begin == cursor) {
+            color.a = 0.6f;
+        }
+        buffer_renderer.render_range(batch,
+                                     font,
+                                     text,
+                                     layout,
+                                     match->begin,
+                                     match->end,
+                                     {0, 0},
+                                     height,
+                                     first_row,
+                                     last_row,
+                                     color);
+    }
+
+    // the pair of brackets at the cursor
+    u32 partner = layout.brackets.match(cursor);
+    if (partner != BracketIndex::none) {
+        for (u32 idx : {partner, layout.brackets.match(partner)}) {
+            buffer_renderer.render_range(batch,
+                                         font,
+                                         text,
+                                         layout,
+                                         idx,
+                                         idx + 1,
+                                         {0, 0},
+                                         height,
+                                         first_row,
+                                         last_row,
+                                         {1.0f, 1.0f, 1.0f, 0.2f});
+        }
+    }
 
-    // render cursor
-    shape.begin();
-    shape.set_view_projection_matrix(camera.get_view_projection_matrix());
-    shape.color = omega::util::color::white;
-    shape.line(cursor_pos_bottom, cursor_pos_top);
+    // identifier completions under the cursor, the chosen one brighter
+    if (active && is_completing()) {
+        f32 scale = height / font->get_font_size();
+        f32 row = font->get_font_height() * scale;
+        f32 width = 0.0f;
+        for (const std::string &word : completions) {
+            f32 advance = 0.0f;
+            for (char c : word) {
+                advance += font->get_advance(c);
+            }
+            width = omega::math::max(width, advance * scale);
+        }
+        width += 10.0f;
+        batch.rect(RenderBatch::Layer::POPUP_BACKGROUND,
+                   {pos.x,
+                    pos.y - row * completions.size(),
+                    width,
+                    row * completions.size()},
+                   {0.1f, 0.1f, 0.15f, 1.0f});
+        for (u32 i = 0; i < completions.size(); ++i) {
+            omega::math::vec4 color{0.7f, 0.7f, 0.7f, 1.0f};
+            if (i == completion_selected) {
+                color = omega::util::color::white;
+            }
+            font_renderer.render(batch,
+                                 font,
+                                 completions[i],
+                                 {pos.x + 5.0f, pos.y - row * (i + 1)},
+                                 height,
+                                 color,
+                                 RenderBatch::Layer::POPUP);
+        }
+    }
 
     // draw the selected text
-    shape.color.a = 0.5f;
-    buffer_renderer.render_selected(
-        shape, font, text, selection_start, {0, 0}, height);
-    shape.end();
+    buffer_renderer.render_selected(batch,
+                                    font,
+                                    text,
+                                    layout,
+                                    selection,
+                                    cursor,
+                                    {0, 0},
+                                    height,
+                                    first_row,
+                                    last_row,
+                                    {1.0f, 1.0f, 1.0f, 0.5f});
+    batch.end();
+}
 
-    // render the file name
-    font_renderer.set_view_proj_matrix(camera.get_projection_matrix());
-    font_renderer.begin();
-    font_renderer.render(
-        font, file_explorer.get_current_file(), {10.0f, 10.0f}, 20.0f);
-    font_renderer.end();
+void Editor::render_file_explorer(Font *font,
+                                  omega::scene::OrthographicCamera &camera) {
+    f32 height = font_render_height;
+    i32 i = 0;
+    for (auto path : file_explorer.get_cwd_ls()) {
+        f32 render_height = height;
+        omega::math::vec4 color{0.9f, 0.9f, 0.9f, 1.0f};
+        if (selected_idx == i) {
+            color = omega::util::color::white;
+            render_height *= 1.3f;
+        }
+        if (std::filesystem::is_directory(path)) {
+            path += "/";
+        }
+        font_renderer.render(render_batch,
+                             font,
+                             path,
+                             {20.0f, 100 + 30.0f * i++},
+                             render_height,
+                             color);
+    }
+    if (mode == Mode::NEW_FILE) {
+        render_input_box(font, camera, "New File: ", new_file_text);
+    }
+}
 
-    // render find/replace box
-    if (mode == Mode::SEARCHING) {
-        auto corner = omega::math::vec2{camera.get_width() - 300.0f,
-                                        camera.get_height() - 40.0f};
-        shape.begin();
-        shape.set_view_projection_matrix(camera.get_projection_matrix());
-        shape.color = omega::util::color::black;
-        shape.rect({corner.x, corner.y, 300.0f, 60.0f});
-        shape.end();
-
-        font_renderer.set_view_proj_matrix(camera.get_projection_matrix());
-        font_renderer.begin();
-        font_renderer.render(font,
-                             "Search: ",
-                             {corner.x - 75.0f, corner.y + 10.0f},
-                             15.0f,
-                             {0.5f, 0.5f, 0.5f, 1.0f});
-        font_renderer.render(font,
-                             search_text,
-                             {corner.x + 10.0f, corner.y + 10.0f},
+void Editor::render_project_search(Font *font,
+                                   omega::scene::OrthographicCamera &camera) {
+    // results stream in while the search runs
+    project_search.take_results(project_results);
+    // rewritten files don't match anymore, the search shows what's left
+    if (project_replacing && !project_search.is_replacing()) {
+        project_replacing = false;
+        auto report = project_search.get_replace_report();
+        update_project_search();
+        project_status = std::to_string(report.replaced) + " replaced in " +
+                         std::to_string(report.files) + " files";
+        if (report.failed > 0) {
+            project_status += ", " + std::to_string(report.failed) + " failed";
+        }
+    }
+    bool replacing = mode == Mode::PROJECT_REPLACE;
+    f32 spacing = 30.0f;
+    u32 rows = omega::math::max(
+        1.0f, std::floor((camera.get_height() - 140.0f) / spacing));
+    u32 first = project_selected >= rows ? project_selected - rows + 1 : 0;
+    u32 last = omega::math::min(first + rows, (u32)project_results.size());
+    for (u32 i = first; i < last; ++i) {
+        const auto &result = project_results[i];
+        omega::math::vec4 color{0.7f, 0.7f, 0.7f, 1.0f};
+        if (i == project_selected) {
+            color = omega::util::color::white;
+        }
+        // the line as it will be, when the match is within the preview
+        std::string preview = result.preview;
+        TextSegments line(preview.data(), preview.size());
+        Replacer::Match match;
+        if (replacing && project_replacer->find(line, result.column, match) &&
+            match.begin == result.column) {
+            std::string replaced = preview.substr(0, match.begin);
+            project_replacer->expand(line, match, replaced);
+            preview = replaced + preview.substr(match.end);
+        }
+        font_renderer.render(render_batch,
+                             font,
+                             result.path + ":" +
+                                 std::to_string(result.line + 1) + ": " +
+                                 preview,
+                             {20.0f,
+                              camera.get_height() - 100.0f -
+                                  spacing * (i - first)},
                              20.0f,
-                             omega::util::color::white);
-        font_renderer.end();
+                             color);
+    }
+
+    std::string status = std::to_string(project_results.size());
+    if (project_search.is_truncated()) {
+        status += "+";
+    }
+    if (project_search.is_running() || project_search.is_replacing()) {
+        status += "...";
+    }
+    if (project_search.is_indexing()) {
+        status += " (indexing)";
+    }
+    if (!project_status.empty()) {
+        status = project_status;
+    }
+    if (replacing) {
+        render_input_box(
+            font, camera, "Replace in files: ", replace_text, status);
+    } else {
+        render_input_box(font,
+                         camera,
+                         search.is_regex() ? "Project regex: " : "Project: ",
+                         project_query,
+                         status);
+    }
+}
+
+void Editor::render_file_finder(Font *font,
+                                omega::scene::OrthographicCamera &camera) {
+    if (file_finder.poll()) {
+        finder_selected = 0;
+    }
+    const auto &matches = file_finder.get_matches();
+    f32 spacing = 30.0f;
+    u32 rows = omega::math::max(
+        1.0f, std::floor((camera.get_height() - 140.0f) / spacing));
+    u32 first = finder_selected >= rows ? finder_selected - rows + 1 : 0;
+    u32 last = omega::math::min(first + rows, (u32)matches.size());
+    for (u32 i = first; i < last; ++i) {
+        omega::math::vec4 color{0.7f, 0.7f, 0.7f, 1.0f};
+        if (i == finder_selected) {
+            color = omega::util::color::white;
+        }
+        font_renderer.render(
+            render_batch,
+            font,
+            file_finder.get_relative_path(matches[i]),
+            {20.0f, camera.get_height() - 100.0f - spacing * (i - first)},
+            20.0f,
+            color);
+    }
+
+    std::string status = std::to_string(file_finder.get_match_count());
+    if (file_finder.is_walking()) {
+        status += "...";
+    }
+    render_input_box(font, camera, "Open: ", finder_query, status);
+}
+
+void Editor::render_symbol_search(Font *font,
+                                  omega::scene::OrthographicCamera &camera) {
+    // a lookup is cheap enough to redo every frame, so a finished build
+    // shows up right away
+    symbols.search(symbol_query, max_symbols_shown, symbol_results);
+    if (symbol_selected >= symbol_results.size()) {
+        symbol_selected =
+            symbol_results.empty() ? 0 : symbol_results.size() - 1;
+    }
+    f32 spacing = 30.0f;
+    u32 rows = omega::math::max(
+        1.0f, std::floor((camera.get_height() - 140.0f) / spacing));
+    u32 first = symbol_selected >= rows ? symbol_selected - rows + 1 : 0;
+    u32 last = omega::math::min(first + rows, (u32)symbol_results.size());
+    for (u32 i = first; i < last; ++i) {
+        const SymbolIndex::Location &location = symbol_results[i];
+        omega::math::vec4 color{0.7f, 0.7f, 0.7f, 1.0f};
+        if (i == symbol_selected) {
+            color = omega::util::color::white;
+        }
+        std::string row = location.symbol.name + "  " + location.path + ":" +
+                          std::to_string(location.symbol.line + 1);
+        font_renderer.render(
+            render_batch,
+            font,
+            row,
+            {20.0f, camera.get_height() - 100.0f - spacing * (i - first)},
+            20.0f,
+            color);
+    }
+
+    std::string status = std::to_string(symbol_results.size());
+    if (symbols.is_building()) {
+        status += "...";
+    }
+    render_input_box(font, camera, "Symbol: ", symbol_query, status);
+}
+
+void Editor::render_input_box(Font *font,
+                              omega::scene::OrthographicCamera &camera,
+                              const std::string &label,
+                              const std::string &input_text,
+                              const std::string &status) {
+    auto corner = omega::math::vec2{camera.get_width() - 300.0f,
+                                    camera.get_height() - 40.0f};
+    render_batch.rect(RenderBatch::Layer::POPUP_BACKGROUND,
+                      {corner.x, corner.y, 300.0f, 60.0f},
+                      omega::util::color::black);
+    font_renderer.render(render_batch,
+                         font,
+                         label,
+                         {corner.x - 75.0f, corner.y + 10.0f},
+                         15.0f,
+                         {0.5f, 0.5f, 0.5f, 1.0f},
+                         RenderBatch::Layer::POPUP);
+    font_renderer.render(render_batch,
+                         font,
+                         input_text,
+                         {corner.x + 10.0f, corner.y + 10.0f},
+                         20.0f,
+                         omega::util::color::white,
+                         RenderBatch::Layer::POPUP);
+    if (!status.empty()) {
+        font_renderer.render(render_batch,
+                             font,
+                             status,
+                             {corner.x + 200.0f, corner.y + 10.0f},
+                             15.0f,
+                             {0.5f, 0.5f, 0.5f, 1.0f},
+                             RenderBatch::Layer::POPUP);
     }
 }
 
@@ -368,27 +887,48 @@ void Editor::save(const std::string &file) {
     of.write(text.head(), text.cursor());
     of.write(text.buff2(), text.buff2_size());
     of.close();
+    project_search.refresh_index(file_explorer.get_root().string());
 }
 
-void Editor::handle_text(omega::events::InputManager &input, char c) {
+void Editor::handle_text(omega::events::InputManager &input,
+                         const char *input_text) {
+    FrameStats::Scope scope(FrameStats::Phase::INPUT);
     auto &keys = input.key_manager;
     if (mode == Mode::SEARCHING) {
-        search_text.push_back(c);
+        search_text += input_text;
+        update_search();
+    } else if (mode == Mode::REPLACING || mode == Mode::PROJECT_REPLACE) {
+        replace_text += input_text;
+        update_project_replacer();
+    } else if (mode == Mode::PROJECT_SEARCH) {
+        project_query += input_text;
+        update_project_search();
+    } else if (mode == Mode::FILE_FINDER) {
+        finder_query += input_text;
+        update_file_finder();
+    } else if (mode == Mode::SYMBOL_SEARCH) {
+        symbol_query += input_text;
+        symbol_selected = 0;
     } else if (mode == Mode::NEW_FILE) {
-        new_file_text.push_back(c);
+        new_file_text += input_text;
     } else {
         // lock the text when ctrl is pressed
         if (!keys[omega::events::Key::k_l_ctrl]) {
             if (selection_start > -1) {
                 backspace();
             }
-            text.insert_char(c);
+            // insert every byte, text input can be a multi byte character
+            for (const char *c = input_text; *c != '\0'; ++c) {
+                text.insert_char(*c);
+            }
             retokenize();
+            update_completion();
         }
     }
 }
 
 void Editor::handle_input(omega::events::InputManager &input) {
+    FrameStats::Scope scope(FrameStats::Phase::INPUT);
     using namespace omega::events;
     auto &keys = input.key_manager;
 
@@ -412,12 +952,57 @@ void Editor::handle_input(omega::events::InputManager &input) {
     update_keys(input);
 
     // search functionality
-    if (keys[Key::k_l_ctrl] && keys[Key::k_f]) {
-        mode = Mode::SEARCHING;
+    if (keys[Key::k_l_ctrl] && keys[Key::k_f] && mode == Mode::EDITING) {
+        // with shift, search every file under the root
+        if (keys[Key::k_l_shift]) {
+            mode = Mode::PROJECT_SEARCH;
+            update_project_search();
+        } else {
+            mode = Mode::SEARCHING;
+            search_origin = text.cursor();
+        }
     }
-    // escape search functionality
-    if (keys[Key::k_escape] && mode == Mode::SEARCHING) {
-        mode = Mode::EDITING;
+    // toggle between literal and regex search
+    if (ctrl_char(keys, Key::k_r) &&
+        (mode == Mode::SEARCHING || mode == Mode::REPLACING)) {
+        search.set_regex(text, !search.is_regex());
+        update_search();
+    } else if (ctrl_char(keys, Key::k_r) &&
+               (mode == Mode::PROJECT_SEARCH ||
+                mode == Mode::PROJECT_REPLACE)) {
+        search.set_regex(text, !search.is_regex());
+        update_project_search();
+    }
+    // enter the replacement for the current query, enter replaces the match
+    // at the cursor and ctrl+enter replaces all of them. Over the project
+    // results ctrl+enter rewrites every file with a hit
+    if (ctrl_char(keys, Key::k_h) && mode == Mode::SEARCHING) {
+        mode = Mode::REPLACING;
+    } else if (ctrl_char(keys, Key::k_h) && mode == Mode::PROJECT_SEARCH) {
+        mode = Mode::PROJECT_REPLACE;
+    }
+    if (ctrl_char(keys, Key::k_z) && mode == Mode::EDITING) {
+        undo(keys[Key::k_l_shift]);
+    }
+    // escape search functionality, the highlights stay until the next escape
+    if (keys.key_just_pressed(Key::k_escape)) {
+        if (mode == Mode::SEARCHING || mode == Mode::REPLACING) {
+            mode = Mode::EDITING;
+        } else if (mode == Mode::PROJECT_SEARCH ||
+                   mode == Mode::PROJECT_REPLACE) {
+            project_search.cancel();
+            mode = Mode::EDITING;
+        } else if (mode == Mode::FILE_FINDER) {
+            // the walk keeps going, the next time starts from its list
+            mode = Mode::EDITING;
+        } else if (mode == Mode::SYMBOL_SEARCH) {
+            mode = Mode::EDITING;
+        } else if (is_completing()) {
+            completions.clear();
+        } else if (mode == Mode::EDITING) {
+            search_text.clear();
+            search.clear();
+        }
     }
 
     // zooming
@@ -457,10 +1042,56 @@ void Editor::handle_input(omega::events::InputManager &input) {
         SDL_free(paste);
         retokenize();
     }
+    // fold or unfold around the cursor
+    if (ctrl_char(keys, Key::k_k) && mode == Mode::EDITING) {
+        toggle_fold();
+    }
+    // jump to the matching bracket, with shift select the enclosing scope
+    if (ctrl_char(keys, Key::k_m) && mode == Mode::EDITING) {
+        if (keys[Key::k_l_shift]) {
+            select_scope();
+        } else {
+            jump_to_match();
+        }
+    }
+    // split views
+    if (ctrl_char(keys, Key::k_e) && mode == Mode::EDITING) {
+        if (keys[Key::k_l_shift]) {
+            close_view();
+        } else {
+            split_view();
+        }
+    }
+    if (ctrl_char(keys, Key::k_g) && mode == Mode::EDITING) {
+        focus_next_view();
+    }
+    // toggle soft wrap
+    if (ctrl_char(keys, Key::k_w)) {
+        set_wrap(!wrap);
+    }
     // open file
     if (ctrl_char(keys, Key::k_o)) {
         mode = Mode::FILE_EXPLORER;
     }
+    // fuzzy find a file, the list from last time shows until it's walked
+    // again. With shift, search the definitions by name
+    if (ctrl_char(keys, Key::k_p) &&
+        (mode == Mode::EDITING || mode == Mode::FILE_EXPLORER)) {
+        if (keys[Key::k_l_shift]) {
+            mode = Mode::SYMBOL_SEARCH;
+            symbol_query.clear();
+            symbol_selected = 0;
+        } else {
+            mode = Mode::FILE_FINDER;
+            finder_query.clear();
+            file_finder.refresh(file_explorer.get_root().string());
+            update_file_finder();
+        }
+    }
+    // go to the definition of the symbol at the cursor
+    if (ctrl_char(keys, Key::k_d) && mode == Mode::EDITING) {
+        jump_to_definition();
+    }
     // new file
     if (ctrl_char(keys, Key::k_n)) {
         if (mode == Mode::FILE_EXPLORER) {
@@ -470,7 +1101,50 @@ void Editor::handle_input(omega::events::InputManager &input) {
 }
 
 void Editor::retokenize() {
+    FrameStats::Scope scope(FrameStats::Phase::RETOKENIZE);
+    text_version++;
     tokens.clear();
+    auto &lines = layout.lines;
+    u32 line_count = lines.line_count();
+    lines.rebuild(text);
+
+    // everything indexing the text follows the edits since the last time
+    auto edit = text.take_edit();
+    u32 line = lines.line_of(text.cursor());
+    cursor_line = line;
+    if (edit.changed) {
+        // the recorded replacements can't be reverted past other edits
+        if (!applying_change) {
+            undo_stack.clear();
+            redo_stack.clear();
+        }
+        // collapsed folds below the edit keep their lines
+        layout.folds.shift(lines.line_of(edit.begin),
+                           (i32)lines.line_count() - (i32)line_count);
+        search.patch(text, edit);
+
+        // the other views' cursors move along with the text
+        const auto follow = [&](u32 idx) {
+            if (idx <= edit.begin) {
+                return idx;
+            }
+            // inside replaced text
+            if ((i64)idx < (i64)edit.end - edit.delta) {
+                return edit.begin;
+            }
+            return (u32)(idx + edit.delta);
+        };
+        for (u32 i = 0; i < views.size(); ++i) {
+            if (i == active_view) {
+                continue;
+            }
+            View &view = *views[i];
+            view.cursor = follow(view.cursor);
+            if (view.selection_start > -1) {
+                view.selection_start = follow(view.selection_start);
+            }
+        }
+    }
 
     lexer.retokenize();
     Token token = lexer.next();
@@ -478,6 +1152,356 @@ void Editor::retokenize() {
         tokens.push_back(token);
         token = lexer.next();
     }
+    FrameStats::get().count(FrameStats::Counter::TOKENS, tokens.size());
+    words.patch(text, tokens, edit);
+    // the open file's definitions follow its edits, before it's saved
+    const std::string &file = file_explorer.get_current_file();
+    if (edit.changed && SymbolIndex::is_source(file)) {
+        std::vector<SymbolIndex::Symbol> found;
+        SymbolIndex::extract(text, tokens, lines, found);
+        symbols.update_file(file, std::move(found));
+    }
+
+    FrameStats::Scope layout_scope(FrameStats::Phase::LAYOUT);
+    layout.folds.rebuild(text, tokens, lines);
+    // moving or typing into a fold opens it
+    layout.folds.reveal(line);
+    layout.wraps.rebuild(lines, layout.folds);
+}
+
+void Editor::update_search() {
+    // refines the previous matches while the query only grows
+    search.set_query(text, search_text);
+    const auto &matches = search.get_matches();
+    if (!matches.empty()) {
+        text.move_cursor_to(matches[search.next(search_origin)].begin);
+        retokenize();
+    }
+}
+
+void Editor::replace_current() {
+    const auto &matches = search.get_matches();
+    u32 current = search.next(text.cursor());
+    if (current >= matches.size()) {
+        return;
+    }
+    SearchIndex::Match match = matches[current];
+    // the first enter shows the match that is going to be replaced
+    if (match.begin != text.cursor()) {
+        text.move_cursor_to(match.begin);
+        retokenize();
+        return;
+    }
+    Replacer replacer(search_text, replace_text, search.is_regex());
+    std::string with;
+    replacer.expand(TextSegments(text), match, with);
+    replace_range(match.begin, match.end, with, match.begin + with.size());
+
+    // on to the next match
+    if (!matches.empty()) {
+        text.move_cursor_to(matches[search.next(text.cursor())].begin);
+        retokenize();
+    }
+}
+
+void Editor::replace_all() {
+    Replacer replacer(search_text, replace_text, search.is_regex());
+    std::string out;
+    u32 first, last;
+    if (replacer.replace_all(TextSegments(text), out, first, last) == 0) {
+        return;
+    }
+    replace_range(first, last, out, first);
+}
+
+void Editor::replace_range(u32 begin,
+                           u32 end,
+                           const std::string &with,
+                           u32 cursor) {
+    undo_stack.push_back({begin, text.substr(begin, end - begin), with});
+    redo_stack.clear();
+    text.splice(begin, end, with.data(), with.size(), cursor);
+    selection_start = -1;
+    vertical_pos = -1;
+    applying_change = true;
+    retokenize();
+    applying_change = false;
+}
+
+void Editor::undo(bool redo) {
+    auto &from = redo ? redo_stack : undo_stack;
+    auto &to = redo ? undo_stack : redo_stack;
+    if (from.empty()) {
+        return;
+    }
+    Change change = std::move(from.back());
+    from.pop_back();
+    // swap whichever side is in the text for the other one
+    const std::string &current = redo ? change.removed : change.inserted;
+    const std::string &next = redo ? change.inserted : change.removed;
+    text.splice(change.begin,
+                change.begin + current.size(),
+                next.data(),
+                next.size(),
+                change.begin);
+    to.push_back(std::move(change));
+    selection_start = -1;
+    vertical_pos = -1;
+    applying_change = true;
+    retokenize();
+    applying_change = false;
+}
+
+void Editor::update_project_search() {
+    project_results.clear();
+    project_selected = 0;
+    project_status.clear();
+    project_search.start(
+        file_explorer.get_root().string(), project_query, search.is_regex());
+    update_project_replacer();
+}
+
+void Editor::update_project_replacer() {
+    project_replacer = omega::util::create_uptr<Replacer>(
+        project_query, replace_text, search.is_regex());
+}
+
+void Editor::open_project_result() {
+    if (project_selected >= project_results.size()) {
+        return;
+    }
+    ProjectSearch::Result result = project_results[project_selected];
+    project_search.cancel();
+    open(result.path);
+    // the file can have changed since it was searched
+    text.move_cursor_to(omega::math::min(result.begin, text.length()));
+    selection_start = -1;
+    retokenize();
+}
+
+void Editor::replace_in_files() {
+    // the results have to be complete, or some files would be left out
+    if (project_search.is_running() || project_search.is_replacing()) {
+        return;
+    }
+    if (project_search.is_truncated()) {
+        project_status = "Too many results to replace, narrow the search";
+        return;
+    }
+    // each file's results come in together
+    std::vector<std::string> paths;
+    for (const auto &result : project_results) {
+        if (paths.empty() || paths.back() != result.path) {
+            paths.push_back(result.path);
+        }
+    }
+    if (paths.empty()) {
+        return;
+    }
+    // the open file is rewritten on disk like the others, and replaced in
+    // the buffer as one undoable change, unsaved edits stay unsaved
+    const std::string &open_file = file_explorer.get_current_file();
+    for (const std::string &path : paths) {
+        std::error_code error;
+        if (!open_file.empty() &&
+            std::filesystem::equivalent(path, open_file, error)) {
+            std::string out;
+            u32 first, last;
+            if (project_replacer->replace_all(
+                    TextSegments(text), out, first, last)) {
+                replace_range(first, last, out, first);
+            }
+            break;
+        }
+    }
+    project_search.replace_files(paths, replace_text);
+    project_replacing = true;
+}
+
+void Editor::update_file_finder() {
+    finder_selected = 0;
+    file_finder.set_query(finder_query);
+}
+
+void Editor::update_completion() {
+    completions.clear();
+    u32 end = text.cursor(), begin = end;
+    const auto is_word = [](char c) { return std::isalnum((u8)c) || c == '_'; };
+    while (begin > 0 && is_word(text.get(begin - 1))) {
+        begin--;
+    }
+    if (end - begin < min_completion_prefix ||
+        std::isdigit((u8)text.get(begin))) {
+        return;
+    }
+    words.complete(
+        text.substr(begin, end - begin), max_completions, completions);
+    completion_selected = 0;
+    completion_prefix = end - begin;
+    completion_version = text_version;
+}
+
+void Editor::accept_completion() {
+    const std::string &word = completions[completion_selected];
+    for (u32 i = completion_prefix; i < word.size(); ++i) {
+        text.insert_char(word[i]);
+    }
+    completions.clear();
+    retokenize();
+}
+
+void Editor::jump_to_definition() {
+    // the symbol the cursor is in or right after
+    u32 cursor = text.cursor();
+    auto it = std::upper_bound(
+        tokens.begin(), tokens.end(), cursor, [&](u32 i, const Token &t) {
+            return i < text.get_index_from_pointer(t.text);
+        });
+    if (it == tokens.begin()) {
+        return;
+    }
+    const Token &token = *(it - 1);
+    u32 begin = text.get_index_from_pointer(token.text);
+    if (token.type != TokenType::SYMBOL || begin + token.len < cursor) {
+        return;
+    }
+    std::string name = text.substr(begin, token.len);
+    std::vector<SymbolIndex::Location> found;
+    symbols.find(name, found);
+    if (found.size() == 1) {
+        open_symbol(found[0]);
+    } else if (found.size() > 1) {
+        mode = Mode::SYMBOL_SEARCH;
+        symbol_query = name;
+        symbol_selected = 0;
+    }
+}
+
+void Editor::open_symbol(const SymbolIndex::Location &location) {
+    std::error_code error;
+    const std::string &file = file_explorer.get_current_file();
+    if (file.empty() ||
+        !std::filesystem::equivalent(location.path, file, error)) {
+        open(location.path);
+    }
+    mode = Mode::EDITING;
+    // the file can have changed since it was indexed
+    text.move_cursor_to(
+        omega::math::min(location.symbol.offset, text.length()));
+    selection_start = -1;
+    vertical_pos = -1;
+    retokenize();
+}
+
+void Editor::jump_to_match() {
+    u32 match = layout.brackets.match(text.cursor());
+    if (match == BracketIndex::none) {
+        return;
+    }
+    text.move_cursor_to(match);
+    selection_start = -1;
+    vertical_pos = -1;
+    retokenize();
+}
+
+void Editor::select_scope() {
+    u32 cursor = text.cursor();
+    u32 begin = cursor, end = cursor;
+    if (selection_start > -1) {
+        begin = omega::math::min((u32)selection_start, cursor);
+        end = omega::math::max((u32)selection_start, cursor);
+    }
+    u32 open, close;
+    if (!layout.brackets.enclosing(begin, end, open, close)) {
+        return;
+    }
+    // the inside first, then the brackets along with it
+    if (begin == open + 1 && end == close) {
+        selection_start = open;
+        text.move_cursor_to(close + 1);
+    } else {
+        selection_start = open + 1;
+        text.move_cursor_to(close);
+    }
+    vertical_pos = -1;
+    retokenize();
+}
+
+void Editor::split_view() {
+    if (views.size() == max_views) {
+        return;
+    }
+    // the new view starts out as a copy of the active one
+    View &active = *views[active_view];
+    auto view = omega::util::create_uptr<View>(shader_solid, shader_tile);
+    view->cursor = text.cursor();
+    view->selection_start = selection_start;
+    view->vertical_pos = vertical_pos;
+    view->cursor_pos = active.cursor_pos;
+    if (active.camera != nullptr) {
+        view->camera =
+            omega::util::create_uptr<omega::scene::OrthographicCamera>(
+                0.0f,
+                active.camera->get_width(),
+                0.0f,
+                active.camera->get_height(),
+                -1.0f,
+                1.0f);
+        view->camera->position = active.camera->position;
+    }
+    views.insert(views.begin() + active_view + 1, std::move(view));
+}
+
+void Editor::close_view() {
+    if (views.size() == 1) {
+        return;
+    }
+    views.erase(views.begin() + active_view);
+    // the cursor of the view taking over has to be put into the buffer
+    active_view = omega::math::min(active_view, (u32)views.size() - 1);
+    View &view = *views[active_view];
+    text.move_cursor_to(view.cursor);
+    selection_start = view.selection_start;
+    vertical_pos = view.vertical_pos;
+    retokenize();
+}
+
+void Editor::focus_next_view() {
+    if (views.size() == 1) {
+        return;
+    }
+    View &previous = *views[active_view];
+    previous.cursor = text.cursor();
+    previous.selection_start = selection_start;
+    previous.vertical_pos = vertical_pos;
+
+    active_view = (active_view + 1) % views.size();
+    View &view = *views[active_view];
+    text.move_cursor_to(view.cursor);
+    selection_start = view.selection_start;
+    vertical_pos = view.vertical_pos;
+    retokenize();
+}
+
+void Editor::toggle_fold() {
+    auto &lines = layout.lines;
+    if (!layout.folds.toggle(cursor_line)) {
+        return;
+    }
+    // keep the cursor out of the collapsed lines. Moving it moves the gap,
+    // so the tokens have to be relexed, the header stays collapsed
+    for (const auto &fold : layout.folds.get_hidden()) {
+        if (cursor_line > fold.header && cursor_line <= fold.last) {
+            text.move_cursor_to(lines.line_end(fold.header));
+            selection_start = -1;
+            retokenize();
+            return;
+        }
+    }
+    // the text didn't change, only the rows
+    FrameStats::Scope scope(FrameStats::Phase::LAYOUT);
+    text_version++;
+    layout.wraps.rebuild(lines, layout.folds);
 }
 
 void Editor::backspace() {
@@ -514,13 +1538,9 @@ void Editor::open(const std::string &file) {
     std::string content;
     bool is_directory = file_explorer.open(file, content);
     if (!is_directory) {
-        // reset all the vars
-        vertical_pos = -1;
-        selection_start = 0;
         mode = Mode::EDITING;
         selected_idx = 0;
-        this->text.open(content.c_str());
-        retokenize();
+        load(content, file);
     }
     // otherwise, this is a CHANGE DIRETORY OPERATION
     else {
@@ -531,6 +1551,35 @@ void Editor::open(const std::string &file) {
     }
 }
 
+void Editor::load(const std::string &content, const std::string &file) {
+    this->text.open(content.c_str());
+    // nothing about the old text applies to the new one
+    this->text.take_edit();
+    undo_stack.clear();
+    redo_stack.clear();
+    // the words point into the old text, so they can't be patched
+    words.clear();
+    completions.clear();
+    vertical_pos = -1;
+    selection_start = -1;
+    // every view starts at the top of the new file
+    for (auto &view : views) {
+        view->cursor = 0;
+        view->selection_start = -1;
+        view->vertical_pos = -1;
+        // the cameras head for the top too, not the old cursor
+        view->cursor_pos = {0.0f};
+        view->camera_settled = false;
+    }
+    layout.folds.clear();
+    layout.folds.set_mode(FoldIndex::mode_for(file));
+    // search the new file for the same query
+    search.clear();
+    search.set_query(this->text, search_text);
+    retokenize();
+    words.rebuild(this->text, tokens);
+}
+
 void Editor::new_file() {
     // WARN: Please just use a valid file/directory name, no funny
     // business :)
@@ -546,11 +1595,10 @@ void Editor::new_file() {
     } else {
         if (!std::filesystem::exists(new_path)) {
             // set the default text to ""
-            this->text.open("");
+            load("", new_path.string());
             save(new_path.string());
             std::string unused;
             file_explorer.open(new_path.string(), unused);
-            retokenize();
         } else {
             // just open the file otherwise
             open(new_path.string());
@@ -608,3 +1656,54 @@ i32 Editor::find_next_token(u32 i) {
     }
     return res;
 }
+
+std::pair<u32, u32> Editor::visible_rows(
+    Font *font,
+    const omega::scene::OrthographicCamera &camera,
+    f32 height) const {
+    // rows grow downwards from y = 0, the camera position is the bottom left
+    f32 line_height =
+        font->get_font_height() * (height / font->get_font_size());
+    f32 top = camera.position.y + camera.get_height();
+    f32 bottom = camera.position.y;
+
+    i32 first = (i32)std::floor(-top / line_height);
+    i32 last = (i32)std::ceil(-bottom / line_height) + 1;
+    i32 max_row = (i32)layout.wraps.row_count() - 1;
+    first = omega::math::max(omega::math::min(first, max_row), 0);
+    last = omega::math::max(omega::math::min(last, max_row), first);
+    return {(u32)first, (u32)last};
+}
+
+f32 Editor::camera_target_x(const omega::math::vec2 &cursor,
+                            const omega::scene::OrthographicCamera &camera) {
+    // wrapped rows always fit, so there is nothing to follow sideways
+    if (wrap) {
+        return -wrap_margin * 0.5f;
+    }
+    return cursor.x - camera.get_width() * 0.25f;
+}
+
+void Editor::set_wrap(bool wrap) {
+    this->wrap = wrap;
+    // turning it on waits for the next render, which knows the width
+    if (!wrap && layout.wraps.is_enabled()) {
+        layout.wraps.set_width(0.0f);
+        retokenize();
+    }
+}
+
+u32 Editor::row_column_index(u32 row, u32 column) const {
+    const auto &wraps = layout.wraps;
+    u32 end = wraps.row_end(row);
+    // the end of a wrapped row is already the next row
+    if (wraps.wraps_into_next(row)) {
+        end--;
+    }
+    u32 idx = omega::math::min(wraps.row_start(row) + column, end);
+    // don't land inside a multi byte character
+    while (idx > wraps.row_start(row) && utf8::is_continuation(text.get(idx))) {
+        idx--;
+    }
+    return idx;
+}
@@ -5,49 +5,166 @@
 #include <omega/core/globals.hpp>
 #include <omega/events/input_manager.hpp>
 #include <omega/gfx/shader.hpp>
-#include <omega/gfx/shape_renderer.hpp>
-#include <omega/gfx/sprite_batch.hpp>
 #include <omega/scene/orthographic_camera.hpp>
 #include <omega/util/types.hpp>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "smed/buffer_renderer.hpp"
+#include "smed/file_finder.hpp"
 #include "smed/files.hpp"
 #include "smed/font.hpp"
 #include "smed/font_renderer.hpp"
 #include "smed/gap_buffer.hpp"
+#include "smed/layout.hpp"
 #include "smed/lexer.hpp"
+#include "smed/minimap.hpp"
+#include "smed/project_search.hpp"
+#include "smed/render_batch.hpp"
+#include "smed/replacer.hpp"
+#include "smed/search_index.hpp"
+#include "smed/symbol_index.hpp"
+#include "smed/thread_pool.hpp"
+#include "smed/tile_cache.hpp"
+#include "smed/view.hpp"
+#include "smed/word_index.hpp"
 
 class Editor {
   public:
     Editor(omega::gfx::Shader *shader,
            omega::gfx::Shader *shader_search,
+           omega::gfx::Shader *shader_tile,
            Font *font,
            std::string path);
+    ~Editor();
 
-    void render(Font *font,
-                omega::scene::OrthographicCamera &camera,
-                omega::gfx::SpriteBatch &batch,
-                omega::gfx::ShapeRenderer &shape);
+    void render(Font *font, omega::scene::OrthographicCamera &camera);
     void save(const std::string &file);
 
-    void handle_text(omega::events::InputManager &input, char c);
+    void handle_text(omega::events::InputManager &input,
+                     const char *input_text);
     void handle_input(omega::events::InputManager &input);
 
+    // true while a camera is still easing towards its cursor
+    bool is_animating() const {
+        for (const auto &view : views) {
+            if (!view->camera_settled) {
+                return true;
+            }
+        }
+        return false;
+    }
+    // true while results are still coming in from the background
+    bool is_busy() const {
+        return project_search.is_running() ||
+               project_search.is_replacing() ||
+               (mode == Mode::PROJECT_SEARCH && project_search.is_indexing()) ||
+               (mode == Mode::FILE_FINDER && file_finder.is_walking()) ||
+               (mode == Mode::SYMBOL_SEARCH && symbols.is_building());
+    }
+    void set_animations(bool animate) {
+        buffer_renderer.set_animated(animate);
+        // animated text changes every frame, so caching it is pointless
+        use_tiles = !animate;
+    }
+    // soft wrap long lines at the view's width
+    void set_wrap(bool wrap);
+
+    inline static const omega::math::vec4 background{
+        17.0f / 255.0f, 17.0f / 255.0f, 27.0f / 255.0f, 1.0f};
+
   private:
+    void render_views(Font *font, omega::scene::OrthographicCamera &camera);
+    void render_document(Font *font, View &view, bool active);
+    void render_file_explorer(Font *font,
+                              omega::scene::OrthographicCamera &camera);
+    void render_project_search(Font *font,
+                               omega::scene::OrthographicCamera &camera);
+    void render_file_finder(Font *font,
+                            omega::scene::OrthographicCamera &camera);
+    void render_symbol_search(Font *font,
+                              omega::scene::OrthographicCamera &camera);
+    void render_input_box(Font *font,
+                          omega::scene::OrthographicCamera &camera,
+                          const std::string &label,
+                          const std::string &input_text,
+                          const std::string &status = "");
+
     void retokenize();
+    // refreshes the matches of search_text and jumps to the first one
+    void update_search();
+    // replaces the match at the cursor, or moves to the next one
+    void replace_current();
+    void replace_all();
+    // one undoable edit with a single relex, the gap is left at cursor
+    void replace_range(u32 begin,
+                       u32 end,
+                       const std::string &with,
+                       u32 cursor);
+    // reverts the last replacement, or applies it again
+    void undo(bool redo);
+    // restarts the project search for project_query
+    void update_project_search();
+    // recompiles project_query with replace_text, after either changed
+    void update_project_replacer();
+    // opens the selected result's file at the match
+    void open_project_result();
+    // replaces every match in the files of the results
+    void replace_in_files();
+    // rescores the file list for finder_query
+    void update_file_finder();
+    // opens the definition of the symbol at the cursor, or lists them when
+    // there are several
+    void jump_to_definition();
+    // moves the cursor to a definition, opening its file if needed
+    void open_symbol(const SymbolIndex::Location &location);
+    // completes the identifier before the cursor from the buffer's words
+    void update_completion();
+    void accept_completion();
+    // the popup shows until the text or the cursor changes
+    bool is_completing() const {
+        return mode == Mode::EDITING && !completions.empty() &&
+               completion_version == text_version;
+    }
+    // splits the active view in two, or closes it
+    void split_view();
+    void close_view();
+    // moves the cursor into the next view
+    void focus_next_view();
+    // collapses or expands the fold around the cursor
+    void toggle_fold();
+    // moves the cursor to the partner of the bracket at or before it
+    void jump_to_match();
+    // selects the inside of the innermost bracket pair around the selection,
+    // or the pair itself when the inside is selected already
+    void select_scope();
     void backspace();
     void copy_to_clipboard();
     void open(const std::string &file);
+    // replaces the buffer with content read from file. Views, undo history,
+    // folds, search matches and words all start over
+    void load(const std::string &content, const std::string &file);
     void new_file();
 
     i32 find_prev_token(u32 i);
     i32 find_next_token(u32 i);
 
+    // range of visual rows the camera can currently see
+    std::pair<u32, u32> visible_rows(
+        Font *font,
+        const omega::scene::OrthographicCamera &camera,
+        f32 height) const;
+    f32 camera_target_x(const omega::math::vec2 &cursor,
+                        const omega::scene::OrthographicCamera &camera);
+    // index column bytes into the visual row, kept on that row
+    u32 row_column_index(u32 row, u32 column) const;
+
     GapBuffer text;
     Lexer lexer;
     std::vector<Token> tokens;
+    Layout layout;
+    u32 cursor_line = 0; // as of the last retokenize
     i32 vertical_pos = -1; // represents the initial up/down cursor column, -1
                            // when none has been initiated
 
@@ -55,21 +172,84 @@ class Editor {
 
     i32 selection_start = -1; // -1 represents no selection
     f32 font_render_height = 25.0f;
+    bool wrap = false;
+    static constexpr f32 wrap_margin = 20.0f; // unscaled space kept free
 
     // searching
     enum class Mode {
         EDITING = 0,
         SEARCHING,
+        REPLACING,
+        PROJECT_SEARCH,
+        PROJECT_REPLACE,
         FILE_EXPLORER,
+        FILE_FINDER,
+        SYMBOL_SEARCH,
         NEW_FILE
     } mode = Mode::EDITING;
     std::string search_text;
+    SearchIndex search;
+    u32 search_origin = 0; // cursor when the search started
+    std::string replace_text;
+
+    // [begin, begin + removed.size()) was replaced by inserted
+    struct Change {
+        u32 begin;
+        std::string removed;
+        std::string inserted;
+    };
+    // only replacements are recorded for now, any other edit clears them
+    std::vector<Change> undo_stack;
+    std::vector<Change> redo_stack;
+    bool applying_change = false;
+
+    // walks and indexing of the project search, file finder and symbols,
+    // one pool instead of one each
+    ThreadPool project_pool;
+    // searching every file under the root
+    ProjectSearch project_search;
+    std::string project_query;
+    std::vector<ProjectSearch::Result> project_results;
+    // project_query and replace_text compiled, for the previews
+    omega::util::uptr<Replacer> project_replacer = nullptr;
+    u32 project_selected = 0;
+    bool project_replacing = false; // until the report is shown
+    std::string project_status;     // the report, until the next search
     FontRenderer font_renderer;
+    RenderBatch render_batch; // everything but the document views
+    TileCache tile_cache;
+    bool use_tiles = false;
+    u64 text_version = 0; // bumped on every retokenize
+
+    // panes side by side, the active one owns the gap buffer's cursor
+    std::vector<omega::util::uptr<View>> views;
+    u32 active_view = 0;
+    static constexpr u32 max_views = 4;
+    omega::gfx::Shader *shader_solid = nullptr;
+    omega::gfx::Shader *shader_tile = nullptr;
 
     // directory/file management
     FileExplorer file_explorer;
     u32 selected_idx = 0;
     std::string new_file_text;
+    // fuzzy opening any file under the root
+    FileFinder file_finder;
+    std::string finder_query;
+    u32 finder_selected = 0;
+    // definitions in the files under the root
+    SymbolIndex symbols;
+    std::string symbol_query;
+    std::vector<SymbolIndex::Location> symbol_results;
+    u32 symbol_selected = 0;
+    static constexpr u32 max_symbols_shown = 1000;
+    // completing identifiers from the buffer
+    WordIndex words;
+    std::vector<std::string> completions;
+    u32 completion_selected = 0;
+    u32 completion_prefix = 0;  // length of the typed part
+    u64 completion_version = 0; // text_version they were made for
+    static constexpr u32 max_completions = 8;
+    static constexpr u32 min_completion_prefix = 2;
 };
 
 #endif // SMED_EDITOR_HPP
@@ -0,0 +1,219 @@
+#include "file_finder.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <omega/math/math.hpp>
+
+#include "smed/project_files.hpp"
+
+namespace {
+
+// scores of a matched character
+constexpr i32 score_match = 16;
+constexpr i32 bonus_boundary = 10; // after a '/' or at the start
+constexpr i32 bonus_separator = 8; // after '_', '-', '.' or ' '
+constexpr i32 bonus_camel = 7;     // an upper case letter after a lower one
+constexpr i32 bonus_name = 2;      // inside the file name
+constexpr i32 bonus_consecutive = 4;
+constexpr i32 penalty_gap_open = 3;
+constexpr i32 penalty_gap_extend = 1;
+constexpr i32 impossible = -(1 << 28);
+
+char to_lower(char c) {
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+} // namespace
+
+FileFinder::FileFinder(ThreadPool &walk_pool, u32 threads)
+    : walk_pool(walk_pool), pool(threads) {
+    rows.resize(pool.size());
+}
+
+void FileFinder::refresh(const std::string &root) {
+    cancel();
+    walk = std::make_shared<Walk>();
+    walk->cancelled = std::make_shared<std::atomic<bool>>(false);
+    walk->relative = (std::filesystem::path(root) / "").string().size();
+    // the jobs hold on to the walk, it outlives being replaced
+    std::shared_ptr<Walk> current = walk;
+    ProjectWalker::walk(
+        walk_pool,
+        root,
+        current->cancelled,
+        [current](u32, const std::string &path) {
+            std::lock_guard<std::mutex> lock(current->mutex);
+            current->found.push_back(path);
+        },
+        [current]() { current->done = true; });
+}
+
+void FileFinder::cancel() {
+    if (walk != nullptr) {
+        *walk->cancelled = true;
+        walk = nullptr;
+    }
+}
+
+bool FileFinder::poll() {
+    if (walk == nullptr || !walk->done) {
+        return false;
+    }
+    std::vector<std::string> found;
+    {
+        std::lock_guard<std::mutex> lock(walk->mutex);
+        found.swap(walk->found);
+    }
+    u32 relative = walk->relative;
+    walk = nullptr;
+
+    std::sort(found.begin(), found.end());
+    files.clear();
+    files.reserve(found.size());
+    for (std::string &path : found) {
+        File file;
+        file.relative = omega::math::min(relative, (u32)path.size());
+        size_t slash = path.find_last_of('/');
+        file.name = slash == std::string::npos || slash < file.relative
+                        ? file.relative
+                        : slash + 1;
+        file.lower.resize(path.size());
+        std::transform(path.begin(), path.end(), file.lower.begin(), to_lower);
+        file.mask = char_mask(file.lower.substr(file.relative));
+        file.path = std::move(path);
+        files.push_back(std::move(file));
+    }
+    rematch(false);
+    return true;
+}
+
+void FileFinder::set_query(const std::string &q) {
+    // every match of the longer query matches the shorter one too
+    bool refine = q.starts_with(query);
+    query = q;
+    lower_query.resize(q.size());
+    std::transform(q.begin(), q.end(), lower_query.begin(), to_lower);
+    query_mask = char_mask(lower_query);
+    rematch(refine);
+}
+
+i32 FileFinder::score(u32 worker, const File &file) const {
+    const std::string &s = file.lower;
+    const std::string &q = lower_query;
+    u32 begin = file.relative, n = s.size(), m = q.size();
+    if ((query_mask & ~file.mask) != 0 || n - begin < m) {
+        return impossible;
+    }
+    // most files fail here, before the quadratic part
+    for (u32 j = begin, i = 0; i < m; ++j, ++i) {
+        const char *found =
+            (const char *)std::memchr(s.data() + j, q[i], n - j);
+        if (found == nullptr) {
+            return impossible;
+        }
+        j = found - s.data();
+    }
+
+    // best score with q[i] matched at column k, from the one before, and
+    // the best of q[i - 1] matched at least two columns back, minus the gap
+    u32 width = n - begin;
+    std::vector<i32> &row = rows[worker];
+    row.assign(width * 2, impossible);
+    i32 *previous = row.data(), *current = row.data() + width;
+    const auto bonus = [&](u32 j) {
+        i32 b = j >= file.name ? bonus_name : 0;
+        char before = j == begin ? '/' : file.path[j - 1];
+        if (before == '/') {
+            return b + bonus_boundary;
+        }
+        if (before == '_' || before == '-' || before == '.' || before == ' ') {
+            return b + bonus_separator;
+        }
+        if (before >= 'a' && before <= 'z' && file.path[j] >= 'A' &&
+            file.path[j] <= 'Z') {
+            return b + bonus_camel;
+        }
+        return b;
+    };
+    for (u32 k = 0; k < width; ++k) {
+        if (s[begin + k] == q[0]) {
+            current[k] = score_match + bonus(begin + k);
+        }
+    }
+    for (u32 i = 1; i < m; ++i) {
+        std::swap(previous, current);
+        i32 gap = impossible;
+        current[0] = impossible;
+        for (u32 k = 1; k < width; ++k) {
+            if (k >= 2) {
+                gap = omega::math::max(gap - penalty_gap_extend,
+                                       previous[k - 2] - penalty_gap_open);
+            }
+            i32 before =
+                omega::math::max(previous[k - 1] + bonus_consecutive, gap);
+            current[k] = s[begin + k] == q[i] && before > impossible / 2
+                             ? before + score_match + bonus(begin + k)
+                             : impossible;
+        }
+    }
+    i32 best = *std::max_element(current, current + width);
+    return best > impossible / 2 ? best : impossible;
+}
+
+void FileFinder::rematch(bool refine) {
+    std::vector<u32> candidates;
+    if (refine) {
+        candidates.swap(matched);
+    } else {
+        candidates.resize(files.size());
+        for (u32 i = 0; i < files.size(); ++i) {
+            candidates[i] = i;
+        }
+    }
+    if (query.empty()) {
+        // sorted by path already
+        matched = std::move(candidates);
+        matches.assign(
+            matched.begin(),
+            matched.begin() + omega::math::min((u32)matched.size(), max_shown));
+        return;
+    }
+
+    scores.resize(files.size());
+    u32 chunks = (candidates.size() + chunk_size - 1) / chunk_size;
+    std::vector<std::vector<u32>> found(chunks);
+    pool.parallel_for(chunks, [&](u32 worker, u32 c) {
+        u32 end =
+            omega::math::min((u32)candidates.size(), (c + 1) * chunk_size);
+        for (u32 i = c * chunk_size; i < end; ++i) {
+            u32 file = candidates[i];
+            i32 s = score(worker, files[file]);
+            if (s != impossible) {
+                scores[file] = s;
+                found[c].push_back(file);
+            }
+        }
+    });
+    // chunks are in file order, so matched stays sorted
+    matched.clear();
+    for (const auto &chunk : found) {
+        matched.insert(matched.end(), chunk.begin(), chunk.end());
+    }
+
+    // ties go to the shorter path
+    matches = matched;
+    auto shown =
+        matches.begin() + omega::math::min((u32)matches.size(), max_shown);
+    std::partial_sort(
+        matches.begin(), shown, matches.end(), [&](u32 a, u32 b) {
+            if (scores[a] != scores[b]) {
+                return scores[a] > scores[b];
+            }
+            if (files[a].path.size() != files[b].path.size()) {
+                return files[a].path.size() < files[b].path.size();
+            }
+            return a < b;
+        });
+    matches.erase(shown, matches.end());
+}
@@ -0,0 +1,106 @@
+#ifndef SMED_FILEFINDER_HPP
+#define SMED_FILEFINDER_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <omega/util/types.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "smed/thread_pool.hpp"
+
+/**
+ * Fuzzy matches a query against every file under the project root. The file
+ * list is walked in the background and kept between uses, refreshing it
+ * leaves the old list usable until the walk is done. The query's characters
+ * have to appear in order, matches after a separator, at a camelCase hump,
+ * in a row or in the file name score higher
+ * */
+class FileFinder {
+  public:
+    /**
+     * Walks on walk_pool, which can be shared and has to be drained before
+     * the finder goes away. Scoring gets its own threads
+     * */
+    FileFinder(ThreadPool &walk_pool,
+               u32 threads = std::thread::hardware_concurrency());
+    ~FileFinder() {
+        cancel();
+    }
+
+    // walks root again in the background
+    void refresh(const std::string &root);
+    void cancel();
+    // takes in a finished walk, returns whether the matches changed
+    bool poll();
+    bool is_walking() const {
+        return walk != nullptr;
+    }
+
+    // rescores the files, only the previous matches when query extends the
+    // last one
+    void set_query(const std::string &query);
+    // file indices, best first, at most max_shown of them
+    const std::vector<u32> &get_matches() const {
+        return matches;
+    }
+    u32 get_match_count() const {
+        return matched.size();
+    }
+    const std::string &get_path(u32 file) const {
+        return files[file].path;
+    }
+    // the path without the root in front
+    const char *get_relative_path(u32 file) const {
+        return files[file].path.c_str() + files[file].relative;
+    }
+
+  private:
+    struct File {
+        std::string path;
+        u32 relative; // where the path below the root starts
+        u32 name;     // where the file name starts
+        std::string lower;
+        u64 mask; // of the characters in lower
+    };
+    struct Walk {
+        std::shared_ptr<std::atomic<bool>> cancelled;
+        std::atomic<bool> done{false};
+        std::mutex mutex;
+        std::vector<std::string> found;
+        u32 relative;
+    };
+
+    // higher is better, a large negative number when the file doesn't
+    // contain the query in order
+    i32 score(u32 worker, const File &file) const;
+    void rematch(bool refine);
+
+    static u64 char_mask(const std::string &lower) {
+        u64 mask = 0;
+        for (char c : lower) {
+            mask |= (u64)1 << (c & 63);
+        }
+        return mask;
+    }
+
+    static constexpr u32 max_shown = 1000;
+    static constexpr u32 chunk_size = 1024; // files per parallel_for index
+
+    std::vector<File> files;
+    std::string query, lower_query;
+    u64 query_mask = 0;
+    std::vector<u32> matched; // every match, by file index
+    std::vector<u32> matches; // the best ones, sorted
+    std::vector<i32> scores;  // by file index, for sorting
+    // dynamic programming rows of each worker
+    mutable std::vector<std::vector<i32>> rows;
+    std::shared_ptr<Walk> walk = nullptr;
+    ThreadPool &walk_pool;
+    // scoring has its own pool, its jobs would queue behind a walk's
+    ThreadPool pool; // last, so its jobs finish before the rest goes away
+};
+
+#endif // SMED_FILEFINDER_HPP
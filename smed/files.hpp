@@ -79,6 +79,9 @@ class FileExplorer {
     const std::filesystem::path &get_cwd() const {
         return cwd;
     }
+    const std::filesystem::path &get_root() const {
+        return root;
+    }
 
   private:
     std::filesystem::path root; // project root
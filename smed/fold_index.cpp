@@ -0,0 +1,193 @@
+#include "fold_index.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <utility>
+
+FoldIndex::Mode FoldIndex::mode_for(const std::string &path) {
+    static const char *indented[] = {
+        ".py", ".pyw", ".yaml", ".yml", ".nim", ".coffee", ".sass", ".pug"};
+    std::string extension = std::filesystem::path(path).extension().string();
+    for (const char *ext : indented) {
+        if (extension == ext) {
+            return Mode::INDENTATION;
+        }
+    }
+    return Mode::BRACES;
+}
+
+void FoldIndex::rebuild(GapBuffer &text,
+                        const std::vector<Token> &tokens,
+                        const LineIndex &lines) {
+    regions.clear();
+    if (mode == Mode::BRACES) {
+        find_brace_regions(text, tokens, lines);
+    } else {
+        find_indent_regions(text, lines);
+    }
+    // one region per header line, the outermost one
+    std::sort(regions.begin(), regions.end(), [](const Fold &a, const Fold &b) {
+        return a.header < b.header || (a.header == b.header && a.last > b.last);
+    });
+    regions.erase(std::unique(regions.begin(),
+                              regions.end(),
+                              [](const Fold &a, const Fold &b) {
+                                  return a.header == b.header;
+                              }),
+                  regions.end());
+
+    // an edit can leave a collapsed header without its region
+    std::erase_if(collapsed,
+                  [&](u32 header) { return find_region(header) == -1; });
+    update_hidden();
+}
+
+void FoldIndex::find_brace_regions(GapBuffer &text,
+                                   const std::vector<Token> &tokens,
+                                   const LineIndex &lines) {
+    std::vector<u32> open; // header lines of the unmatched braces
+    u32 line = 0;
+    for (const Token &token : tokens) {
+        if (token.type != TokenType::OPEN_CURLY &&
+            token.type != TokenType::CLOSE_CURLY) {
+            continue;
+        }
+        // tokens come in text order, so the line only moves forwards
+        u32 idx = text.get_index_from_pointer(token.text);
+        while (line + 1 < lines.line_count() &&
+               lines.line_start(line + 1) <= idx) {
+            line++;
+        }
+        if (token.type == TokenType::OPEN_CURLY) {
+            open.push_back(line);
+        } else if (!open.empty()) {
+            u32 header = open.back();
+            open.pop_back();
+            // the line of the closing brace stays visible
+            if (line > header + 1) {
+                regions.push_back({header, line - 1});
+            }
+        }
+    }
+}
+
+void FoldIndex::find_indent_regions(GapBuffer &text, const LineIndex &lines) {
+    // (header line, its indentation) of the regions still open
+    std::vector<std::pair<u32, u32>> open;
+    u32 last_text = 0; // last line that isn't blank
+    const auto close = [&](u32 header) {
+        if (last_text > header) {
+            regions.push_back({header, last_text});
+        }
+    };
+    for (u32 line = 0; line < lines.line_count(); ++line) {
+        u32 end = lines.line_end(line);
+        u32 indent = 0;
+        u32 i = lines.line_start(line);
+        for (; i < end; ++i) {
+            char c = text.get(i);
+            if (c == ' ') {
+                indent++;
+            } else if (c == '\t') {
+                indent += 4;
+            } else {
+                break;
+            }
+        }
+        // blank lines belong to whichever region surrounds them
+        if (i == end || text.get(i) == '\r') {
+            continue;
+        }
+        while (!open.empty() && open.back().second >= indent) {
+            close(open.back().first);
+            open.pop_back();
+        }
+        open.push_back({line, indent});
+        last_text = line;
+    }
+    for (const auto &[header, indent] : open) {
+        close(header);
+    }
+}
+
+void FoldIndex::shift(u32 edit_line, i32 delta) {
+    if (delta == 0) {
+        return;
+    }
+    std::erase_if(collapsed, [&](u32 header) {
+        return delta < 0 && header > edit_line &&
+               header <= edit_line + (u32)-delta;
+    });
+    for (u32 &header : collapsed) {
+        if (header > edit_line) {
+            header += delta;
+        }
+    }
+}
+
+bool FoldIndex::toggle(u32 line) {
+    auto it = std::lower_bound(collapsed.begin(), collapsed.end(), line);
+    if (it != collapsed.end() && *it == line) {
+        collapsed.erase(it);
+        update_hidden();
+        return true;
+    }
+    // nested regions start later, so the innermost one is the closest
+    // header above line that still reaches it
+    auto region = std::upper_bound(
+        regions.begin(), regions.end(), line, [](u32 l, const Fold &fold) {
+            return l < fold.header;
+        });
+    while (region != regions.begin()) {
+        --region;
+        if (region->last >= line) {
+            collapsed.insert(
+                std::lower_bound(
+                    collapsed.begin(), collapsed.end(), region->header),
+                region->header);
+            update_hidden();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FoldIndex::reveal(u32 line) {
+    u32 size = collapsed.size();
+    std::erase_if(collapsed, [&](u32 header) {
+        return header < line && regions[find_region(header)].last >= line;
+    });
+    if (collapsed.size() == size) {
+        return false;
+    }
+    update_hidden();
+    return true;
+}
+
+bool FoldIndex::is_collapsed(u32 header) const {
+    return std::binary_search(collapsed.begin(), collapsed.end(), header);
+}
+
+i32 FoldIndex::find_region(u32 header) const {
+    auto it = std::lower_bound(
+        regions.begin(), regions.end(), header, [](const Fold &fold, u32 h) {
+            return fold.header < h;
+        });
+    if (it == regions.end() || it->header != header) {
+        return -1;
+    }
+    return it - regions.begin();
+}
+
+void FoldIndex::update_hidden() {
+    hidden.clear();
+    for (u32 header : collapsed) {
+        const Fold &region = regions[find_region(header)];
+        // folds inside a collapsed fold are hidden along with it
+        if (!hidden.empty() && header <= hidden.back().last) {
+            hidden.back().last = std::max(hidden.back().last, region.last);
+            continue;
+        }
+        hidden.push_back(region);
+    }
+}
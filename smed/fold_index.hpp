@@ -0,0 +1,81 @@
+#ifndef SMED_FOLDINDEX_HPP
+#define SMED_FOLDINDEX_HPP
+
+#include <omega/util/types.hpp>
+#include <string>
+#include <vector>
+
+#include "smed/gap_buffer.hpp"
+#include "smed/lexer.hpp"
+#include "smed/line_index.hpp"
+
+/**
+ * Foldable regions of the document, from matching curly braces or from
+ * indentation, and which of them are collapsed. The collapsed ones become
+ * sorted ranges of hidden lines, which WrapLayout leaves out of the visual
+ * rows, so a folded region costs nothing to render or to scroll past
+ * */
+class FoldIndex {
+  public:
+    enum class Mode {
+        BRACES = 0,
+        INDENTATION
+    };
+
+    // lines [header + 1, last] are hidden while the fold is collapsed
+    struct Fold {
+        u32 header;
+        u32 last;
+    };
+
+    // indentation for languages without braces, judged by the extension
+    static Mode mode_for(const std::string &path);
+    void set_mode(Mode mode) {
+        this->mode = mode;
+    }
+
+    /**
+     * Finds the regions again after a relex, collapsed folds that aren't
+     * regions anymore are dropped
+     * */
+    void rebuild(GapBuffer &text,
+                 const std::vector<Token> &tokens,
+                 const LineIndex &lines);
+    /**
+     * Moves the collapsed folds along with an edit on edit_line that changed
+     * the line count by delta, the folds of removed lines are dropped
+     * */
+    void shift(u32 edit_line, i32 delta);
+
+    // collapses the innermost region around line or expands the fold at it,
+    // returns false when there is nothing to fold
+    bool toggle(u32 line);
+    // expands the folds hiding line, returns whether any were
+    bool reveal(u32 line);
+    void clear() {
+        collapsed.clear();
+        hidden.clear();
+    }
+
+    bool is_collapsed(u32 header) const;
+    // sorted and disjoint
+    const std::vector<Fold> &get_hidden() const {
+        return hidden;
+    }
+
+  private:
+    void find_brace_regions(GapBuffer &text,
+                            const std::vector<Token> &tokens,
+                            const LineIndex &lines);
+    void find_indent_regions(GapBuffer &text, const LineIndex &lines);
+    // index into regions of the region starting at header, -1 for none
+    i32 find_region(u32 header) const;
+    void update_hidden();
+
+    Mode mode = Mode::BRACES;
+    std::vector<Fold> regions; // sorted by header, one per header
+    std::vector<u32> collapsed; // sorted headers
+    std::vector<Fold> hidden;
+};
+
+#endif // SMED_FOLDINDEX_HPP
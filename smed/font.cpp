@@ -1,69 +1,541 @@
 #include "font.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+
+#include "smed/cache.hpp"
+#include "smed/mapped_file.hpp"
+
 FT_Library Font::library;
 
-Font::Font(const std::string &path, u32 height) : font_size(height) {
-    FT_Face face;
-    FT_Error error = FT_New_Face(library, path.c_str(), 0, &face);
+Font::Font(const std::string &path, u32 height, bool sdf)
+    : path(path),
+      font_size(height),
+      render_mode(sdf ? FT_RENDER_MODE_SDF : FT_RENDER_MODE_NORMAL) {
+    FT_Error error = FTC_Manager_New(
+        library, 1, 1, 0, face_requester, nullptr, &manager);
+    if (error) {
+        OMEGA_ERROR("Failed to create the glyph cache for '{}'", path);
+    }
+    FTC_CMapCache_New(manager, &cmap_cache);
+    FTC_ImageCache_New(manager, &image_cache);
+
+    // the face is only opened once a glyph is missing from the cached atlas
+    if (load_cache()) {
+        detect_monospace();
+        return;
+    }
+
+    FTC_ScalerRec scaler{face_id(), 0, height, 1, 0, 0};
+    FT_Size size;
+    error = FTC_Manager_LookupSize(manager, &scaler, &size);
     if (error == FT_Err_Unknown_File_Format) {
         OMEGA_ERROR("Unknown file format for '{}'", path);
     } else if (error) {
         OMEGA_ERROR("Error opening file '{}'", path);
+    } else {
+        font_height =
+            (size->metrics.ascender - size->metrics.descender) >> 6;
+    }
+
+    // ascii and latin-1 are always needed, so load them up front outside of
+    // any budget
+    std::vector<u32> warm;
+    for (u32 c = 32; c < 127; ++c) {
+        warm.push_back(c);
+    }
+    for (u32 c = 0xA0; c <= 0xFF; ++c) {
+        warm.push_back(c);
+    }
+    rasterize_batch(warm);
+    for (u32 c = 32; c < 127; ++c) {
+        ascii_advances[c] = ascii[c] ? ascii[c]->advance.x : 0.0f;
+    }
+    // control characters (tabs) take the space of a space
+    for (u32 c = 0; c < 32; ++c) {
+        ascii_advances[c] = ascii_advances[' '];
+    }
+    ascii_advances[127] = ascii_advances[' '];
+    save_cache();
+    detect_monospace();
+}
+
+void Font::detect_monospace() {
+    // printable ascii decides, every other character is laid out as one
+    // column as well
+    monospace = ascii_advances[' '] > 0.0f;
+    for (u32 c = 33; c < 127 && monospace; ++c) {
+        monospace = ascii_advances[c] == ascii_advances[' '];
+    }
+    mono_advance = ascii_advances[' '];
+}
+
+Font::~Font() {
+    raster_pool = nullptr;
+    for (auto &worker : raster_workers) {
+        if (worker.face) FT_Done_Face(worker.face);
+        if (worker.library) FT_Done_FreeType(worker.library);
+    }
+    FTC_Manager_Done(manager);
+}
+
+FT_Error Font::face_requester(FTC_FaceID face_id,
+                              FT_Library library,
+                              FT_Pointer req_data,
+                              FT_Face *face) {
+    Font *font = (Font *)face_id;
+    return FT_New_Face(library, font->path.c_str(), 0, face);
+}
+
+void Font::begin_frame() {
+    frame++;
+    raster_time = clock::duration{0};
+    pending = false;
+
+    // glyphs that didn't make it last frame are rasterized together, within
+    // the frame's budget. The ones left over are drawn as missing again and
+    // deferred to the next frame
+    if (!missing.empty()) {
+        std::vector<u32> batch = std::move(missing);
+        missing.clear();
+        std::sort(batch.begin(), batch.end());
+        batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+        u32 max_batch = 32 * (raster_pool ? raster_pool->size() : 1);
+        if (batch.size() > max_batch) {
+            batch.resize(max_batch);
+        }
+        auto start = clock::now();
+        rasterize_batch(std::move(batch), start + raster_budget);
+        raster_time += clock::now() - start;
+    }
+}
+
+namespace {
+
+// layout of the atlas cache file, everything is written in native byte order:
+// header, key, ascii advances, glyphs, then each page's skyline and pixels
+constexpr char cache_magic[4] = {'S', 'M', 'A', 'T'};
+constexpr u32 cache_version = 1;
+
+struct CacheHeader {
+    char magic[4];
+    u32 version;
+    u32 key_length;
+    u32 font_height;
+    u32 page_size;
+    u32 page_count;
+    u32 glyph_count;
+};
+
+struct CachedGlyph {
+    u32 codepoint;
+    Glyph glyph;
+};
+static_assert(std::is_trivially_copyable_v<CachedGlyph>);
+
+} // namespace
+
+std::string Font::cache_key() const {
+    std::error_code error;
+    auto mtime = std::filesystem::last_write_time(path, error);
+    if (error) {
+        return "";
+    }
+    return std::filesystem::absolute(path).string() + "\n" +
+           std::to_string(mtime.time_since_epoch().count()) + "\n" +
+           std::to_string(font_size) + "\n" + std::to_string(is_sdf()) +
+           "\n" + std::to_string(page_size);
+}
+
+std::string Font::cache_path(const std::string &key) const {
+    return cache_file(key, "atlas");
+}
+
+bool Font::load_cache() {
+    std::string key = cache_key();
+    if (key.empty()) {
+        return false;
+    }
+    MappedFile file(cache_path(key));
+    if (!file.is_open()) {
+        return false;
+    }
+    CacheReader reader{file.data(), file.size()};
+    CacheHeader header;
+    if (!reader.read(&header, sizeof(header)) ||
+        std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 ||
+        header.version != cache_version || header.page_size != page_size ||
+        header.page_count > max_pages || header.key_length != key.length()) {
+        return false;
+    }
+    // hash collisions and stale files are caught by the full key
+    const char *cached_key = reader.view(header.key_length);
+    if (cached_key == nullptr ||
+        std::memcmp(cached_key, key.data(), key.length()) != 0) {
+        return false;
+    }
+    std::array<f32, 128> cached_advances;
+    if (!reader.read(cached_advances.data(), sizeof(cached_advances)) ||
+        !reader.fits(header.glyph_count, sizeof(CachedGlyph))) {
+        return false;
+    }
+    std::vector<CachedGlyph> cached_glyphs(header.glyph_count);
+    if (!reader.read(cached_glyphs.data(),
+                     sizeof(CachedGlyph) * header.glyph_count)) {
+        return false;
+    }
+    for (const auto &cached : cached_glyphs) {
+        if (cached.glyph.page >= header.page_count) {
+            return false;
+        }
+    }
+
+    // the pixels go straight from the mapping to the gpu
+    std::vector<AtlasPage> cached_pages;
+    for (u32 i = 0; i < header.page_count; ++i) {
+        u32 node_count = 0;
+        if (!reader.read(&node_count, sizeof(node_count)) ||
+            !reader.fits(node_count, sizeof(SkylinePacker::Node))) {
+            return false;
+        }
+        std::vector<SkylinePacker::Node> skyline(node_count);
+        const char *pixels = nullptr;
+        if (!reader.read(skyline.data(),
+                         sizeof(SkylinePacker::Node) * node_count) ||
+            !(pixels = reader.view(page_size * page_size))) {
+            return false;
+        }
+        // the nodes have to span the page side by side, or the packer
+        // would place glyphs off it
+        u32 x = 0;
+        for (const auto &node : skyline) {
+            if (node.x != x || node.width > page_size - x ||
+                node.y > page_size) {
+                return false;
+            }
+            x += node.width;
+        }
+        if (x != page_size) {
+            return false;
+        }
+        cached_pages.emplace_back(page_size, page_size, (const u8 *)pixels);
+        cached_pages.back().packer.set_skyline(std::move(skyline));
+    }
+
+    font_height = header.font_height;
+    ascii_advances = cached_advances;
+    pages = std::move(cached_pages);
+    for (const auto &cached : cached_glyphs) {
+        Glyph *stored = &(glyphs[cached.codepoint] = cached.glyph);
+        if (cached.codepoint < ascii.size()) {
+            ascii[cached.codepoint] = stored;
+        }
+    }
+    return true;
+}
+
+void Font::save_cache() {
+    std::string key = cache_key();
+    std::string file = key.empty() ? "" : cache_path(key);
+    if (file.empty()) {
+        return;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(
+        std::filesystem::path(file).parent_path(), error);
+
+    // write to a temporary first, so a partial file is never mapped
+    std::string tmp = file + ".tmp";
+    std::ofstream of(tmp, std::ios::binary);
+    if (of.fail()) {
+        OMEGA_WARN("Failed to write the font atlas cache '{}'", tmp);
+        return;
     }
-    FT_Set_Pixel_Sizes(face, 0, height);
-    i32 padding = 1; // space between chars
-    i32 row = 0;
-    i32 col = padding;
-    const i32 texture_width = 512;
-    char texture_buffer[texture_width * texture_width] = {0};
-
-    for (i8 char_idx = 32; char_idx < 127; ++char_idx) {
-        FT_UInt glyph_index = FT_Get_Char_Index(face, char_idx);
-        FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT);
-        FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL);
-        // check if glyph will fit in current row
-        if (col + face->glyph->bitmap.width + padding >= texture_width) {
-            col = padding;
-            row += height;
-        }
-        // update the actual font height
-        font_height = omega::math::max(
-            (face->size->metrics.ascender - face->size->metrics.descender) >> 6,
-            (i64)font_height);
-        for (u32 y = 0; y < face->glyph->bitmap.rows; ++y) {
-            for (u32 x = 0; x < face->glyph->bitmap.width; ++x) {
-                texture_buffer[(row + y) * texture_width + col + x] =
-                    face->glyph->bitmap
-                        .buffer[y * face->glyph->bitmap.width + x];
+    CacheHeader header{};
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.key_length = key.length();
+    header.font_height = font_height;
+    header.page_size = page_size;
+    header.page_count = pages.size();
+    header.glyph_count = glyphs.size();
+    of.write((const char *)&header, sizeof(header));
+    of.write(key.data(), key.length());
+    of.write((const char *)ascii_advances.data(), sizeof(ascii_advances));
+    for (const auto &[codepoint, glyph] : glyphs) {
+        CachedGlyph cached{codepoint, glyph};
+        of.write((const char *)&cached, sizeof(cached));
+    }
+    for (const auto &page : pages) {
+        const auto &skyline = page.packer.get_skyline();
+        u32 node_count = skyline.size();
+        of.write((const char *)&node_count, sizeof(node_count));
+        of.write((const char *)skyline.data(),
+                 sizeof(SkylinePacker::Node) * node_count);
+        of.write((const char *)page.pixels.data(), page.pixels.size());
+    }
+    of.close();
+    if (of.fail()) {
+        std::filesystem::remove(tmp, error);
+        return;
+    }
+    std::filesystem::rename(tmp, file, error);
+}
+
+bool Font::load_glyph(u32 codepoint, FT_Glyph &glyph) {
+    FT_UInt index = FTC_CMapCache_Lookup(cmap_cache, face_id(), -1, codepoint);
+    FTC_ImageTypeRec type{face_id(), 0, font_size, FT_LOAD_DEFAULT};
+    return FTC_ImageCache_Lookup(image_cache, &type, index, &glyph, nullptr) ==
+           0;
+}
+
+f32 Font::lookup_advance(u32 codepoint) {
+    auto it = advances.find(codepoint);
+    if (it != advances.end()) {
+        return it->second;
+    }
+    FT_Glyph glyph;
+    f32 advance = 0.0f;
+    if (load_glyph(codepoint, glyph)) {
+        advance = glyph->advance.x >> 16;
+    }
+    advances[codepoint] = advance;
+    return advance;
+}
+
+Glyph *Font::find_glyph(u32 codepoint) {
+    if (codepoint < ascii.size()) {
+        return ascii[codepoint];
+    }
+    auto it = glyphs.find(codepoint);
+    return it != glyphs.end() ? &it->second : nullptr;
+}
+
+const Glyph &Font::get_glyph(u32 codepoint) {
+    Glyph *glyph = find_glyph(codepoint);
+    if (glyph == nullptr) {
+        if (raster_time >= raster_budget) {
+            return pending_glyph(codepoint);
+        }
+        auto start = clock::now();
+        glyph = rasterize(codepoint);
+        raster_time += clock::now() - start;
+    }
+    pages[glyph->page].last_used = frame;
+    return *glyph;
+}
+
+const Glyph &Font::pending_glyph(u32 codepoint) {
+    pending = true;
+    missing.push_back(codepoint);
+    pending_result = Glyph{};
+    pending_result.advance = {get_advance(codepoint), 0.0f};
+    return pending_result;
+}
+
+Glyph *Font::rasterize(u32 codepoint) {
+    Glyph glyph;
+    FT_Glyph outline;
+    if (load_glyph(codepoint, outline)) {
+        glyph.advance = {outline->advance.x >> 16, outline->advance.y >> 16};
+
+        // the cached glyph must stay untouched, so render a copy of it
+        FT_Glyph bitmap_glyph = outline;
+        bool owned = outline->format != FT_GLYPH_FORMAT_BITMAP;
+        if (owned &&
+            FT_Glyph_To_Bitmap(&bitmap_glyph, render_mode, nullptr, 0)) {
+            owned = false;
+            bitmap_glyph = nullptr;
+        }
+        if (bitmap_glyph) {
+            const FT_Bitmap &bitmap = ((FT_BitmapGlyph)bitmap_glyph)->bitmap;
+            glyph.size = {bitmap.width, bitmap.rows};
+            glyph.offset = {((FT_BitmapGlyph)bitmap_glyph)->left,
+                            ((FT_BitmapGlyph)bitmap_glyph)->top};
+
+            if (bitmap.width > 0 && bitmap.rows > 0) {
+                if (allocate(bitmap.width + padding,
+                             bitmap.rows + padding,
+                             glyph.tex_coords,
+                             glyph.page)) {
+                    // repack the rows, the bitmap pitch can be padded
+                    std::vector<u8> pixels(bitmap.width * bitmap.rows);
+                    for (u32 y = 0; y < bitmap.rows; ++y) {
+                        std::memcpy(&pixels[y * bitmap.width],
+                                    bitmap.buffer + y * bitmap.pitch,
+                                    bitmap.width);
+                    }
+                    pages[glyph.page].upload(glyph.tex_coords,
+                                             bitmap.width,
+                                             bitmap.rows,
+                                             pixels.data());
+                } else {
+                    // no room in the atlas, it's drawn empty
+                    glyph.size = {0, 0};
+                }
+            } else {
+                glyph.size = {0, 0};
             }
+            if (owned) FT_Done_Glyph(bitmap_glyph);
+        }
+    }
+    // glyphs that failed to load or to fit are stored empty, so they aren't
+    // retried
+    generation++;
+    Glyph *stored = &(glyphs[codepoint] = glyph);
+    if (codepoint < ascii.size()) {
+        ascii[codepoint] = stored;
+    }
+    return stored;
+}
+
+void Font::rasterize_batch(std::vector<u32> codepoints,
+                           clock::time_point deadline) {
+    if (raster_pool == nullptr) {
+        raster_pool = omega::util::create_uptr<ThreadPool>();
+        raster_workers.resize(raster_pool->size());
+    }
+    struct Raster {
+        Glyph glyph;
+        std::vector<u8> pixels;
+        bool loaded = false;
+        bool skipped = false; // started past the deadline
+    };
+    std::vector<Raster> rasters(codepoints.size());
+
+    raster_pool->parallel_for(codepoints.size(), [&](u32 worker, u32 i) {
+        if (clock::now() >= deadline) {
+            rasters[i].skipped = true;
+            return;
         }
-        Glyph *glyph = &glyphs[char_idx];
-        glyph->tex_coords = {col, row};
-        glyph->size = {face->glyph->bitmap.width, face->glyph->bitmap.rows};
-        glyph->advance = {face->glyph->advance.x >> 6,
-                          face->glyph->advance.y >> 6};
-        glyph->offset = {face->glyph->bitmap_left, face->glyph->bitmap_top};
-        col += face->glyph->bitmap.width + padding;
-    }
-    FT_Done_Face(face);
-    u32 id = 0;
-    glGenTextures(1, &id);
-    texture = omega::gfx::texture::Texture::create_wrapper(
-        id, texture_width, texture_width);
-    texture->bind(0);
-    glTexImage2D(GL_TEXTURE_2D,
-                 0,
-                 GL_RED,
-                 texture_width,
-                 texture_width,
-                 0,
-                 GL_RED,
-                 GL_UNSIGNED_BYTE,
-                 texture_buffer);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        RasterWorker &raster_worker = raster_workers[worker];
+        if (raster_worker.face == nullptr) {
+            if (FT_Init_FreeType(&raster_worker.library) ||
+                FT_New_Face(raster_worker.library,
+                            path.c_str(),
+                            0,
+                            &raster_worker.face)) {
+                return;
+            }
+            FT_Set_Pixel_Sizes(raster_worker.face, 0, font_size);
+        }
+        FT_Face face = raster_worker.face;
+        if (FT_Load_Char(face, codepoints[i], FT_LOAD_DEFAULT) ||
+            FT_Render_Glyph(face->glyph, render_mode)) {
+            return;
+        }
+        const FT_Bitmap &bitmap = face->glyph->bitmap;
+        Raster &raster = rasters[i];
+        raster.glyph.advance = {face->glyph->advance.x >> 6,
+                                face->glyph->advance.y >> 6};
+        raster.glyph.offset = {face->glyph->bitmap_left,
+                               face->glyph->bitmap_top};
+        raster.glyph.size = {bitmap.width, bitmap.rows};
+        raster.pixels.resize(bitmap.width * bitmap.rows);
+        for (u32 y = 0; y < bitmap.rows; ++y) {
+            std::memcpy(&raster.pixels[y * bitmap.width],
+                        bitmap.buffer + y * bitmap.pitch,
+                        bitmap.width);
+        }
+        raster.loaded = true;
+    });
+
+    // pack in codepoint order, so the atlas doesn't depend on thread timing
+    std::vector<u32> order(codepoints.size());
+    for (u32 i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](u32 a, u32 b) {
+        return codepoints[a] < codepoints[b];
+    });
+    for (u32 i : order) {
+        u32 codepoint = codepoints[i];
+        Raster &raster = rasters[i];
+        if (raster.skipped || find_glyph(codepoint) != nullptr) {
+            continue;
+        }
+        if (!raster.loaded) {
+            // let the cache path deal with (and remember) broken glyphs
+            rasterize(codepoint);
+            continue;
+        }
+        Glyph &glyph = raster.glyph;
+        if (glyph.size.x > 0 && glyph.size.y > 0) {
+            if (allocate(glyph.size.x + padding,
+                         glyph.size.y + padding,
+                         glyph.tex_coords,
+                         glyph.page)) {
+                pages[glyph.page].blit(glyph.tex_coords,
+                                       glyph.size.x,
+                                       glyph.size.y,
+                                       raster.pixels.data());
+            } else {
+                glyph.size = {0, 0};
+            }
+        } else {
+            glyph.size = {0, 0};
+        }
+        generation++;
+        Glyph *stored = &(glyphs[codepoint] = glyph);
+        if (codepoint < ascii.size()) {
+            ascii[codepoint] = stored;
+        }
+    }
+    for (auto &page : pages) {
+        page.flush();
+    }
+}
+
+bool Font::allocate(u32 w, u32 h, omega::math::ivec2 &pos, u32 &page) {
+    if (w > page_size || h > page_size) {
+        return false;
+    }
+    for (page = 0; page < pages.size(); ++page) {
+        if (pages[page].packer.pack(w, h, pos)) {
+            pages[page].last_used = frame;
+            return true;
+        }
+    }
+    if (pages.size() < max_pages) {
+        pages.emplace_back(page_size, page_size);
+        page = pages.size() - 1;
+        pages[page].last_used = frame;
+        return pages[page].packer.pack(w, h, pos);
+    }
+    // recycle the least recently used page, unless it's drawn this frame
+    i32 lru = -1;
+    for (u32 i = 0; i < pages.size(); ++i) {
+        if (pages[i].last_used < frame &&
+            (lru == -1 || pages[i].last_used < pages[lru].last_used)) {
+            lru = i;
+        }
+    }
+    if (lru == -1) {
+        return false;
+    }
+    evict(lru);
+    page = lru;
+    pages[page].last_used = frame;
+    return pages[page].packer.pack(w, h, pos);
+}
+
+void Font::evict(u32 page) {
+    generation++;
+    pages[page].clear();
+    for (auto it = glyphs.begin(); it != glyphs.end();) {
+        const Glyph &glyph = it->second;
+        if (glyph.page == page && glyph.size.x > 0) {
+            if (it->first < ascii.size()) {
+                ascii[it->first] = nullptr;
+            }
+            it = glyphs.erase(it);
+        } else {
+            ++it;
+        }
+    }
 }
 
 void Font::render(omega::gfx::SpriteBatch &batch,
@@ -75,8 +547,10 @@ void Font::render(omega::gfx::SpriteBatch &batch,
     f32 scale_factor = height / font_size;
 
     omega::math::vec2 origin = pos;
-    for (u32 i = 0; i < length; ++i) {
-        const auto &c = text[i];
+    for (u32 i = 0; i < length;) {
+        u32 len = 1;
+        u32 c = utf8::decode(text, i, length, len);
+        i += len;
         if (c == '\n') {
             pos.y -= font_height * scale_factor; // subtract for inverted y axis
             pos.x = origin.x;
@@ -86,7 +560,7 @@ void Font::render(omega::gfx::SpriteBatch &batch,
             pos.x += font_size * scale_factor;
             continue;
         }
-        const Glyph &glyph = glyphs[c];
+        const Glyph &glyph = get_glyph(c);
 
         // actual render pos
         omega::math::rectf src{(f32)glyph.tex_coords.x,
@@ -100,7 +574,7 @@ void Font::render(omega::gfx::SpriteBatch &batch,
             glyph.size.x * scale_factor,
             glyph.size.y * scale_factor};
 
-        batch.render_texture(texture.get(), src, dest);
+        batch.render_texture(get_texture(glyph.page), src, dest);
         pos.x += glyph.advance.x * scale_factor;
     }
 }
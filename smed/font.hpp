@@ -1,32 +1,50 @@
 #ifndef SMED_FONT_HPP
 #define SMED_FONT_HPP
 
+#include <array>
+#include <cstring>
+#include <chrono>
 #include <iostream>
 #include <omega/core/platform.hpp>
 #include <omega/gfx/sprite_batch.hpp>
 #include <omega/gfx/texture/texture.hpp>
 #include <omega/util/std.hpp>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "ft2build.h"
 #include FT_FREETYPE_H
+#include FT_CACHE_H
+#include FT_GLYPH_H
 #include <omega/math/math.hpp>
 #include <omega/util/log.hpp>
 #include <omega/util/types.hpp>
 
+#include "smed/atlas.hpp"
+#include "smed/thread_pool.hpp"
+#include "smed/utf8.hpp"
+
 struct Glyph {
     omega::math::vec2 offset;
     omega::math::vec2 advance; // pixels skipped till next character
     omega::math::ivec2 tex_coords;
     omega::math::ivec2 size;
+    u32 page = 0; // atlas page the bitmap lives on
 };
 
+/**
+ * Glyph atlas keyed by codepoint. Glyphs are rasterized lazily through the
+ * FreeType cache (FTC) and packed into atlas pages, the least recently used
+ * page is recycled once all pages are full
+ * */
 class Font {
   public:
     // Taken from Cakez: https://www.youtube.com/watch?v=23x0nGzHQgY
-    Font(const std::string &path, u32 height = 64);
+    // sdf stores signed distance fields, which stay sharp at any scale
+    Font(const std::string &path, u32 height = 64, bool sdf = false);
 
-    ~Font() = default;
+    ~Font();
 
     static void init() {
         FT_Error error = FT_Init_FreeType(&library);
@@ -39,6 +57,18 @@ class Font {
         FT_Done_FreeType(library);
     }
 
+    // resets the per frame rasterization budget, call before rendering
+    void begin_frame();
+    // glyphs were skipped last frame to stay within the budget
+    bool has_pending() const {
+        return pending;
+    }
+    // changes whenever glyphs are added or evicted, so cached quads know
+    // when to be rebuilt
+    u64 get_generation() const {
+        return generation;
+    }
+
     void render(omega::gfx::SpriteBatch &batch,
                 const char *text,
                 u32 length,
@@ -49,23 +79,111 @@ class Font {
     u32 get_font_size() const {
         return font_size;
     }
+    bool is_sdf() const {
+        return render_mode == FT_RENDER_MODE_SDF;
+    }
     u32 get_font_height() const {
         return font_height;
     }
-    const Glyph &get_glyph(char c) const {
-        return glyphs[c];
+    /**
+     * Returns the glyph, rasterizing it if needed. When the frame's budget is
+     * used up, an empty glyph with the right advance is returned instead
+     * */
+    const Glyph &get_glyph(u32 codepoint);
+    // advance without rasterizing, for layout
+    f32 get_advance(u32 codepoint) {
+        if (codepoint < ascii_advances.size()) {
+            return ascii_advances[codepoint];
+        }
+        if (monospace) {
+            return mono_advance;
+        }
+        return lookup_advance(codepoint);
+    }
+    /**
+     * Every character of a monospace font is one column of the same advance,
+     * so x positions are column * advance
+     * */
+    bool is_monospace() const {
+        return monospace;
+    }
+    f32 get_mono_advance() const {
+        return mono_advance;
     }
 
-    omega::gfx::texture::Texture *get_texture() {
-        return texture.get();
+    omega::gfx::texture::Texture *get_texture(u32 page = 0) {
+        return pages[page].texture.get();
     }
 
   private:
-    omega::util::sptr<omega::gfx::texture::Texture> texture = nullptr;
-    Glyph glyphs[127];
+    static FT_Error face_requester(FTC_FaceID face_id,
+                                   FT_Library library,
+                                   FT_Pointer req_data,
+                                   FT_Face *face);
+
+    FTC_FaceID face_id() {
+        return (FTC_FaceID)this;
+    }
+    // on-disk copy of the atlas after startup, keyed by font path, mtime and
+    // size
+    std::string cache_key() const;
+    std::string cache_path(const std::string &key) const;
+    bool load_cache();
+    void save_cache();
+
+    void detect_monospace();
+    bool load_glyph(u32 codepoint, FT_Glyph &glyph);
+    f32 lookup_advance(u32 codepoint);
+    Glyph *find_glyph(u32 codepoint);
+    Glyph *rasterize(u32 codepoint);
+    // rasterizes on all cores, then packs and uploads the results at once.
+    // Glyphs not started by the deadline are left out
+    void rasterize_batch(std::vector<u32> codepoints,
+                         std::chrono::steady_clock::time_point deadline =
+                             std::chrono::steady_clock::time_point::max());
+    bool allocate(u32 w, u32 h, omega::math::ivec2 &pos, u32 &page);
+    void evict(u32 page);
+    const Glyph &pending_glyph(u32 codepoint);
+
+    std::string path;
     static FT_Library library;
+    FTC_Manager manager = nullptr;
+    FTC_CMapCache cmap_cache = nullptr;
+    FTC_ImageCache image_cache = nullptr;
+
+    std::vector<AtlasPage> pages;
+    const u32 page_size = 512;
+    const u32 max_pages = 8;
+    const i32 padding = 1; // space between chars
+
+    std::unordered_map<u32, Glyph> glyphs;
+    std::array<Glyph *, 128> ascii{}; // fast path into glyphs
+    std::array<f32, 128> ascii_advances{};
+    bool monospace = false;
+    f32 mono_advance = 0.0f;
+    std::unordered_map<u32, f32> advances;
+
+    // FreeType faces aren't thread safe, so each worker opens its own
+    struct RasterWorker {
+        FT_Library library = nullptr;
+        FT_Face face = nullptr;
+    };
+    omega::util::uptr<ThreadPool> raster_pool = nullptr;
+    std::vector<RasterWorker> raster_workers;
+    std::vector<u32> missing; // glyphs deferred by the budget last frame
+
+    // rasterization budget, so new glyphs can't stall a frame
+    using clock = std::chrono::steady_clock;
+    const clock::duration raster_budget = std::chrono::milliseconds(2);
+    clock::duration raster_time{0};
+    u64 frame = 1;
+    u64 generation = 0;
+    bool pending = false;
+    Glyph pending_result;
+
     u32 font_height = 0; // total spacing factor
     u32 font_size = 0;   // size in pixels
+    FT_Render_Mode render_mode = FT_RENDER_MODE_NORMAL;
 };
 
 #endif // SMED_FONT_HPP
@@ -0,0 +1,93 @@
+#include "frame_stats.hpp"
+
+#include <algorithm>
+#include <imgui/imgui.h>
+
+static f64 ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<f64, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+FrameStats::Scope::Scope(Phase phase) : phase(phase) {
+    auto &stats = FrameStats::get();
+    outer = stats.open_scope;
+    stats.open_scope = this;
+    start = std::chrono::steady_clock::now();
+}
+
+FrameStats::Scope::~Scope() {
+    auto &stats = FrameStats::get();
+    f64 elapsed = ms_since(start);
+    stats.times[(u32)phase] += elapsed - nested;
+    if (outer != nullptr) {
+        outer->nested += elapsed;
+    }
+    stats.open_scope = outer;
+}
+
+void FrameStats::begin_frame() {
+    times.fill(0.0);
+    counters.fill(0);
+    frame_start = std::chrono::steady_clock::now();
+}
+
+void FrameStats::end_frame() {
+    for (u32 i = 0; i < phase_count; ++i) {
+        time_history[i][history_idx] = times[i];
+    }
+    for (u32 i = 0; i < counter_count; ++i) {
+        counter_history[i][history_idx] = counters[i];
+    }
+    frame_history[history_idx] = ms_since(frame_start);
+    history_idx = (history_idx + 1) % history_size;
+}
+
+void FrameStats::render_overlay(bool *open) {
+    static const char *phase_names[] = {
+        "input", "retokenize", "layout", "vertex build", "upload", "draw"};
+    static const char *counter_names[] = {
+        "tokens lexed", "glyphs", "draw calls", "gap bytes moved"};
+    // the newest entry is the one before history_idx
+    u32 last = (history_idx + history_size - 1) % history_size;
+    const auto histogram = [&](const char *id,
+                               const std::array<f32, history_size> &values) {
+        f32 max = *std::max_element(values.begin(), values.end());
+        ImGui::PlotHistogram(id,
+                             values.data(),
+                             history_size,
+                             history_idx,
+                             nullptr,
+                             0.0f,
+                             std::max(max, 1.0f),
+                             ImVec2(240.0f, 32.0f));
+    };
+
+    ImGui::SetNextWindowPos(ImVec2(10.0f, 40.0f), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.8f);
+    if (!ImGui::Begin("Frame stats",
+                      open,
+                      ImGuiWindowFlags_AlwaysAutoResize |
+                          ImGuiWindowFlags_NoFocusOnAppearing)) {
+        ImGui::End();
+        return;
+    }
+    ImGui::Text("frame %7.3f ms", frame_history[last]);
+    histogram("##frame", frame_history);
+    ImGui::Separator();
+    // cpu time, the gpu works asynchronously
+    for (u32 i = 0; i < phase_count; ++i) {
+        ImGui::Text("%-16s %7.3f ms", phase_names[i], time_history[i][last]);
+        ImGui::PushID(i);
+        histogram("##phase", time_history[i]);
+        ImGui::PopID();
+    }
+    ImGui::Separator();
+    for (u32 i = 0; i < counter_count; ++i) {
+        ImGui::Text("%-16s %7.0f", counter_names[i], counter_history[i][last]);
+        ImGui::PushID(phase_count + i);
+        histogram("##counter", counter_history[i]);
+        ImGui::PopID();
+    }
+    ImGui::End();
+}
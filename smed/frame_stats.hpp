@@ -0,0 +1,83 @@
+#ifndef SMED_FRAMESTATS_HPP
+#define SMED_FRAMESTATS_HPP
+
+#include <array>
+#include <chrono>
+#include <omega/util/types.hpp>
+
+/**
+ * Per frame timings of the editor's phases and counters of the work done,
+ * with a rolling history of each drawn as histograms in an ImGui overlay.
+ * Phases nest: a phase started inside another one is taken out of the outer
+ * phase's time, so the phases of a frame add up
+ * */
+class FrameStats {
+  public:
+    enum class Phase : u8 {
+        INPUT = 0,
+        RETOKENIZE,
+        LAYOUT,
+        VERTEX_BUILD,
+        UPLOAD,
+        DRAW,
+        COUNT
+    };
+    enum class Counter : u8 {
+        TOKENS = 0,
+        GLYPHS,
+        DRAW_CALLS,
+        GAP_BYTES_MOVED,
+        COUNT
+    };
+
+    // times a phase until it goes out of scope
+    class Scope {
+      public:
+        Scope(Phase phase);
+        ~Scope();
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+      private:
+        Phase phase;
+        std::chrono::steady_clock::time_point start;
+        f64 nested = 0.0; // ms spent in phases started inside this one
+        Scope *outer = nullptr;
+    };
+
+    static FrameStats &get() {
+        static FrameStats stats;
+        return stats;
+    }
+
+    void begin_frame();
+    // moves the frame into the history
+    void end_frame();
+
+    void count(Counter counter, u64 n = 1) {
+        counters[(u32)counter] += n;
+    }
+
+    // the overlay, has to be called inside an ImGui frame
+    void render_overlay(bool *open);
+
+  private:
+    static constexpr u32 history_size = 240; // frames
+    static constexpr u32 phase_count = (u32)Phase::COUNT;
+    static constexpr u32 counter_count = (u32)Counter::COUNT;
+
+    std::array<f64, phase_count> times{}; // ms of the current frame
+    std::array<u64, counter_count> counters{};
+    std::chrono::steady_clock::time_point frame_start;
+    Scope *open_scope = nullptr;
+
+    // ring buffers, oldest entry at history_idx
+    std::array<std::array<f32, history_size>, phase_count> time_history{};
+    std::array<std::array<f32, history_size>, counter_count>
+        counter_history{};
+    std::array<f32, history_size> frame_history{};
+    u32 history_idx = 0;
+};
+
+#endif // SMED_FRAMESTATS_HPP
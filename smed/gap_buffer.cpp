@@ -1,7 +1,10 @@
 #include "gap_buffer.hpp"
 
+#include <algorithm>
 #include <iostream>
 
+#include "smed/frame_stats.hpp"
+
 GapBuffer::GapBuffer(const char *text) {
     open(text);
 }
@@ -24,9 +27,13 @@ void GapBuffer::open(const char *text) {
     strncpy(this->text + gap_length, text, text_length);
     gap_start = this->text;
     gap_end = gap_start + gap_length;
+    // nothing typed into the old buffer's gap carries over
+    gap_idx = 0;
+    edit = {};
 }
 
 void GapBuffer::move_buffer(bool right) {
+    FrameStats::get().count(FrameStats::Counter::GAP_BYTES_MOVED);
     if (right) {
         gap_start++;
         *(gap_start + gap_idx - 1) = *gap_end;
@@ -39,6 +46,7 @@ void GapBuffer::move_buffer(bool right) {
 }
 
 void GapBuffer::insert_char(char c) {
+    record_insert(cursor());
     if (gap_idx < gap_length) {
         gap_start[gap_idx++] = c;
     } else {
@@ -50,6 +58,8 @@ void GapBuffer::insert_char(char c) {
         strncpy(new_text, text, buff1_size);
         // copy everything from buff2, after the new gap buffer
         strncpy(new_text + buff1_size + gap_length, gap_end, end - gap_end);
+        FrameStats::get().count(FrameStats::Counter::GAP_BYTES_MOVED,
+                                buff1_size + (end - gap_end));
         delete[] text;
         text = new_text;
         // update counters
@@ -80,6 +90,9 @@ void GapBuffer::move_cursor_to(u32 new_pos) {
 std::pair<bool, bool> GapBuffer::backspace_char() {
     bool line_change = false;
     bool char_change = false;
+    if (cursor() > 0) {
+        record_remove(cursor() - 1);
+    }
     // if there's text in the gap buffer, simply decrement the gap_idx
     if (gap_idx > 0) {
         line_change = gap_start[gap_idx] == '\n';
@@ -99,11 +112,84 @@ std::pair<bool, bool> GapBuffer::backspace_char() {
 void GapBuffer::delete_char() {
     // swallow the last character if possible
     if (gap_end < end) {
+        record_remove(cursor());
         gap_end++;
         gap_length++;
     }
 }
 
+void GapBuffer::splice(u32 from,
+                       u32 to,
+                       const char *data,
+                       u32 size,
+                       u32 new_cursor) {
+    u32 new_length = length() - (to - from) + size;
+    char *new_text = new char[new_length + gap_length];
+    // [0, from) of the old text, data, then [to, length) of the old text,
+    // each piece split around the gap
+    u32 at = 0;
+    const auto put = [&](const char *piece, u32 begin, u32 end) {
+        u32 n = end - begin;
+        u32 before = at < new_cursor ? std::min(n, new_cursor - at) : 0;
+        char *dst = new_text + at;
+        if (piece != nullptr) {
+            std::memcpy(dst, piece + begin, before);
+            std::memcpy(dst + before + gap_length,
+                        piece + begin + before,
+                        n - before);
+        } else {
+            copy_out(begin, begin + before, dst);
+            copy_out(begin + before, end, dst + before + gap_length);
+        }
+        at += n;
+    };
+    put(nullptr, 0, from);
+    put(data, 0, size);
+    put(nullptr, to, length());
+    FrameStats::get().count(FrameStats::Counter::GAP_BYTES_MOVED, new_length);
+
+    delete[] text;
+    text = new_text;
+    total_length = new_length + gap_length;
+    end = text + total_length;
+    gap_start = text + new_cursor;
+    gap_end = gap_start + gap_length;
+    gap_idx = 0;
+    record_replace(from, to, size);
+}
+
+void GapBuffer::record_insert(u32 idx) {
+    if (!edit.changed) {
+        edit = {idx, idx + 1, 1, true};
+        return;
+    }
+    edit.end = idx <= edit.end ? edit.end + 1 : idx + 1;
+    edit.begin = std::min(edit.begin, idx);
+    edit.delta++;
+}
+
+void GapBuffer::record_remove(u32 idx) {
+    if (!edit.changed) {
+        edit = {idx, idx, -1, true};
+        return;
+    }
+    edit.end = idx < edit.end ? edit.end - 1 : idx;
+    edit.begin = std::min(edit.begin, idx);
+    edit.delta--;
+}
+
+void GapBuffer::record_replace(u32 from, u32 to, u32 size) {
+    i32 delta = (i32)size - (i32)(to - from);
+    if (!edit.changed) {
+        edit = {from, from + size, delta, true};
+        return;
+    }
+    // the merged range covers both, its end moves with the replacement
+    edit.end = std::max(edit.end, to) + delta;
+    edit.begin = std::min(edit.begin, from);
+    edit.delta += delta;
+}
+
 void GapBuffer::print() {
     char *i = text;
     for (; i < gap_start; ++i) {
@@ -1,13 +1,23 @@
 #ifndef SMED_GAPBUFFER_HPP
 #define SMED_GAPBUFFER_HPP
 
+#include <algorithm>
 #include <cstring>
 #include <omega/util/types.hpp>
 #include <string>
 #include <utility>
 
+#include "smed/utf8.hpp"
+
 class GapBuffer {
   public:
+    // text changed by edits, in the current indices
+    struct Edit {
+        u32 begin = 0, end = 0; // [begin, end) replaced [begin, end - delta)
+        i32 delta = 0;          // text after end moved by delta
+        bool changed = false;
+    };
+
     GapBuffer(const char *text);
     ~GapBuffer();
 
@@ -17,13 +27,26 @@ class GapBuffer {
     void insert_char(char c);
     void move_cursor_to(u32 new_pos);
     /**
-     * Delete the character at the gap_idx, and return if there's a line change,
-     * char_change
+     * Delete the byte before the gap, and return if there's a line change,
+     * char_change. A character of several bytes takes one call per byte, see
+     * prev_char
      * */
     std::pair<bool, bool> backspace_char();
     void delete_char();
+    /**
+     * Replaces [from, to) with size bytes of data by writing a new buffer
+     * from the old segments in one pass, the gap is left at new_cursor
+     * */
+    void splice(u32 from, u32 to, const char *data, u32 size, u32 new_cursor);
     void print();
 
+    // the edits since the last call, merged into one range
+    Edit take_edit() {
+        Edit e = edit;
+        edit = {};
+        return e;
+    }
+
     u32 gap_size() const {
         return gap_length;
     }
@@ -67,13 +90,33 @@ class GapBuffer {
         return text[i + (gap_length - gap_idx)];
     }
 
-    std::string substr(u32 i, u32 l) {
-        std::string s;
-        for (u32 x = i; x < i + l; ++x) {
-            s += get(x);
-        }
+    // decode the UTF-8 character starting at i, len is set to its byte count
+    u32 codepoint_at(u32 i, u32 &len) const {
+        return utf8::decode(
+            [this](u32 k) { return (u8)get(k); }, i, length(), len);
+    }
+    // start of the character before i and end of the one at i, the cursor
+    // moves and deletes by these so it never lands inside a character
+    u32 prev_char(u32 i) const {
+        return utf8::prev([this](u32 k) { return (u8)get(k); }, i);
+    }
+    u32 next_char(u32 i) const {
+        return utf8::next([this](u32 k) { return (u8)get(k); }, i, length());
+    }
+
+    std::string substr(u32 i, u32 l) const {
+        std::string s(l, '\0');
+        copy_out(i, i + l, s.data());
         return s;
     }
+    // copies [from, to) into out, across the gap
+    void copy_out(u32 from, u32 to, char *out) const {
+        u32 split = std::clamp(cursor(), from, to);
+        std::memcpy(out, text + from, split - from);
+        std::memcpy(out + (split - from),
+                    gap_end + (split - cursor()),
+                    to - split);
+    }
 
     bool compare(size_t start_index, const char *s, size_t n) const {
         if (start_index + n >= length()) {
@@ -147,6 +190,11 @@ class GapBuffer {
     }
 
   private:
+    void record_insert(u32 idx);
+    void record_remove(u32 idx);
+    void record_replace(u32 from, u32 to, u32 size);
+
+    Edit edit;
     char *text = nullptr;
     char *end = nullptr;
 
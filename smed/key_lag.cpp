@@ -39,3 +39,12 @@ void update_keys(omega::events::InputManager &input) {
         }
     }
 }
+
+bool keys_held(omega::events::InputManager &input) {
+    for (const auto &k : key_list) {
+        if (input.key_manager[k.key]) {
+            return true;
+        }
+    }
+    return false;
+}
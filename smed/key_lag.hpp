@@ -9,5 +9,7 @@ void register_key(
     omega::events::Key key,
     std::function<void(omega::events::InputManager &input)> callback);
 void update_keys(omega::events::InputManager &input);
+// whether a registered key is held down, so it repeats on later frames
+bool keys_held(omega::events::InputManager &input);
 
 #endif // SMED_KEYLAG_HPP
@@ -0,0 +1,22 @@
+#ifndef SMED_LAYOUT_HPP
+#define SMED_LAYOUT_HPP
+
+#include "smed/bracket_index.hpp"
+#include "smed/fold_index.hpp"
+#include "smed/line_index.hpp"
+#include "smed/width_index.hpp"
+#include "smed/wrap_layout.hpp"
+
+/**
+ * Indices rebuilt from the text on every retokenize, shared by rendering and
+ * cursor math
+ * */
+struct Layout {
+    LineIndex lines;
+    WidthIndex widths;
+    WrapLayout wraps;
+    FoldIndex folds;
+    BracketIndex brackets;
+};
+
+#endif // SMED_LAYOUT_HPP
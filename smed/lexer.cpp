@@ -3,6 +3,8 @@
 #include <cctype>
 #include <cstring>
 
+#include "smed/utf8.hpp"
+
 constexpr static char *keywords[] = {
     "auto",
     "break",
@@ -120,6 +122,10 @@ std::string Token::to_string() {
             return "Open curly";
         case TokenType::CLOSE_CURLY:
             return "Close curly";
+        case TokenType::OPEN_SQUARE:
+            return "Open square";
+        case TokenType::CLOSE_SQUARE:
+            return "Close square";
         case TokenType::SEMICOLON:
             return "Semicolon";
         case TokenType::KEYWORD:
@@ -134,14 +140,33 @@ std::string Token::to_string() {
     return "";
 }
 
-Lexer::Lexer(GapBuffer *gap_buffer, Font *font)
-    : text(gap_buffer), idx(0), line(0), line_start(0), font(font) {}
+Lexer::Lexer(GapBuffer *gap_buffer,
+             Font *font,
+             WidthIndex *widths,
+             WrapLayout *wraps,
+             BracketIndex *brackets)
+    : text(gap_buffer),
+      idx(0),
+      line(0),
+      line_start(0),
+      font(font),
+      widths(widths),
+      wraps(wraps),
+      brackets(brackets) {}
 
 void Lexer::retokenize() {
     idx = 0;
     line = 0;
     line_start = 0;
     pos = {0.0f, 0.0f};
+    column = 0;
+    widths->clear();
+    row_start = 0;
+    row_x = 0.0f;
+    break_idx = 0;
+    break_x = 0.0f;
+    wraps->clear();
+    brackets->clear();
 }
 
 void Lexer::trim_left() {
@@ -171,18 +196,78 @@ bool is_num_start(char x) {
 
 char Lexer::chop_char() {
     char x = text->get(idx);
+    u32 char_idx = idx;
     idx++;
+    // without a font only the tokens are wanted, nothing is laid out
+    if (font == nullptr) {
+        if (x == '\n') {
+            line++;
+            line_start = idx;
+        }
+        return x;
+    }
     if (x == '\n') {
         line++;
         line_start = idx;
+        column = 0;
         pos.y += font->get_font_height();
         pos.x = 0.0f;
+        row_start = idx;
+        row_x = 0.0f;
+        break_idx = idx;
+        break_x = 0.0f;
+        return x;
+    }
+    // the lead byte of a multi byte character carries the advance
+    if (utf8::is_continuation(x)) {
+        return x;
+    }
+    // long lines get prefix width checkpoints
+    if (column != 0 && column % WidthIndex::interval == 0) {
+        widths->add(char_idx, pos.x);
+    }
+    column++;
+
+    f32 advance = 0.0f;
+    if ((u8)x < 0x80) {
+        advance = font->get_advance(x);
+    } else if (font->is_monospace()) {
+        // one column per character, no need to decode it
+        advance = font->get_mono_advance();
     } else {
-        pos.x += font->get_glyph(x).advance.x;
+        u32 len = 1;
+        advance = font->get_advance(text->codepoint_at(char_idx, len));
+    }
+    if (wraps->is_enabled()) {
+        wrap(char_idx, advance);
+    }
+    pos.x += advance;
+    if (x == ' ' || x == '\t') {
+        break_idx = idx;
+        break_x = pos.x;
     }
     return x;
 }
 
+void Lexer::wrap(u32 char_idx, f32 advance) {
+    f32 width = wraps->get_width();
+    if (pos.x + advance - row_x <= width) {
+        return;
+    }
+    // break after the row's last whitespace, keeping the word together
+    if (break_idx > row_start) {
+        wraps->add(break_idx, break_x);
+        row_start = break_idx;
+        row_x = break_x;
+    }
+    // words longer than a row are broken anywhere
+    if (pos.x + advance - row_x > width && char_idx > row_start) {
+        wraps->add(char_idx, pos.x);
+        row_start = char_idx;
+        row_x = pos.x;
+    }
+}
+
 bool Lexer::starts_with(const char *prefix, size_t prefix_len) {
     if (prefix_len == 0) {
         return true;
@@ -220,17 +305,23 @@ Token Lexer::next() {
         return token;
     }
 
-    const char literal_tokens[] = {'(', ')', '{', '}', ';'};
+    const char literal_tokens[] = {'(', ')', '{', '}', '[', ']', ';'};
     const TokenType types[] = {TokenType::OPEN_PAREN,
                                TokenType::CLOSE_PAREN,
                                TokenType::OPEN_CURLY,
                                TokenType::CLOSE_CURLY,
+                               TokenType::OPEN_SQUARE,
+                               TokenType::CLOSE_SQUARE,
                                TokenType::SEMICOLON};
-    for (size_t i = 0; i < 5; ++i) {
+    for (size_t i = 0; i < 7; ++i) {
         char c = literal_tokens[i];
         if (c == text->get(idx)) {
             token.type = types[i];
             token.len++;
+            // pairs of the same kind are next to each other in the list
+            if (i < 6) {
+                brackets->add(idx, (BracketIndex::Kind)(i / 2), i % 2 == 0);
+            }
             chop_char();
             return token;
         }
@@ -353,9 +444,13 @@ Token Lexer::next() {
         }
     }
 
+    // keep multi byte characters in one token, so they render whole
     token.type = TokenType::INVALID;
-    token.len = 1;
-    chop_char();
+    token.len = omega::math::min(
+        (size_t)utf8::sequence_length(text->get(idx)), len - idx);
+    for (size_t i = 0; i < token.len; ++i) {
+        chop_char();
+    }
 
     return token;
 }
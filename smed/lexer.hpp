@@ -5,8 +5,11 @@
 #include <omega/math/math.hpp>
 #include <string>
 
+#include "smed/bracket_index.hpp"
 #include "smed/font.hpp"
 #include "smed/gap_buffer.hpp"
+#include "smed/width_index.hpp"
+#include "smed/wrap_layout.hpp"
 
 // The following initial implementation is Tsoding's:
 // https://www.youtube.com/watch?v=AqyZztKlSGQ&list=PLpM-Dvs8t0VZVshbPeHPculzFFBdQWIFu&index=15
@@ -19,6 +22,8 @@ enum class TokenType {
     CLOSE_PAREN,
     OPEN_CURLY,
     CLOSE_CURLY,
+    OPEN_SQUARE,
+    CLOSE_SQUARE,
     SEMICOLON,
     KEYWORD,
     TYPE,
@@ -55,7 +60,12 @@ struct Token {
 };
 
 struct Lexer {
-    Lexer(GapBuffer *text, Font *font);
+    // font can be null to only tokenize, like for indexing files
+    Lexer(GapBuffer *text,
+          Font *font,
+          WidthIndex *widths,
+          WrapLayout *wraps,
+          BracketIndex *brackets);
 
     Token next();
     void retokenize();
@@ -69,11 +79,21 @@ struct Lexer {
   private:
     void trim_left();
     char chop_char();
+    // soft wraps the row before the character at char_idx if it overflows
+    void wrap(u32 char_idx, f32 advance);
     bool starts_with(const char *prefix, size_t prefix_len);
 
     // INFO: the next part is only for rendering
     Font *font = nullptr;
     omega::math::vec2 pos{0.0f};
+    WidthIndex *widths = nullptr; // filled with checkpoints while lexing
+    u32 column = 0;
+    WrapLayout *wraps = nullptr; // filled with soft wrap points
+    u32 row_start = 0;
+    f32 row_x = 0.0f;
+    u32 break_idx = 0; // after the last whitespace, rows rather break there
+    f32 break_x = 0.0f;
+    BracketIndex *brackets = nullptr; // filled with the bracket pairs
 };
 
 #endif // SMED_LEXER_HPP
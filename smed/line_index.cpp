@@ -0,0 +1,28 @@
+#include "line_index.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+void LineIndex::rebuild(const GapBuffer &text) {
+    starts.clear();
+    starts.push_back(0);
+    length = text.length();
+
+    // the text is stored in 2 contiguous segments around the gap, so memchr
+    // can scan each of them directly
+    const auto scan = [&](const char *segment, u32 size, u32 offset) {
+        const char *c = segment;
+        const char *segment_end = segment + size;
+        while ((c = (const char *)memchr(c, '\n', segment_end - c))) {
+            starts.push_back(offset + (c - segment) + 1);
+            c++;
+        }
+    };
+    scan(text.head(), text.cursor(), 0);
+    scan(text.buff2(), text.buff2_size(), text.cursor());
+}
+
+u32 LineIndex::line_of(u32 idx) const {
+    auto it = std::upper_bound(starts.begin(), starts.end(), idx);
+    return (it - starts.begin()) - 1;
+}
@@ -0,0 +1,38 @@
+#ifndef SMED_LINEINDEX_HPP
+#define SMED_LINEINDEX_HPP
+
+#include <omega/util/types.hpp>
+#include <vector>
+
+#include "smed/gap_buffer.hpp"
+
+/**
+ * Sorted table of line start offsets into a GapBuffer, so that line <-> offset
+ * queries don't have to walk the text from index 0
+ * */
+class LineIndex {
+  public:
+    void rebuild(const GapBuffer &text);
+
+    u32 line_count() const {
+        return starts.size();
+    }
+    u32 line_start(u32 line) const {
+        return starts[line];
+    }
+    // index of the terminating '\n' or the text length for the last line
+    u32 line_end(u32 line) const {
+        if (line + 1 < starts.size()) {
+            return starts[line + 1] - 1;
+        }
+        return length;
+    }
+    // binary search for the line containing idx
+    u32 line_of(u32 idx) const;
+
+  private:
+    std::vector<u32> starts{0};
+    u32 length = 0;
+};
+
+#endif // SMED_LINEINDEX_HPP
@@ -13,15 +13,70 @@
 #include <omega/scene/orthographic_camera.hpp>
 #include <omega/util/log.hpp>
 #include <omega/util/std.hpp>
+#include <tomlplusplus/toml.hpp>
 
 #include "smed/editor.hpp"
 #include "smed/font.hpp"
+#include "smed/frame_stats.hpp"
+#include "smed/key_lag.hpp"
 
 using namespace omega;
 
+// controls when the editor draws new frames, read from the [redraw] table
+struct RedrawConfig {
+    bool lazy = true;        // sleep on SDL_WaitEvent while nothing changes
+    bool animations = false; // animate the default text color every frame
+
+    static RedrawConfig from_config(const std::string &path) {
+        RedrawConfig redraw;
+        auto config = toml::parse_file(path);
+        redraw.lazy = config["redraw"]["lazy"].value_or(redraw.lazy);
+        redraw.animations =
+            config["redraw"]["animations"].value_or(redraw.animations);
+        return redraw;
+    }
+};
+
+// glyph atlas settings, read from the [font] table
+struct FontConfig {
+    std::string path = "./res/font/FiraMonoNerdFontMono-Regular.otf";
+    u32 size = 64;    // rasterized pixel size, scaled to the zoom level
+    bool sdf = false; // distance field atlas, sharp at every zoom level
+
+    static FontConfig from_config(const std::string &path) {
+        FontConfig font;
+        auto config = toml::parse_file(path);
+        font.path = config["font"]["path"].value_or(font.path);
+        font.sdf = config["font"]["sdf"].value_or(font.sdf);
+        // a distance field atlas can be much smaller for the same quality
+        font.size = config["font"]["size"].value_or(font.sdf ? 32u : 64u);
+        return font;
+    }
+};
+
+// editing behaviour, read from the [editor] table
+struct EditorConfig {
+    bool wrap = false; // soft wrap long lines at the view's width
+
+    static EditorConfig from_config(const std::string &path) {
+        EditorConfig editor;
+        auto config = toml::parse_file(path);
+        editor.wrap = config["editor"]["wrap"].value_or(editor.wrap);
+        return editor;
+    }
+};
+
 struct App : public core::App {
-    App(const core::AppConfig &config, const std::string &path)
-        : core::App(config), path(path) {}
+    App(const core::AppConfig &config,
+        const RedrawConfig &redraw,
+        const FontConfig &font_config,
+        const EditorConfig &editor_config,
+        const std::string &path)
+        : core::App(config),
+          redraw(redraw),
+          font_config(font_config),
+          editor_config(editor_config),
+          path(path) {}
 
     void setup() override {
         // set the icon
@@ -36,32 +91,40 @@ struct App : public core::App {
         globals->asset_manager.load_shader("font", "./res/shaders/font.glsl");
         globals->asset_manager.load_shader("classic_font",
                                            "./res/shaders/classic_font.glsl");
+        globals->asset_manager.load_shader("tile", "./res/shaders/tile.glsl");
 
         SDL_StartTextInput(window->get_native_window());
         Font::init();
         font = util::create_uptr<Font>(
-            "./res/font/FiraMonoNerdFontMono-Regular.otf", 64);
+            font_config.path, font_config.size, font_config.sdf);
 
         editor = util::create_uptr<Editor>(
             globals->asset_manager.get_shader("font"),
             globals->asset_manager.get_shader("classic_font"),
+            globals->asset_manager.get_shader("tile"),
             font.get(),
             path);
+        editor->set_animations(redraw.animations);
+        editor->set_wrap(editor_config.wrap);
     }
 
     ~App() {
+        // the glyph cache has to be released before FreeType itself
+        editor = nullptr;
+        font = nullptr;
         Font::quit();
     }
 
     void render(f32 dt) override {
-        gfx::set_clear_color(
-            17.0f / 255.0f, 17.0f / 255.0f, 27.0f / 255.0f, 1.0f);
+        const auto &bg = Editor::background;
+        gfx::set_clear_color(bg.r, bg.g, bg.b, bg.a);
         gfx::clear_buffer(OMEGA_GL_COLOR_BUFFER_BIT);
 
-        auto &batch = globals->sprite_batch;
-        auto &shape = globals->shape_renderer;
-
-        editor->render(font.get(), *cam, batch, shape);
+        font->begin_frame();
+        editor->render(font.get(), *cam);
+        if (imgui && show_stats) {
+            FrameStats::get().render_overlay(&show_stats);
+        }
     }
 
     void update(f32 dt) override {}
@@ -71,11 +134,36 @@ struct App : public core::App {
         if (keys[events::Key::k_l_ctrl] && keys[events::Key::k_q]) {
             running = false;
         }
+        // frame timings overlay
+        if (keys[events::Key::k_l_ctrl] &&
+            keys.key_just_pressed(events::Key::k_t)) {
+            show_stats = !show_stats;
+        }
         editor->handle_input(globals->input);
     }
 
+    /**
+     * Whether the next frame has to be drawn even without new events: the
+     * camera is still easing, glyphs are waiting to be rasterized, search
+     * results are coming in, a held key is repeating, or animations are on
+     * */
+    bool needs_redraw() const {
+        if (!redraw.lazy || redraw.animations || editor->is_animating() ||
+            editor->is_busy() || font->has_pending()) {
+            return true;
+        }
+        // only keys that repeat need frames while held, a held modifier
+        // doesn't
+        return keys_held(globals->input);
+    }
+
     void frame() override {
+        // sleep until something happens instead of redrawing an idle editor
+        if (!needs_redraw()) {
+            SDL_WaitEvent(nullptr);
+        }
         f32 dt = tick();
+        FrameStats::get().begin_frame();
 
         auto &input = globals->input;
         input.prepare_for_update();
@@ -101,7 +189,7 @@ struct App : public core::App {
                         math::vec2((f32)event.wheel.x, (f32)event.wheel.y);
                     break;
                 case events::EventType::text_input:
-                    editor->handle_text(input, event.text.text[0]);
+                    editor->handle_text(input, event.text.text);
                     break;
                 default:
                     break;
@@ -116,13 +204,18 @@ struct App : public core::App {
         omega::core::end_imgui_frame(window);
 
         window->swap_buffers();
+        FrameStats::get().end_frame();
     }
 
     util::uptr<scene::OrthographicCamera> cam = nullptr;
     util::uptr<Editor> editor = nullptr;
     util::uptr<Font> font = nullptr;
 
+    RedrawConfig redraw;
+    FontConfig font_config;
+    EditorConfig editor_config;
     std::string path;
+    bool show_stats = false;
 };
 
 int main(int argc, char **argv) {
@@ -139,7 +232,11 @@ int main(int argc, char **argv) {
     }
 
     core::AppConfig config = core::AppConfig::from_config("./res/config.toml");
-    App app(config, argv[1]);
+    RedrawConfig redraw = RedrawConfig::from_config("./res/config.toml");
+    FontConfig font_config = FontConfig::from_config("./res/config.toml");
+    EditorConfig editor_config =
+        EditorConfig::from_config("./res/config.toml");
+    App app(config, redraw, font_config, editor_config, argv[1]);
     app.run();
     return 0;
 }
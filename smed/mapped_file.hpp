@@ -0,0 +1,64 @@
+#ifndef SMED_MAPPEDFILE_HPP
+#define SMED_MAPPEDFILE_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <omega/util/types.hpp>
+#include <string>
+
+/**
+ * Read only memory mapping of a whole file, unmapped when it goes out of scope
+ * */
+class MappedFile {
+  public:
+    MappedFile(const std::string &path) {
+        i32 fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            length = st.st_size;
+            opened = true;
+            if (length > 0) {
+                void *ptr =
+                    mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (ptr == MAP_FAILED) {
+                    opened = false;
+                    length = 0;
+                } else {
+                    bytes = (const char *)ptr;
+                }
+            }
+        }
+        ::close(fd);
+    }
+    ~MappedFile() {
+        if (bytes != nullptr) {
+            munmap((void *)bytes, length);
+        }
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool is_open() const {
+        return opened;
+    }
+    const char *data() const {
+        return bytes;
+    }
+    size_t size() const {
+        return length;
+    }
+
+  private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+    bool opened = false;
+};
+
+#endif // SMED_MAPPEDFILE_HPP
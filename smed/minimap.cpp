@@ -0,0 +1,184 @@
+#include "minimap.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <omega/gfx/gl.hpp>
+
+#include "smed/buffer_renderer.hpp"
+
+static u32 pack_color(const omega::math::vec4 &color) {
+    const auto channel = [](f32 c) {
+        return (u32)(omega::math::min(omega::math::max(c, 0.0f), 1.0f) *
+                     255.0f);
+    };
+    return channel(color.r) | channel(color.g) << 8 | channel(color.b) << 16 |
+           channel(color.a) << 24;
+}
+
+Minimap::Minimap(omega::gfx::Shader *shader)
+    : pixels(columns * ring_rows, 0),
+      slot_row(ring_rows, -1),
+      row(columns, 0),
+      shader(shader) {
+    u32 id = 0;
+    glGenTextures(1, &id);
+    texture =
+        omega::gfx::texture::Texture::create_wrapper(id, columns, ring_rows);
+    texture->bind(0);
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 GL_RGBA8,
+                 columns,
+                 ring_rows,
+                 0,
+                 GL_RGBA,
+                 GL_UNSIGNED_BYTE,
+                 pixels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    // the strip wraps around the ring, so a single quad can show it
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+void Minimap::render(RenderBatch &batch,
+                     GapBuffer &text,
+                     const std::vector<Token> &tokens,
+                     const WrapLayout &wraps,
+                     const omega::scene::OrthographicCamera &camera,
+                     u32 first_row,
+                     u32 last_row,
+                     const omega::math::vec4 &background,
+                     u64 text_version) {
+    u32 row_count = wraps.row_count();
+    u32 view_rows = last_row - first_row + 1;
+    u32 shown = omega::math::min(ring_rows, row_count);
+    if (shown == 0) {
+        return;
+    }
+
+    // past the ring's size the strip scrolls along with the view like a
+    // scrollbar
+    u32 strip_first = 0;
+    if (row_count > shown && row_count > view_rows) {
+        f32 progress = (f32)first_row / (row_count - view_rows);
+        progress = omega::math::min(progress, 1.0f);
+        strip_first = (u32)(progress * (row_count - shown));
+    }
+    // a texel per row while they fit, squeezed to the view's height after
+    f32 row_height =
+        omega::math::min(texel_size, camera.get_height() / (f32)shown);
+
+    // after an edit every row is rebuilt, but only the ones that actually
+    // changed are uploaded
+    if (text_version != this->text_version) {
+        this->text_version = text_version;
+        std::fill(slot_row.begin(), slot_row.end(), -1);
+    }
+    i64 run_start = -1;
+    u32 run_length = 0;
+    for (u32 i = 0; i < shown; ++i) {
+        u32 visual_row = strip_first + i;
+        u32 slot = visual_row % ring_rows;
+        bool dirty = false;
+        if (slot_row[slot] != visual_row) {
+            slot_row[slot] = visual_row;
+            dirty = build_row(
+                slot, visual_row, text, tokens, wraps, background);
+        }
+        // uploads go in runs of consecutive rows
+        if (run_start != -1 && (!dirty || slot == 0)) {
+            upload(run_start, run_length);
+            run_start = -1;
+        }
+        if (dirty) {
+            if (run_start == -1) {
+                run_start = slot;
+                run_length = 0;
+            }
+            run_length++;
+        }
+    }
+    if (run_start != -1) {
+        upload(run_start, run_length);
+    }
+
+    f32 width = columns * texel_size;
+    f32 left = camera.get_width() - width;
+    f32 top = camera.get_height();
+    f32 bottom = top - shown * row_height;
+    batch.image(RenderBatch::Layer::MINIMAP,
+                shader,
+                texture.get(),
+                {left, bottom, width, shown * row_height},
+                {0.0f,
+                 (f32)(strip_first % ring_rows) / ring_rows,
+                 1.0f,
+                 (f32)shown / ring_rows});
+
+    // highlight the rows on screen, at least a texel high
+    f32 view_top = top - ((f32)first_row - strip_first) * row_height;
+    f32 view_bottom =
+        view_top - omega::math::max(view_rows * row_height, texel_size);
+    view_top = omega::math::min(view_top, top);
+    view_bottom = omega::math::max(view_bottom, bottom);
+    if (view_top > view_bottom) {
+        batch.rect(RenderBatch::Layer::UI,
+                   {left, view_bottom, width, view_top - view_bottom},
+                   {1.0f, 1.0f, 1.0f, 0.15f});
+    }
+}
+
+bool Minimap::build_row(u32 slot,
+                        u32 visual_row,
+                        GapBuffer &text,
+                        const std::vector<Token> &tokens,
+                        const WrapLayout &wraps,
+                        const omega::math::vec4 &background) {
+    std::fill(row.begin(), row.end(), pack_color(background));
+    u32 row_start = wraps.row_start(visual_row);
+    u32 row_end = wraps.row_end(visual_row);
+    for (u32 t = BufferRenderer::first_token(tokens, text, row_start);
+         t < tokens.size();
+         ++t) {
+        const Token &token = tokens[t];
+        u32 idx = text.get_index_from_pointer(token.text);
+        // a token running into the row is drawn from the row's start
+        u32 begin = idx < row_start ? row_start : idx;
+        if (begin >= row_end || begin - row_start >= columns) {
+            break;
+        }
+        u32 token_end = omega::math::min((u32)(idx + token.len), row_end);
+        if (token_end <= begin) {
+            continue;
+        }
+        // one texel per byte is close enough at this size
+        u32 end = omega::math::min(token_end - row_start, columns);
+        auto color = BufferRenderer::token_color(token.type,
+                                                 {0.8f, 0.8f, 0.8f, 1.0f});
+        std::fill(row.begin() + (begin - row_start),
+                  row.begin() + end,
+                  pack_color(color));
+    }
+
+    u32 *dest = &pixels[slot * columns];
+    if (std::memcmp(dest, row.data(), columns * sizeof(u32)) == 0) {
+        return false;
+    }
+    std::memcpy(dest, row.data(), columns * sizeof(u32));
+    return true;
+}
+
+void Minimap::upload(u32 first_slot, u32 count) {
+    texture->bind(0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D,
+                    0,
+                    0,
+                    first_slot,
+                    columns,
+                    count,
+                    GL_RGBA,
+                    GL_UNSIGNED_BYTE,
+                    &pixels[first_slot * columns]);
+}
@@ -0,0 +1,69 @@
+#ifndef SMED_MINIMAP_HPP
+#define SMED_MINIMAP_HPP
+
+#include <omega/gfx/shader.hpp>
+#include <omega/gfx/texture/texture.hpp>
+#include <omega/scene/orthographic_camera.hpp>
+#include <omega/util/std.hpp>
+#include <omega/util/types.hpp>
+#include <vector>
+
+#include "smed/gap_buffer.hpp"
+#include "smed/lexer.hpp"
+#include "smed/render_batch.hpp"
+#include "smed/wrap_layout.hpp"
+
+/**
+ * Overview strip along the right edge, one texel row per visual row colored
+ * by token type, so folded lines are left out and wrapped ones take a row
+ * per piece. Up to ring_rows rows it shows the whole document, squeezed to
+ * the view's height, longer ones scroll with the view. Rows live in a ring
+ * texture, so only rows scrolled in or changed by an edit are rebuilt and
+ * uploaded
+ * */
+class Minimap {
+  public:
+    Minimap(omega::gfx::Shader *shader);
+
+    /**
+     * Pushes the strip and the view indicator, [first_row, last_row] are
+     * the visual rows on screen
+     * */
+    void render(RenderBatch &batch,
+                GapBuffer &text,
+                const std::vector<Token> &tokens,
+                const WrapLayout &wraps,
+                const omega::scene::OrthographicCamera &camera,
+                u32 first_row,
+                u32 last_row,
+                const omega::math::vec4 &background,
+                u64 text_version);
+
+    f32 get_width() const {
+        return columns * texel_size;
+    }
+
+  private:
+    // returns whether the row's pixels changed
+    bool build_row(u32 slot,
+                   u32 visual_row,
+                   GapBuffer &text,
+                   const std::vector<Token> &tokens,
+                   const WrapLayout &wraps,
+                   const omega::math::vec4 &background);
+    void upload(u32 first_slot, u32 count);
+
+    static constexpr u32 columns = 128;   // texels per row
+    static constexpr u32 ring_rows = 1024; // rows shown at most
+    static constexpr f32 texel_size = 2.0f; // world units per texel, at most
+
+    std::vector<u32> pixels;   // RGBA shadow of the texture
+    std::vector<i64> slot_row; // visual row each ring row holds, -1 for none
+    std::vector<u32> row;       // scratch row
+    u64 text_version = 0;
+
+    omega::util::sptr<omega::gfx::texture::Texture> texture = nullptr;
+    omega::gfx::Shader *shader = nullptr;
+};
+
+#endif // SMED_MINIMAP_HPP
@@ -0,0 +1,219 @@
+#include "project_files.hpp"
+
+#include <fstream>
+
+bool IgnoreList::load(const std::filesystem::path &root,
+                      const std::string &dir) {
+    std::ifstream ifs(root / dir / ".gitignore");
+    if (!ifs) {
+        return false;
+    }
+    u32 count = rules.size();
+    std::string line;
+    while (std::getline(ifs, line)) {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        Rule rule;
+        rule.base = dir.empty() ? "" : dir + "/";
+        if (line[0] == '!') {
+            rule.negated = true;
+            line.erase(0, 1);
+        } else if (line[0] == '\\') {
+            line.erase(0, 1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            rule.dir_only = true;
+            line.pop_back();
+        }
+        // a slash anywhere but the end ties the pattern to this directory
+        rule.anchored = line.find('/') != std::string::npos;
+        if (!line.empty() && line[0] == '/') {
+            line.erase(0, 1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+        rule.pattern = line;
+        rules.push_back(std::move(rule));
+    }
+    return rules.size() > count;
+}
+
+bool IgnoreList::is_ignored(const std::string &path, bool is_dir) const {
+    size_t slash = path.find_last_of('/');
+    const char *name =
+        path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+    for (auto rule = rules.rbegin(); rule != rules.rend(); ++rule) {
+        if (rule->dir_only && !is_dir) {
+            continue;
+        }
+        const char *target = name;
+        if (rule->anchored) {
+            if (!path.starts_with(rule->base)) {
+                continue;
+            }
+            target = path.c_str() + rule->base.size();
+        }
+        if (glob_match(rule->pattern.c_str(), target)) {
+            return !rule->negated;
+        }
+    }
+    return false;
+}
+
+bool glob_match(const char *pattern, const char *path) {
+    const char *p = pattern, *s = path;
+    while (*p != '\0') {
+        if (p[0] == '*' && p[1] == '*') {
+            p += 2;
+            if (*p == '/') {
+                p++;
+            }
+            // any number of whole components, including none
+            for (const char *t = s;; ++t) {
+                if ((t == s || t[-1] == '/') && glob_match(p, t)) {
+                    return true;
+                }
+                if (*t == '\0') {
+                    return *p == '\0';
+                }
+            }
+        }
+        if (*p == '*') {
+            p++;
+            for (const char *t = s;; ++t) {
+                if (glob_match(p, t)) {
+                    return true;
+                }
+                if (*t == '\0' || *t == '/') {
+                    return false;
+                }
+            }
+        }
+        if (*s == '\0') {
+            return false;
+        }
+        if (*p == '?') {
+            if (*s == '/') {
+                return false;
+            }
+        } else if (*p == '[') {
+            const char *q = p + 1;
+            bool negated = *q == '!' || *q == '^';
+            if (negated) {
+                q++;
+            }
+            bool found = false;
+            for (bool first = true; *q != '\0' && (*q != ']' || first);
+                 first = false) {
+                if (q[1] == '-' && q[2] != '\0' && q[2] != ']') {
+                    found |= q[0] <= *s && *s <= q[2];
+                    q += 3;
+                } else {
+                    found |= *q == *s;
+                    q++;
+                }
+            }
+            if (*q == '\0' || found == negated) {
+                return false;
+            }
+            p = q;
+        } else {
+            if (*p == '\\' && p[1] != '\0') {
+                p++;
+            }
+            if (*p != *s) {
+                return false;
+            }
+        }
+        p++;
+        s++;
+    }
+    return *s == '\0';
+}
+
+void ProjectWalker::walk(ThreadPool &pool,
+                         const std::string &root,
+                         std::shared_ptr<std::atomic<bool>> cancelled,
+                         FileFn on_file,
+                         std::function<void()> on_done) {
+    auto walk = std::make_shared<Walk>();
+    walk->pool = &pool;
+    walk->root = root;
+    walk->cancelled = std::move(cancelled);
+    walk->on_file = std::move(on_file);
+    walk->on_done = std::move(on_done);
+    walk->pending = 1;
+    pool.submit([walk](u32) {
+        walk_directory(walk, "", std::make_shared<IgnoreList>());
+    });
+}
+
+void ProjectWalker::walk_directory(std::shared_ptr<Walk> walk,
+                                   std::string dir,
+                                   std::shared_ptr<const IgnoreList> ignore) {
+    namespace fs = std::filesystem;
+    if (*walk->cancelled) {
+        finish_job(*walk);
+        return;
+    }
+    // the list is only copied where a directory adds its own patterns
+    std::error_code ec, entry_ec;
+    if (fs::is_regular_file(walk->root / dir / ".gitignore", entry_ec)) {
+        auto own = std::make_shared<IgnoreList>(*ignore);
+        if (own->load(walk->root, dir)) {
+            ignore = own;
+        }
+    }
+
+    std::vector<std::string> files;
+    fs::directory_iterator it(
+        walk->root / dir, fs::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (name == ".git") {
+            continue;
+        }
+        std::string path = dir.empty() ? name : dir + "/" + name;
+        bool is_dir =
+            it->is_directory(entry_ec) && !it->is_symlink(entry_ec);
+        if (ignore->is_ignored(path, is_dir)) {
+            continue;
+        }
+        if (is_dir) {
+            walk->pending++;
+            walk->pool->submit([walk, path, ignore](u32) {
+                walk_directory(walk, path, ignore);
+            });
+        } else if (it->is_regular_file(entry_ec)) {
+            files.push_back((walk->root / path).string());
+        }
+    }
+
+    for (u32 i = 0; i < files.size(); i += batch_size) {
+        walk->pending++;
+        auto batch = std::make_shared<std::vector<std::string>>(
+            files.begin() + i,
+            files.begin() + std::min<size_t>(i + batch_size, files.size()));
+        walk->pool->submit([walk, batch](u32 worker) {
+            for (const std::string &file : *batch) {
+                if (*walk->cancelled) {
+                    break;
+                }
+                walk->on_file(worker, file);
+            }
+            finish_job(*walk);
+        });
+    }
+    finish_job(*walk);
+}
+
+void ProjectWalker::finish_job(Walk &walk) {
+    if (--walk.pending == 0 && walk.on_done) {
+        walk.on_done();
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef SMED_PROJECTFILES_HPP
+#define SMED_PROJECTFILES_HPP
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <omega/util/types.hpp>
+#include <string>
+#include <vector>
+
+#include "smed/thread_pool.hpp"
+
+/**
+ * The .gitignore patterns that apply to a directory, its own and those of
+ * the directories above it. Supports comments, !negation, trailing / for
+ * directories only, anchoring with a leading or inner /, and * ? [...] **
+ * */
+class IgnoreList {
+  public:
+    // adds the patterns of dir/.gitignore, dir relative to the project root
+    // as a generic path, "" for the root. Returns whether there were any
+    bool load(const std::filesystem::path &root, const std::string &dir);
+
+    // path relative to the project root, the last matching pattern wins
+    bool is_ignored(const std::string &path, bool is_dir) const;
+
+  private:
+    struct Rule {
+        std::string base; // directory of the .gitignore, "" or ending in /
+        std::string pattern;
+        bool negated = false;
+        bool dir_only = false;
+        bool anchored = false; // matched against the path, not the name
+    };
+    std::vector<Rule> rules;
+};
+
+// fnmatch style, * and ? stay within a path component and ** crosses them
+bool glob_match(const char *pattern, const char *path);
+
+/**
+ * Walks the files under a project root on a ThreadPool, every directory is
+ * a job of its own and the files it holds are handed out in batches, so the
+ * walk and whatever runs on the files spread over all workers. .git and the
+ * paths ignored by .gitignore files are skipped, symlinked directories
+ * aren't followed
+ * */
+class ProjectWalker {
+  public:
+    // gets the path under root and the worker running it
+    using FileFn = std::function<void(u32 worker, const std::string &path)>;
+
+    /**
+     * Returns right away. on_file runs on the workers, on_done on the worker
+     * that finished last, and setting cancelled makes the remaining jobs
+     * return without doing anything
+     * */
+    static void walk(ThreadPool &pool,
+                     const std::string &root,
+                     std::shared_ptr<std::atomic<bool>> cancelled,
+                     FileFn on_file,
+                     std::function<void()> on_done);
+
+  private:
+    struct Walk {
+        ThreadPool *pool;
+        std::filesystem::path root;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+        FileFn on_file;
+        std::function<void()> on_done;
+        std::atomic<u32> pending{0}; // jobs that haven't finished
+    };
+
+    static void walk_directory(std::shared_ptr<Walk> walk,
+                               std::string dir,
+                               std::shared_ptr<const IgnoreList> ignore);
+    static void finish_job(Walk &walk);
+
+    static constexpr u32 batch_size = 32; // files per job
+};
+
+#endif // SMED_PROJECTFILES_HPP
@@ -0,0 +1,221 @@
+#include "project_search.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <omega/math/math.hpp>
+#include <omega/util/log.hpp>
+
+#include "smed/mapped_file.hpp"
+
+ProjectSearch::ProjectSearch(ThreadPool &pool) : pool(pool) {
+    matchers.resize(pool.size());
+}
+
+void ProjectSearch::start(const std::string &root,
+                          const std::string &query,
+                          bool regex) {
+    cancel();
+    last_query = query;
+    last_regex = regex;
+    if (query.empty()) {
+        return;
+    }
+    current = std::make_shared<Search>();
+    current->id = ++next_id;
+    current->query = query;
+    current->regex = regex;
+    current->cancelled = std::make_shared<std::atomic<bool>>(false);
+    // the index as of the last update narrows the files down, and the files
+    // its update finds changed are searched as they're read
+    std::vector<std::string> literals;
+    if (!regex) {
+        literals.push_back(query);
+    } else {
+        Regex(query).required_literals(literals);
+    }
+    // the jobs hold on to the search, it outlives being replaced
+    std::shared_ptr<Search> search = current;
+    index.candidates(
+        root,
+        literals,
+        search->cancelled,
+        [this, search](u32 worker, const std::string &path) {
+            search_file(*search, worker, path);
+        },
+        [search]() { search->done = true; });
+}
+
+void ProjectSearch::cancel() {
+    if (current != nullptr) {
+        *current->cancelled = true;
+        current = nullptr;
+    }
+}
+
+void ProjectSearch::take_results(std::vector<Result> &out) {
+    if (current == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(current->mutex);
+    current->taken += current->results.size();
+    std::move(current->results.begin(),
+              current->results.end(),
+              std::back_inserter(out));
+    current->results.clear();
+}
+
+void ProjectSearch::search_file(Search &search,
+                                u32 worker,
+                                const std::string &path) {
+    MappedFile file(path);
+    if (!file.is_open() || file.size() == 0 || file.size() > UINT32_MAX) {
+        return;
+    }
+    // binary files have a NUL byte early on
+    const char *data = file.data();
+    u32 size = file.size();
+    if (std::memchr(data, '\0', omega::math::min(size, binary_probe))) {
+        return;
+    }
+
+    auto &[id, matcher] = matchers[worker];
+    if (id != search.id) {
+        id = search.id;
+        matcher = omega::util::create_uptr<Replacer>(
+            search.query, "", search.regex);
+    }
+    if (!matcher->is_valid()) {
+        return;
+    }
+
+    std::vector<Result> found;
+    TextSegments text(data, size);
+    Replacer::Match match;
+    u32 line = 0, line_start = 0, counted = 0; // lines counted up to counted
+    for (u32 from = 0; from <= size && found.size() < max_file_results &&
+                       !*search.cancelled;
+         from = match.end) {
+        if (!matcher->find(text, from, match)) {
+            break;
+        }
+        while (const char *nl = (const char *)std::memchr(
+                   data + counted, '\n', match.begin - counted)) {
+            line++;
+            counted = line_start = nl - data + 1;
+        }
+        counted = match.begin;
+        const char *line_end = (const char *)std::memchr(
+            data + line_start, '\n', size - line_start);
+        u32 preview_end = line_end == nullptr ? size : line_end - data;
+        preview_end = omega::math::min(preview_end, line_start + max_preview);
+        found.push_back({path,
+                         line,
+                         match.begin,
+                         match.end,
+                         match.begin - line_start,
+                         std::string(data + line_start,
+                                     preview_end - line_start)});
+    }
+    if (found.empty() || *search.cancelled) {
+        return;
+    }
+    // the hits past a file's cap aren't shown, but replacing would rewrite
+    // them too
+    if (found.size() == max_file_results &&
+        matcher->find(text, match.end, match)) {
+        search.truncated = true;
+    }
+
+    // past the cap the search stops, the results so far stay
+    if ((search.result_count += found.size()) >= max_results) {
+        search.truncated = true;
+        *search.cancelled = true;
+    }
+    std::lock_guard<std::mutex> lock(search.mutex);
+    std::move(found.begin(), found.end(), std::back_inserter(search.results));
+}
+
+void ProjectSearch::replace_files(const std::vector<std::string> &paths,
+                                  const std::string &replacement) {
+    if (is_replacing() || paths.empty() || last_query.empty()) {
+        return;
+    }
+    replacing = std::make_shared<Replace>();
+    replacing->query = last_query;
+    replacing->replacement = replacement;
+    replacing->regex = last_regex;
+    replacing->paths = paths;
+    // every job takes the next file until none are left
+    u32 jobs = omega::math::min(pool.size(), (u32)paths.size());
+    replacing->pending = jobs;
+    std::shared_ptr<Replace> replace = replacing;
+    for (u32 i = 0; i < jobs; ++i) {
+        pool.submit([replace](u32) {
+            Replacer replacer(
+                replace->query, replace->replacement, replace->regex);
+            for (u32 i = replace->next++; i < replace->paths.size();
+                 i = replace->next++) {
+                replace_file(*replace, replacer, replace->paths[i]);
+            }
+            if (--replace->pending == 0) {
+                replace->done = true;
+            }
+        });
+    }
+}
+
+ProjectSearch::ReplaceReport ProjectSearch::get_replace_report() const {
+    if (replacing == nullptr) {
+        return {};
+    }
+    return {replacing->files, replacing->replaced, replacing->failed};
+}
+
+void ProjectSearch::replace_file(Replace &replace,
+                                 Replacer &replacer,
+                                 const std::string &path) {
+    namespace fs = std::filesystem;
+    // a symlink is replaced through, not by a regular file
+    std::error_code error;
+    fs::path target = fs::canonical(path, error);
+    MappedFile file(target.string());
+    if (error || !file.is_open() || file.size() > UINT32_MAX ||
+        !replacer.is_valid()) {
+        replace.failed++;
+        return;
+    }
+    const char *data = file.data();
+    u32 size = file.size();
+    std::string out;
+    u32 first, last;
+    u32 count =
+        replacer.replace_all(TextSegments(data, size), out, first, last);
+    if (count == 0) {
+        return;
+    }
+
+    // write to a temporary first, so a partial file never replaces it
+    fs::path tmp = target;
+    tmp += ".smed-replace";
+    std::ofstream of(tmp, std::ios::binary);
+    of.write(data, first);
+    of.write(out.data(), out.size());
+    of.write(data + last, size - last);
+    of.close();
+    std::error_code ignored;
+    fs::permissions(tmp, fs::status(target, ignored).permissions(), ignored);
+    if (!of.fail()) {
+        fs::rename(tmp, target, error);
+    }
+    if (of.fail() || error) {
+        OMEGA_WARN("Failed to replace in '{}'", path);
+        fs::remove(tmp, ignored);
+        replace.failed++;
+        return;
+    }
+    replace.files++;
+    replace.replaced += count;
+}
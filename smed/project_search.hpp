@@ -0,0 +1,141 @@
+#ifndef SMED_PROJECTSEARCH_HPP
+#define SMED_PROJECTSEARCH_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <omega/util/std.hpp>
+#include <omega/util/types.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "smed/project_files.hpp"
+#include "smed/replacer.hpp"
+#include "smed/thread_pool.hpp"
+#include "smed/trigram_index.hpp"
+
+/**
+ * Searches every file under the project root in the background. Files are
+ * memory mapped and scanned with the same matcher as replacing, literal or
+ * regex, and results stream in as each file finishes. Starting a new search
+ * cancels the running one, its queued jobs return without touching a file.
+ * Only the files the trigram index can't rule out for the query's literals
+ * are visited, the project isn't walked for every search
+ * */
+class ProjectSearch {
+  public:
+    struct Result {
+        std::string path;
+        u32 line; // 0 based
+        u32 begin, end; // byte offsets of the match in the file
+        u32 column;     // of begin in the line
+        std::string preview; // the start of the matching line
+    };
+    struct ReplaceReport {
+        u32 files = 0;    // rewritten
+        u32 replaced = 0; // matches
+        u32 failed = 0;   // files that couldn't be read or written
+    };
+
+    /**
+     * The jobs run on pool, which can be shared. Their owner has to cancel
+     * and drain it before the search goes away, the jobs reference it
+     * */
+    ProjectSearch(ThreadPool &pool);
+    ~ProjectSearch() {
+        cancel();
+        cancel_index();
+    }
+
+    // cancels the running search and starts searching root for query
+    void start(const std::string &root, const std::string &query, bool regex);
+    void cancel();
+    void cancel_index() {
+        index.cancel();
+    }
+    // brings the trigram index of root up to date in the background
+    void refresh_index(const std::string &root) {
+        index.update(root);
+    }
+    bool is_indexing() const {
+        return index.is_updating();
+    }
+
+    /**
+     * Rewrites the files in paths in the background, with every match of
+     * the last search's query replaced. Each file is written to a temporary
+     * next to it that is then renamed over it, so a file is either replaced
+     * whole or left as it was
+     * */
+    void replace_files(const std::vector<std::string> &paths,
+                       const std::string &replacement);
+    bool is_replacing() const {
+        return replacing != nullptr && !replacing->done;
+    }
+    // what the last replace_files did, complete once is_replacing is false
+    ReplaceReport get_replace_report() const;
+    // moves the results found since the last call to the back of out
+    void take_results(std::vector<Result> &out);
+    // true until the walk is done and every result was taken
+    bool is_running() const {
+        return current != nullptr &&
+               (!current->done || current->taken < current->result_count);
+    }
+    /**
+     * Not every hit is in the results: the search stopped at max_results,
+     * or a file had more than max_file_results
+     * */
+    bool is_truncated() const {
+        return current != nullptr && current->truncated;
+    }
+
+  private:
+    struct Search {
+        u64 id;
+        std::string query;
+        bool regex;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+        std::atomic<bool> done{false};
+        std::atomic<bool> truncated{false};
+        std::atomic<u32> result_count{0};
+        u32 taken = 0; // by take_results
+        std::mutex mutex;
+        std::vector<Result> results; // not taken yet
+    };
+
+    struct Replace {
+        std::string query, replacement;
+        bool regex;
+        std::vector<std::string> paths;
+        std::atomic<u32> next{0}; // path handed out next
+        std::atomic<u32> pending{0}; // jobs that haven't finished
+        std::atomic<u32> files{0}, replaced{0}, failed{0};
+        std::atomic<bool> done{false};
+    };
+
+    void search_file(Search &search, u32 worker, const std::string &path);
+    static void replace_file(Replace &replace,
+                             Replacer &replacer,
+                             const std::string &path);
+
+    static constexpr u32 max_results = 100000;
+    static constexpr u32 max_file_results = 1000;
+    static constexpr u32 max_preview = 200;
+    static constexpr u32 binary_probe = 8192; // bytes checked for a NUL
+
+    std::shared_ptr<Search> current = nullptr;
+    std::shared_ptr<Replace> replacing = nullptr;
+    // the query of the last search, replace_files uses it
+    std::string last_query;
+    bool last_regex = false;
+    u64 next_id = 0;
+    // the matcher of each worker and the id of the search it was made for,
+    // only touched by that worker
+    std::vector<std::pair<u64, omega::util::uptr<Replacer>>> matchers;
+    ThreadPool &pool;
+    // runs on pool, which it only uses once updating
+    TrigramIndex index{pool};
+};
+
+#endif // SMED_PROJECTSEARCH_HPP
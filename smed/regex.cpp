@@ -0,0 +1,892 @@
+#include "regex.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+Regex::Regex(const std::string &pattern, u32 memory_cap)
+    : pattern(pattern),
+      forward_dfa(&forward, false, false, memory_cap),
+      reverse_dfa(&reverse, true, true, memory_cap) {
+    root = parse_alternate();
+    if (error.empty() && pos < this->pattern.size()) {
+        error = "unmatched )";
+    }
+    if (!error.empty()) {
+        return;
+    }
+    compile(forward, false);
+    compile(reverse, true);
+    if (!error.empty()) {
+        return;
+    }
+    find_literal_prefix();
+}
+
+bool Regex::search(const TextSegments &text, u32 start, Match &match) {
+    u32 length = text.length();
+    if (!is_valid() || start > length) {
+        return false;
+    }
+
+    // forwards to the end of the leftmost-first match
+    i32 s = forward_dfa.start(start == 0 || text.at(start - 1) == '\n');
+    i64 end = -1;
+    bool dead = false;
+    u32 i = start;
+    for (u32 seg = 0; seg < 2 && !dead; ++seg) {
+        u32 seg_begin = seg == 0 ? 0 : text.size[0];
+        u32 seg_end = seg_begin + text.size[seg];
+        const u8 *data = (const u8 *)text.data[seg];
+        while (i < seg_end) {
+            // nothing started yet, skip to the next byte a match can start
+            // with
+            if (!prefix.empty() && forward_dfa.is_start(s)) {
+                const void *found =
+                    memchr(data + (i - seg_begin), prefix[0], seg_end - i);
+                u32 skip_to = found == nullptr
+                                  ? seg_end
+                                  : seg_begin + ((const u8 *)found - data);
+                if (skip_to != i) {
+                    i = skip_to;
+                    s = forward_dfa.start(text.at(i - 1) == '\n');
+                    if (i == seg_end) {
+                        break;
+                    }
+                }
+            }
+            s = forward_dfa.next(s, data[i - seg_begin]);
+            if (forward_dfa.is_match(s)) {
+                end = i;
+            }
+            if (forward_dfa.is_dead(s)) {
+                dead = true;
+                break;
+            }
+            i++;
+        }
+    }
+    if (!dead) {
+        s = forward_dfa.next(s, Dfa::end_of_text);
+        if (forward_dfa.is_match(s)) {
+            end = length;
+        }
+    }
+    if (end == -1) {
+        return false;
+    }
+
+    // backwards from the end to the longest match of the reversed pattern
+    i32 r = reverse_dfa.start(end == length || text.at(end) == '\n');
+    i64 begin = end;
+    dead = false;
+    for (u32 k = end; k > start; --k) {
+        r = reverse_dfa.next(r, text.at(k - 1));
+        if (reverse_dfa.is_match(r)) {
+            begin = k;
+        }
+        if (reverse_dfa.is_dead(r)) {
+            dead = true;
+            break;
+        }
+    }
+    if (!dead) {
+        r = reverse_dfa.next(
+            r, start == 0 ? Dfa::end_of_text : text.at(start - 1));
+        if (reverse_dfa.is_match(r)) {
+            begin = start;
+        }
+    }
+    match = {(u32)begin, (u32)end};
+    return true;
+}
+
+void Regex::captures(const TextSegments &text,
+                     const Match &match,
+                     std::vector<Match> &groups) {
+    // Pike VM over just the match, it ends at match.end because threads
+    // with a higher priority than the one ending there never match
+    u32 slots = 2 * (this->groups + 1);
+    Threads *list = &threads[0], *next = &threads[1];
+    list->pcs.clear();
+    list->caps.clear();
+    visited.resize(forward.insts.size(), 0);
+    generation++;
+    caps.assign(slots, -1);
+    best.clear();
+
+    add_thread(text, *list, forward.anchored, match.begin, caps.data());
+    for (u32 pos = match.begin; !list->pcs.empty(); ++pos) {
+        next->pcs.clear();
+        next->caps.clear();
+        generation++;
+        for (u32 t = 0; t < list->pcs.size(); ++t) {
+            const Inst &inst = forward.insts[list->pcs[t]];
+            i64 *thread_caps = list->caps.data() + t * slots;
+            if (inst.op == Op::MATCH) {
+                // lower priority threads are cut off
+                best.assign(thread_caps, thread_caps + slots);
+                break;
+            }
+            u8 c = pos < match.end ? text.at(pos) : 0;
+            if (pos < match.end && inst.lo <= c && c <= inst.hi) {
+                add_thread(text, *next, inst.x, pos + 1, thread_caps);
+            }
+        }
+        std::swap(list, next);
+        if (pos == match.end) {
+            break;
+        }
+    }
+
+    groups.assign(this->groups + 1, {0, 0});
+    groups[0] = match;
+    for (u32 g = 1; g <= this->groups && !best.empty(); ++g) {
+        if (best[2 * g] != -1 && best[2 * g + 1] != -1) {
+            groups[g] = {(u32)best[2 * g], (u32)best[2 * g + 1]};
+        }
+    }
+}
+
+void Regex::add_thread(const TextSegments &text,
+                       Threads &list,
+                       u32 pc,
+                       u32 pos,
+                       i64 *caps) {
+    if (visited[pc] == generation) {
+        return;
+    }
+    visited[pc] = generation;
+    const Inst &inst = forward.insts[pc];
+    switch (inst.op) {
+        case Op::JMP:
+            add_thread(text, list, inst.x, pos, caps);
+            break;
+        case Op::SPLIT:
+            add_thread(text, list, inst.x, pos, caps);
+            add_thread(text, list, inst.y, pos, caps);
+            break;
+        case Op::SAVE: {
+            i64 old = caps[inst.y];
+            caps[inst.y] = pos;
+            add_thread(text, list, inst.x, pos, caps);
+            caps[inst.y] = old;
+            break;
+        }
+        case Op::LINE_START:
+            if (pos == 0 || text.at(pos - 1) == '\n') {
+                add_thread(text, list, inst.x, pos, caps);
+            }
+            break;
+        case Op::LINE_END:
+            if (pos == text.length() || text.at(pos) == '\n') {
+                add_thread(text, list, inst.x, pos, caps);
+            }
+            break;
+        case Op::RANGE:
+        case Op::MATCH:
+            list.pcs.push_back(pc);
+            list.caps.insert(list.caps.end(), caps, caps + 2 * (groups + 1));
+            break;
+    }
+}
+
+void Regex::required_literals(std::vector<std::string> &out) const {
+    if (!is_valid()) {
+        return;
+    }
+    u32 index = root;
+    while (nodes[index].type == Node::Type::CAPTURE) {
+        index = nodes[index].children[0];
+    }
+    const Node &node = nodes[index];
+    std::vector<u32> children =
+        node.type == Node::Type::CONCAT ? node.children
+                                        : std::vector<u32>{index};
+    // runs of single bytes in the top level sequence
+    std::string run;
+    for (u32 child : children) {
+        const Node &c = nodes[child];
+        if (c.type == Node::Type::BYTES && c.ranges.size() == 1 &&
+            c.ranges[0].first == c.ranges[0].second) {
+            run += (char)c.ranges[0].first;
+            continue;
+        }
+        // anchors match no bytes, they don't break a run
+        if (c.type == Node::Type::LINE_START ||
+            c.type == Node::Type::LINE_END) {
+            continue;
+        }
+        if (!run.empty()) {
+            out.push_back(std::move(run));
+            run.clear();
+        }
+    }
+    if (!run.empty()) {
+        out.push_back(std::move(run));
+    }
+}
+
+// parser
+
+u32 Regex::parse_alternate() {
+    u32 first = parse_concat();
+    if (pos >= pattern.size() || pattern[pos] != '|') {
+        return first;
+    }
+    Node node;
+    node.type = Node::Type::ALTERNATE;
+    node.children.push_back(first);
+    while (error.empty() && pos < pattern.size() && pattern[pos] == '|') {
+        pos++;
+        node.children.push_back(parse_concat());
+    }
+    return add_node(std::move(node));
+}
+
+u32 Regex::parse_concat() {
+    Node node;
+    node.type = Node::Type::CONCAT;
+    while (error.empty() && pos < pattern.size() && pattern[pos] != '|' &&
+           pattern[pos] != ')') {
+        node.children.push_back(parse_repeat());
+    }
+    if (node.children.size() == 1) {
+        return node.children[0];
+    }
+    if (node.children.empty()) {
+        return add_node({});
+    }
+    return add_node(std::move(node));
+}
+
+u32 Regex::parse_repeat() {
+    u32 atom = parse_atom();
+    while (error.empty() && pos < pattern.size()) {
+        Node node;
+        node.type = Node::Type::REPEAT;
+        char c = pattern[pos];
+        if (c == '*') {
+            node.min = 0, node.max = -1;
+        } else if (c == '+') {
+            node.min = 1, node.max = -1;
+        } else if (c == '?') {
+            node.min = 0, node.max = 1;
+        } else if (c == '{') {
+            // {m}, {m,} or {m,n}
+            u32 p = pos + 1;
+            const auto number = [&](i32 &out) {
+                u32 begin = p;
+                out = 0;
+                while (p < pattern.size() && std::isdigit(pattern[p]) &&
+                       out <= max_repeat) {
+                    out = out * 10 + (pattern[p++] - '0');
+                }
+                return p > begin;
+            };
+            if (!number(node.min)) {
+                error = "invalid repetition";
+                break;
+            }
+            node.max = node.min;
+            if (p < pattern.size() && pattern[p] == ',') {
+                p++;
+                node.max = -1;
+                if (p < pattern.size() && pattern[p] != '}' &&
+                    !number(node.max)) {
+                    error = "invalid repetition";
+                    break;
+                }
+            }
+            if (p >= pattern.size() || pattern[p] != '}') {
+                error = "invalid repetition";
+                break;
+            }
+            if (node.min > max_repeat || node.max > max_repeat ||
+                (node.max != -1 && node.max < node.min)) {
+                error = "invalid repetition";
+                break;
+            }
+            pos = p;
+        } else {
+            break;
+        }
+        pos++;
+        if (pos < pattern.size() && pattern[pos] == '?') {
+            node.greedy = false;
+            pos++;
+        }
+        node.children.push_back(atom);
+        atom = add_node(std::move(node));
+    }
+    return atom;
+}
+
+u32 Regex::parse_atom() {
+    char c = pattern[pos];
+    switch (c) {
+        case '(': {
+            if (++depth > max_depth) {
+                error = "too many nested groups";
+                return 0;
+            }
+            pos++;
+            Node node;
+            node.type = Node::Type::CAPTURE;
+            if (pattern.compare(pos, 2, "?:") == 0) {
+                pos += 2;
+            } else {
+                node.group = ++groups;
+            }
+            u32 child = parse_alternate();
+            if (!error.empty()) {
+                return 0;
+            }
+            if (pos >= pattern.size() || pattern[pos] != ')') {
+                error = "missing )";
+                return 0;
+            }
+            pos++;
+            depth--;
+            if (node.group == 0) {
+                return child;
+            }
+            node.children.push_back(child);
+            return add_node(std::move(node));
+        }
+        case '[':
+            return parse_class();
+        case '.':
+            pos++;
+            return add_any_char();
+        case '^':
+        case '$': {
+            pos++;
+            Node node;
+            node.type =
+                c == '^' ? Node::Type::LINE_START : Node::Type::LINE_END;
+            return add_node(std::move(node));
+        }
+        case '\\':
+            return parse_escape();
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+            error = "nothing to repeat";
+            return 0;
+        default:
+            pos++;
+            return add_bytes({{(u8)c, (u8)c}});
+    }
+}
+
+// ranges of \d \w \s, or none for other escapes
+static std::vector<std::pair<u8, u8>> class_escape(char c) {
+    switch (std::tolower(c)) {
+        case 'd':
+            return {{'0', '9'}};
+        case 'w':
+            return {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}};
+        case 's':
+            return {{'\t', '\r'}, {' ', ' '}};
+        default:
+            return {};
+    }
+}
+
+// byte of a single character escape, -1 for an invalid escape
+static i32 char_escape(const std::string &pattern, u32 &pos) {
+    char c = pattern[pos++];
+    switch (c) {
+        case 'n':
+            return '\n';
+        case 't':
+            return '\t';
+        case 'r':
+            return '\r';
+        case 'f':
+            return '\f';
+        case 'v':
+            return '\v';
+        case '0':
+            return '\0';
+        case 'x': {
+            if (pos + 2 > pattern.size() || !std::isxdigit(pattern[pos]) ||
+                !std::isxdigit(pattern[pos + 1])) {
+                return -1;
+            }
+            i32 byte = std::stoi(pattern.substr(pos, 2), nullptr, 16);
+            pos += 2;
+            return byte;
+        }
+        default:
+            // letters and digits are reserved for escapes
+            return std::isalnum(c) ? -1 : (u8)c;
+    }
+}
+
+u32 Regex::parse_escape() {
+    pos++;
+    if (pos >= pattern.size()) {
+        error = "trailing \\";
+        return 0;
+    }
+    char c = pattern[pos];
+    std::vector<std::pair<u8, u8>> ranges = class_escape(c);
+    if (!ranges.empty()) {
+        pos++;
+        return std::isupper(c) ? add_negated(ranges) : add_bytes(ranges);
+    }
+    i32 byte = char_escape(pattern, pos);
+    if (byte == -1) {
+        error = "invalid escape";
+        return 0;
+    }
+    return add_bytes({{(u8)byte, (u8)byte}});
+}
+
+u32 Regex::parse_class() {
+    pos++;
+    bool negated = pos < pattern.size() && pattern[pos] == '^';
+    if (negated) {
+        pos++;
+    }
+    std::vector<std::pair<u8, u8>> ranges;
+    bool first = true;
+    while (pos < pattern.size() && (pattern[pos] != ']' || first)) {
+        first = false;
+        // one byte, or the ranges of a class escape
+        const auto item = [&](i32 &byte) {
+            byte = (u8)pattern[pos];
+            if (byte != '\\') {
+                pos++;
+                return true;
+            }
+            if (++pos >= pattern.size()) {
+                error = "trailing \\";
+                return false;
+            }
+            std::vector<std::pair<u8, u8>> escape = class_escape(pattern[pos]);
+            if (!escape.empty()) {
+                if (std::isupper(pattern[pos])) {
+                    error = "negated escape in class";
+                    return false;
+                }
+                pos++;
+                ranges.insert(ranges.end(), escape.begin(), escape.end());
+                byte = -1;
+                return true;
+            }
+            byte = char_escape(pattern, pos);
+            if (byte == -1) {
+                error = "invalid escape";
+                return false;
+            }
+            return true;
+        };
+        i32 lo, hi;
+        if (!item(lo)) {
+            return 0;
+        }
+        if (lo == -1) {
+            continue;
+        }
+        hi = lo;
+        if (pos + 1 < pattern.size() && pattern[pos] == '-' &&
+            pattern[pos + 1] != ']') {
+            pos++;
+            if (!item(hi)) {
+                return 0;
+            }
+            if (hi == -1 || hi < lo) {
+                error = "invalid class range";
+                return 0;
+            }
+        }
+        if (hi >= 0x80) {
+            error = "classes are ASCII only";
+            return 0;
+        }
+        ranges.push_back({(u8)lo, (u8)hi});
+    }
+    if (pos >= pattern.size()) {
+        error = "missing ]";
+        return 0;
+    }
+    pos++;
+    return negated ? add_negated(ranges) : add_bytes(ranges);
+}
+
+u32 Regex::add_node(Node node) {
+    nodes.push_back(std::move(node));
+    return nodes.size() - 1;
+}
+
+u32 Regex::add_bytes(std::vector<std::pair<u8, u8>> ranges) {
+    Node node;
+    node.type = Node::Type::BYTES;
+    node.ranges = std::move(ranges);
+    return add_node(std::move(node));
+}
+
+u32 Regex::add_negated(const std::vector<std::pair<u8, u8>> &ascii) {
+    bool in[128] = {};
+    for (const auto &[lo, hi] : ascii) {
+        for (u32 c = lo; c <= hi && c < 128; ++c) {
+            in[c] = true;
+        }
+    }
+    std::vector<std::pair<u8, u8>> ranges;
+    for (u32 c = 0; c < 128; ++c) {
+        if (in[c]) {
+            continue;
+        }
+        if (!ranges.empty() && ranges.back().second == c - 1) {
+            ranges.back().second = c;
+        } else {
+            ranges.push_back({(u8)c, (u8)c});
+        }
+    }
+
+    // lead byte followed by its continuation bytes
+    Node alternate;
+    alternate.type = Node::Type::ALTERNATE;
+    if (!ranges.empty()) {
+        alternate.children.push_back(add_bytes(ranges));
+    }
+    const std::pair<u8, u8> leads[] = {
+        {0xc2, 0xdf}, {0xe0, 0xef}, {0xf0, 0xf4}};
+    for (u32 i = 0; i < 3; ++i) {
+        Node sequence;
+        sequence.type = Node::Type::CONCAT;
+        sequence.children.push_back(add_bytes({leads[i]}));
+        for (u32 j = 0; j <= i; ++j) {
+            sequence.children.push_back(add_bytes({{0x80, 0xbf}}));
+        }
+        alternate.children.push_back(add_node(std::move(sequence)));
+    }
+    return add_node(std::move(alternate));
+}
+
+u32 Regex::add_any_char() {
+    return add_negated({{'\n', '\n'}});
+}
+
+// compiler
+
+void Regex::compile(Program &program, bool reverse) {
+    program.insts.clear();
+    program.anchored = 0;
+    if (!reverse) {
+        add_inst(program, {Op::SAVE, 0, 0, 1, 0});
+    }
+    emit(program, root, reverse);
+    if (!reverse) {
+        u32 pc = program.insts.size();
+        add_inst(program, {Op::SAVE, 0, 0, pc + 1, 1});
+    }
+    add_inst(program, {Op::MATCH});
+
+    // prefer starting the pattern here over skipping a byte
+    u32 loop = program.insts.size();
+    add_inst(program, {Op::SPLIT, 0, 0, program.anchored, loop + 1});
+    add_inst(program, {Op::RANGE, 0, 0xff, loop});
+    program.unanchored = loop;
+}
+
+void Regex::emit(Program &program, u32 index, bool reverse) {
+    if (!error.empty()) {
+        return;
+    }
+    const auto size = [&]() { return (u32)program.insts.size(); };
+    // copied, emitting children can grow nodes
+    const Node node = nodes[index];
+    switch (node.type) {
+        case Node::Type::EMPTY:
+            break;
+        case Node::Type::BYTES: {
+            // one split per extra range, all ranges go to the same place
+            std::vector<u32> ranges;
+            for (u32 i = 0; i < node.ranges.size(); ++i) {
+                u32 split = 0;
+                bool last = i + 1 == node.ranges.size();
+                if (!last) {
+                    split = add_inst(program, {Op::SPLIT, 0, 0, size() + 1});
+                }
+                ranges.push_back(add_inst(program,
+                                          {Op::RANGE,
+                                           node.ranges[i].first,
+                                           node.ranges[i].second}));
+                if (!last) {
+                    program.insts[split].y = size();
+                }
+            }
+            for (u32 pc : ranges) {
+                program.insts[pc].x = size();
+            }
+            break;
+        }
+        case Node::Type::CONCAT:
+            if (reverse) {
+                for (auto it = node.children.rbegin();
+                     it != node.children.rend();
+                     ++it) {
+                    emit(program, *it, reverse);
+                }
+            } else {
+                for (u32 child : node.children) {
+                    emit(program, child, reverse);
+                }
+            }
+            break;
+        case Node::Type::ALTERNATE: {
+            std::vector<u32> jumps;
+            for (u32 i = 0; i + 1 < node.children.size(); ++i) {
+                u32 split = add_inst(program, {Op::SPLIT, 0, 0, size() + 1});
+                emit(program, node.children[i], reverse);
+                jumps.push_back(add_inst(program, {Op::JMP}));
+                program.insts[split].y = size();
+            }
+            emit(program, node.children.back(), reverse);
+            for (u32 pc : jumps) {
+                program.insts[pc].x = size();
+            }
+            break;
+        }
+        case Node::Type::REPEAT: {
+            for (i32 i = 0; i < node.min; ++i) {
+                emit(program, node.children[0], reverse);
+            }
+            // the split's preferred branch enters the body when greedy
+            const auto branch = [&](u32 split, u32 body, u32 out) {
+                Inst &inst = program.insts[split];
+                inst.x = node.greedy ? body : out;
+                inst.y = node.greedy ? out : body;
+            };
+            if (node.max == -1) {
+                u32 split = add_inst(program, {Op::SPLIT});
+                emit(program, node.children[0], reverse);
+                add_inst(program, {Op::JMP, 0, 0, split});
+                branch(split, split + 1, size());
+                break;
+            }
+            std::vector<u32> splits;
+            for (i32 i = node.min; i < node.max; ++i) {
+                splits.push_back(add_inst(program, {Op::SPLIT}));
+                emit(program, node.children[0], reverse);
+            }
+            for (u32 split : splits) {
+                branch(split, split + 1, size());
+            }
+            break;
+        }
+        case Node::Type::CAPTURE:
+            add_inst(program, {Op::SAVE, 0, 0, size() + 1, 2 * node.group});
+            emit(program, node.children[0], reverse);
+            add_inst(program,
+                     {Op::SAVE, 0, 0, size() + 1, 2 * node.group + 1});
+            break;
+        case Node::Type::LINE_START:
+        case Node::Type::LINE_END: {
+            // a reversed pattern sees the text backwards
+            bool start = (node.type == Node::Type::LINE_START) != reverse;
+            add_inst(program,
+                     {start ? Op::LINE_START : Op::LINE_END, 0, 0, size() + 1});
+            break;
+        }
+    }
+}
+
+u32 Regex::add_inst(Program &program, Inst inst) {
+    if (program.insts.size() >= max_insts) {
+        error = "pattern too large";
+        // keeps the patching in emit in bounds until it unwinds
+        return program.insts.size() - 1;
+    }
+    if (inst.op == Op::RANGE && inst.x == 0) {
+        inst.x = program.insts.size() + 1;
+    }
+    program.insts.push_back(inst);
+    return program.insts.size() - 1;
+}
+
+void Regex::find_literal_prefix() {
+    u32 index = root;
+    while (nodes[index].type == Node::Type::CAPTURE ||
+           (nodes[index].type == Node::Type::CONCAT &&
+            !nodes[index].children.empty())) {
+        const Node &node = nodes[index];
+        if (node.type == Node::Type::CAPTURE) {
+            index = node.children[0];
+            continue;
+        }
+        for (u32 child : node.children) {
+            const Node &c = nodes[child];
+            if (c.type != Node::Type::BYTES || c.ranges.size() != 1 ||
+                c.ranges[0].first != c.ranges[0].second) {
+                break;
+            }
+            prefix += (char)c.ranges[0].first;
+        }
+        if (prefix.empty() &&
+            nodes[node.children[0]].type != Node::Type::BYTES) {
+            index = node.children[0];
+            continue;
+        }
+        return;
+    }
+    const Node &node = nodes[index];
+    if (node.type == Node::Type::BYTES && node.ranges.size() == 1 &&
+        node.ranges[0].first == node.ranges[0].second) {
+        prefix += (char)node.ranges[0].first;
+    }
+}
+
+// DFA
+
+i32 Regex::Dfa::start(bool after_newline) {
+    i32 &s = starts[after_newline];
+    if (s == -1) {
+        next_pcs.assign(1, anchored ? program->anchored : program->unanchored);
+        // a flush inside find_or_add resets the starts
+        i32 state = find_or_add(next_pcs, after_newline, false);
+        starts[after_newline] = state;
+    }
+    return starts[after_newline];
+}
+
+i32 Regex::Dfa::compute(i32 state, u32 c) {
+    const std::vector<Inst> &insts = program->insts;
+    // copied, adding states can move them
+    list = states[state].insts;
+    bool after_newline = states[state].after_newline;
+    bool at_line_end = c == '\n' || c == end_of_text;
+    bool matched = false;
+
+    visited.resize(insts.size(), 0);
+    generation++;
+    next_pcs.clear();
+    for (u32 pc : list) {
+        expanded.clear();
+        if (insts[pc].op == Op::LINE_END) {
+            if (!at_line_end) {
+                continue;
+            }
+            closure(insts[pc].x, after_newline, true, expanded);
+        } else {
+            expanded.push_back(pc);
+        }
+        bool cut = false;
+        for (u32 p : expanded) {
+            const Inst &inst = insts[p];
+            if (inst.op == Op::MATCH) {
+                matched = true;
+                // leftmost-first drops the lower priority threads
+                if (!longest) {
+                    cut = true;
+                    break;
+                }
+            } else if (inst.op == Op::RANGE && c != end_of_text &&
+                       inst.lo <= c && c <= inst.hi) {
+                next_pcs.push_back(inst.x);
+            }
+        }
+        if (cut) {
+            break;
+        }
+    }
+
+    u32 flushed = flushes;
+    i32 next = find_or_add(next_pcs, c == '\n', matched);
+    // after a flush the old state is gone
+    if (flushes == flushed) {
+        states[state].next[c] = next;
+    }
+    return next;
+}
+
+i32 Regex::Dfa::find_or_add(std::vector<u32> &pcs,
+                            bool after_newline,
+                            bool matched) {
+    visited.resize(program->insts.size(), 0);
+    generation++;
+    closed.clear();
+    for (u32 pc : pcs) {
+        closure(pc, after_newline, false, closed);
+    }
+    // line starts were resolved, so the context only matters for the line
+    // ends still waiting on their next byte
+    key.assign(1, (char)(after_newline | matched << 1));
+    key.append((const char *)closed.data(), closed.size() * sizeof(u32));
+    auto it = cache.find(key);
+    if (it != cache.end()) {
+        return it->second;
+    }
+
+    u32 cost = sizeof(State) + closed.size() * sizeof(u32) + key.size() * 2;
+    if (memory + cost > memory_cap && !states.empty()) {
+        flush();
+    }
+    memory += cost;
+    State state;
+    state.insts = closed;
+    state.after_newline = after_newline;
+    state.matched = matched;
+    state.next.fill(-1);
+    states.push_back(std::move(state));
+    cache.emplace(key, states.size() - 1);
+    return states.size() - 1;
+}
+
+void Regex::Dfa::closure(u32 pc,
+                         bool after_newline,
+                         bool line_end,
+                         std::vector<u32> &out) {
+    const std::vector<Inst> &insts = program->insts;
+    stack.push_back(pc);
+    while (!stack.empty()) {
+        u32 p = stack.back();
+        stack.pop_back();
+        if (visited[p] == generation) {
+            continue;
+        }
+        visited[p] = generation;
+        const Inst &inst = insts[p];
+        switch (inst.op) {
+            case Op::JMP:
+            case Op::SAVE:
+                stack.push_back(inst.x);
+                break;
+            case Op::SPLIT:
+                // x is popped first, it has the higher priority
+                stack.push_back(inst.y);
+                stack.push_back(inst.x);
+                break;
+            case Op::LINE_START:
+                if (after_newline) {
+                    stack.push_back(inst.x);
+                }
+                break;
+            case Op::LINE_END:
+                if (line_end) {
+                    stack.push_back(inst.x);
+                } else {
+                    out.push_back(p);
+                }
+                break;
+            case Op::RANGE:
+            case Op::MATCH:
+                out.push_back(p);
+                break;
+        }
+    }
+}
+
+void Regex::Dfa::flush() {
+    states.clear();
+    cache.clear();
+    starts[0] = starts[1] = -1;
+    memory = 0;
+    flushes++;
+}
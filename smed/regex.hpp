@@ -0,0 +1,247 @@
+#ifndef SMED_REGEX_HPP
+#define SMED_REGEX_HPP
+
+#include <array>
+#include <omega/util/types.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "smed/gap_buffer.hpp"
+
+/**
+ * Text as up to two contiguous segments, the layout of a GapBuffer around
+ * its gap. Files that aren't open are a single segment
+ * */
+struct TextSegments {
+    TextSegments(const GapBuffer &text)
+        : data{text.head(), text.buff2()},
+          size{text.cursor(), text.buff2_size()} {}
+    TextSegments(const char *data, u32 size)
+        : data{data, nullptr}, size{size, 0} {}
+
+    u32 length() const {
+        return size[0] + size[1];
+    }
+    u8 at(u32 i) const {
+        return i < size[0] ? data[0][i] : data[1][i - size[0]];
+    }
+
+    const char *data[2];
+    u32 size[2];
+};
+
+/**
+ * Regular expressions in the style of RE2: the pattern is compiled into a
+ * Thompson NFA, which is simulated by a DFA whose states are built lazily
+ * while searching. Every byte is looked at a bounded number of times, so
+ * searches are linear in the text without any backtracking. The state cache
+ * is flushed once it outgrows the memory cap, which costs speed but never
+ * correctness.
+ *
+ * Supported: literals, ., [classes], \d \w \s and their negations, groups,
+ * (?:...), |, * + ? {m,n} and their lazy forms, ^ and $ at line boundaries.
+ * Classes are ASCII, . and negated classes match whole UTF-8 characters.
+ *
+ * Searching mutates the DFA cache, so each thread needs its own Regex
+ * */
+class Regex {
+  public:
+    struct Match {
+        u32 begin = 0, end = 0;
+    };
+
+    Regex(const std::string &pattern, u32 memory_cap = 8 << 20);
+
+    // the DFAs point into the programs
+    Regex(const Regex &) = delete;
+    Regex &operator=(const Regex &) = delete;
+
+    bool is_valid() const {
+        return error.empty();
+    }
+    const std::string &get_error() const {
+        return error;
+    }
+    // number of capture groups, not counting the whole match
+    u32 group_count() const {
+        return groups;
+    }
+
+    // leftmost-first match starting at or after start
+    bool search(const TextSegments &text, u32 start, Match &match);
+    /**
+     * Fills groups with the submatches of a match found by search, groups[0]
+     * is the whole match. Groups that didn't take part are {0, 0}
+     * */
+    void captures(const TextSegments &text,
+                  const Match &match,
+                  std::vector<Match> &groups);
+    // literal strings every match contains, for narrowing down files
+    void required_literals(std::vector<std::string> &out) const;
+
+  private:
+    // parse tree
+    struct Node {
+        enum class Type {
+            EMPTY = 0,
+            BYTES, // one byte out of ranges
+            CONCAT,
+            ALTERNATE,
+            REPEAT,
+            CAPTURE,
+            LINE_START,
+            LINE_END
+        } type = Type::EMPTY;
+        std::vector<std::pair<u8, u8>> ranges;
+        std::vector<u32> children;
+        i32 min = 0, max = 0; // max -1 is unbounded
+        bool greedy = true;
+        u32 group = 0;
+    };
+
+    // compiled program
+    struct Inst {
+        enum class Op : u8 {
+            RANGE = 0,  // consume a byte in [lo, hi], continue at x
+            SPLIT,      // continue at x, then at y with lower priority
+            JMP,        // continue at x
+            SAVE,       // record the position in slot y, continue at x
+            LINE_START, // assert the previous byte is '\n' or none
+            LINE_END,   // assert the next byte is '\n' or none
+            MATCH
+        } op;
+        u8 lo = 0, hi = 0;
+        u32 x = 0, y = 0;
+    };
+    using Op = Inst::Op;
+    struct Program {
+        std::vector<Inst> insts;
+        u32 anchored = 0;   // start of the pattern
+        u32 unanchored = 0; // start of .*? followed by the pattern
+    };
+
+    // lazily built DFA over one program
+    class Dfa {
+      public:
+        static constexpr u32 end_of_text = 256;
+
+        Dfa(const Program *program,
+            bool anchored,
+            bool longest,
+            u32 memory_cap)
+            : program(program),
+              anchored(anchored),
+              longest(longest),
+              memory_cap(memory_cap) {}
+
+        // start state for the context before the first byte
+        i32 start(bool after_newline);
+        // state after reading c, a byte or end_of_text
+        i32 next(i32 state, u32 c) {
+            i32 n = states[state].next[c];
+            return n != -1 ? n : compute(state, c);
+        }
+        // a match ended right before the byte that led into the state
+        bool is_match(i32 state) const {
+            return states[state].matched;
+        }
+        // no match can be continued or started anymore
+        bool is_dead(i32 state) const {
+            return states[state].insts.empty();
+        }
+        bool is_start(i32 state) const {
+            return state == starts[0] || state == starts[1];
+        }
+
+      private:
+        struct State {
+            std::vector<u32> insts; // RANGE, MATCH and unresolved LINE_END
+            bool after_newline = false;
+            bool matched = false;
+            std::array<i32, 257> next;
+        };
+
+        i32 compute(i32 state, u32 c);
+        i32 find_or_add(std::vector<u32> &insts,
+                        bool after_newline,
+                        bool matched);
+        // ordered epsilon closure of pc, line ends stay unresolved unless
+        // line_end is set
+        void closure(u32 pc,
+                     bool after_newline,
+                     bool line_end,
+                     std::vector<u32> &out);
+        void flush();
+
+        const Program *program;
+        bool anchored;
+        bool longest; // otherwise leftmost-first
+        u32 memory_cap;
+        u32 memory = 0;
+        u32 flushes = 0;
+        std::vector<State> states;
+        std::unordered_map<std::string, i32> cache;
+        i32 starts[2] = {-1, -1}; // by after_newline
+
+        // scratch
+        std::vector<u32> visited;
+        u32 generation = 0;
+        std::vector<u32> stack, list, expanded, next_pcs, closed;
+        std::string key;
+    };
+
+    // recursive descent parser, returns the node index
+    u32 parse_alternate();
+    u32 parse_concat();
+    u32 parse_repeat();
+    u32 parse_atom();
+    u32 parse_class();
+    u32 parse_escape();
+    u32 add_node(Node node);
+    u32 add_bytes(std::vector<std::pair<u8, u8>> ranges);
+    // ASCII ranges complemented, plus every multi byte UTF-8 character
+    u32 add_negated(const std::vector<std::pair<u8, u8>> &ascii);
+    u32 add_any_char();
+
+    void compile(Program &program, bool reverse);
+    void emit(Program &program, u32 node, bool reverse);
+    u32 add_inst(Program &program, Inst inst);
+    // Pike VM threads in priority order, each with its SAVE slots
+    struct Threads {
+        std::vector<u32> pcs;
+        std::vector<i64> caps;
+    };
+    void add_thread(const TextSegments &text,
+                    Threads &list,
+                    u32 pc,
+                    u32 pos,
+                    i64 *caps);
+
+    // prefix every match starts with, for skipping ahead with memchr
+    void find_literal_prefix();
+
+    static constexpr u32 max_insts = 1 << 16;
+    static constexpr u32 max_depth = 256;    // of nested groups
+    static constexpr i32 max_repeat = 1000;
+
+    std::string pattern;
+    u32 pos = 0; // parser position
+    u32 depth = 0;
+    std::string error;
+    std::vector<Node> nodes;
+    u32 root = 0;
+    u32 groups = 0;
+
+    Program forward, reverse;
+    Dfa forward_dfa, reverse_dfa;
+    std::string prefix;
+
+    // captures scratch
+    Threads threads[2];
+    std::vector<u32> visited;
+    u32 generation = 0;
+    std::vector<i64> caps, best;
+};
+
+#endif // SMED_REGEX_HPP
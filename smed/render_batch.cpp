@@ -0,0 +1,208 @@
+#include "render_batch.hpp"
+
+#include <algorithm>
+#include <omega/gfx/gl.hpp>
+#include <omega/gfx/vertex_buffer_layout.hpp>
+
+#include "smed/frame_stats.hpp"
+
+RenderBatch::RenderBatch(omega::gfx::Shader *solid_shader)
+    : solid_shader(solid_shader) {
+    shaders.push_back(solid_shader);
+    u32 id = 0;
+    u8 texel = 0xFF;
+    glGenTextures(1, &id);
+    white = omega::gfx::texture::Texture::create_wrapper(id, 1, 1);
+    white->bind(0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 GL_RED,
+                 1,
+                 1,
+                 0,
+                 GL_RED,
+                 GL_UNSIGNED_BYTE,
+                 &texel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    reserve(6 * 1024);
+}
+
+void RenderBatch::begin() {
+    for (auto &b : buckets) {
+        b.vertices.clear();
+    }
+    last_bucket = -1;
+}
+
+std::vector<RenderBatch::Vertex> &RenderBatch::bucket(const DrawKey &key) {
+    if (last_bucket != -1 && buckets[last_bucket].key == key) {
+        return buckets[last_bucket].vertices;
+    }
+    for (u32 i = 0; i < buckets.size(); ++i) {
+        if (buckets[i].key == key) {
+            last_bucket = i;
+            return buckets[i].vertices;
+        }
+    }
+    buckets.push_back({key, sort_key(key), {}});
+    last_bucket = buckets.size() - 1;
+    return buckets.back().vertices;
+}
+
+u64 RenderBatch::sort_key(const DrawKey &key) {
+    auto it = std::find(shaders.begin(), shaders.end(), key.shader);
+    u64 rank = it - shaders.begin();
+    if (it == shaders.end()) {
+        shaders.push_back(key.shader);
+    }
+    return (u64)key.layer << 56 | rank << 32 | buckets_created++;
+}
+
+void RenderBatch::push(const Quad &quad) {
+    auto &vertices = bucket(quad.key);
+    vertices.insert(vertices.end(), quad.vertices, quad.vertices + 6);
+}
+
+void RenderBatch::rect(Layer layer,
+                       const omega::math::rectf &dest,
+                       const omega::math::vec4 &color) {
+    Quad quad;
+    quad.key = {layer, solid_shader, white.get(), false};
+    make_vertices(quad.vertices, dest, {0.0f, 0.0f, 1.0f, 1.0f}, color);
+    push(quad);
+}
+
+void RenderBatch::image(Layer layer,
+                        omega::gfx::Shader *shader,
+                        omega::gfx::texture::Texture *texture,
+                        const omega::math::rectf &dest,
+                        const omega::math::rectf &src) {
+    Quad quad;
+    quad.key = {layer, shader, texture, false};
+    make_vertices(quad.vertices, dest, src, {1.0f, 1.0f, 1.0f, 1.0f});
+    push(quad);
+}
+
+bool RenderBatch::make_glyph(Quad &quad,
+                             Layer layer,
+                             omega::gfx::Shader *shader,
+                             Font *font,
+                             const Glyph &glyph,
+                             omega::math::vec2 pen,
+                             f32 scale_factor,
+                             const omega::math::vec4 &color) {
+    if (glyph.size.x == 0 || glyph.size.y == 0) {
+        return false;
+    }
+    auto *texture = font->get_texture(glyph.page);
+    quad.key = {layer, shader, texture, font->is_sdf()};
+
+    // normalize the src rectangle (texture coordinates)
+    omega::math::rectf src{(f32)glyph.tex_coords.x / texture->get_width(),
+                           (f32)glyph.tex_coords.y / texture->get_height(),
+                           (f32)glyph.size.x / texture->get_width(),
+                           (f32)glyph.size.y / texture->get_height()};
+    omega::math::rectf dest{
+        pen.x + glyph.offset.x * scale_factor,
+        pen.y - (glyph.size.y - glyph.offset.y) * scale_factor,
+        glyph.size.x * scale_factor,
+        glyph.size.y * scale_factor};
+    make_vertices(quad.vertices, dest, src, color);
+    return true;
+}
+
+void RenderBatch::make_vertices(Vertex *vertices,
+                                const omega::math::rectf &dest,
+                                const omega::math::rectf &src,
+                                const omega::math::vec4 &color) {
+    // create the vertices, inverting y up
+    vertices[0] = {{dest.x, dest.y}, {src.x, src.y + src.h}, color};
+    vertices[1] = {
+        {dest.x + dest.w, dest.y}, {src.x + src.w, src.y + src.h}, color};
+    vertices[2] = {
+        {dest.x + dest.w, dest.y + dest.h}, {src.x + src.w, src.y}, color};
+    vertices[3] = vertices[2];
+    vertices[4] = {{dest.x, dest.y + dest.h}, {src.x, src.y}, color};
+    vertices[5] = vertices[0];
+}
+
+void RenderBatch::reserve(u32 vertex_count) {
+    if (vertex_count <= vertex_capacity) {
+        return;
+    }
+    vertex_capacity = omega::math::max(vertex_count, vertex_capacity * 2);
+    vbo = omega::util::create_uptr<omega::gfx::VertexBuffer>(
+        sizeof(Vertex) * vertex_capacity);
+    vao = omega::util::create_uptr<omega::gfx::VertexArray>();
+
+    omega::gfx::VertexBufferLayout layout;
+    layout.push(OMEGA_GL_FLOAT, 2);
+    layout.push(OMEGA_GL_FLOAT, 2);
+    layout.push(OMEGA_GL_FLOAT, 4);
+    vao->add_buffer(*vbo, layout);
+}
+
+void RenderBatch::end() {
+    draw_calls = 0;
+    // buckets nobody drew into this frame are dropped
+    buckets.erase(std::remove_if(buckets.begin(),
+                                 buckets.end(),
+                                 [](const Bucket &b) {
+                                     return b.vertices.empty();
+                                 }),
+                  buckets.end());
+    std::sort(buckets.begin(), buckets.end(), [](const auto &a, const auto &b) {
+        return a.order < b.order;
+    });
+    last_bucket = -1;
+
+    staging.clear();
+    for (const auto &b : buckets) {
+        staging.insert(staging.end(), b.vertices.begin(), b.vertices.end());
+    }
+    if (staging.empty()) {
+        return;
+    }
+    {
+        FrameStats::Scope upload(FrameStats::Phase::UPLOAD);
+        reserve(staging.size());
+        vbo->bind();
+        vbo->sub_data(0, sizeof(Vertex) * staging.size(), staging.data());
+    }
+    FrameStats::Scope draw(FrameStats::Phase::DRAW);
+    vao->bind();
+
+    // uniforms are only uploaded when the shader or the layer changes
+    omega::gfx::Shader *bound = nullptr;
+    Layer bound_layer = Layer::COUNT;
+    u32 offset = 0;
+    for (const auto &b : buckets) {
+        const DrawKey &key = b.key;
+        if (key.shader != bound) {
+            if (bound != nullptr) {
+                bound->unbind();
+            }
+            bound = key.shader;
+            bound->bind();
+            bound->set_uniform_1i("u_texture", 0);
+            bound_layer = Layer::COUNT;
+        }
+        if (key.layer != bound_layer) {
+            bound_layer = key.layer;
+            bound->set_uniform_mat4f("u_view_proj",
+                                     view_proj[(u32)key.layer]);
+        }
+        bound->set_uniform_1i("u_sdf", key.sdf);
+        key.texture->bind(0);
+        omega::gfx::draw_arrays(
+            OMEGA_GL_TRIANGLES, offset, b.vertices.size());
+        offset += b.vertices.size();
+        draw_calls++;
+    }
+    bound->unbind();
+    vao->unbind();
+    vbo->unbind();
+    FrameStats::get().count(FrameStats::Counter::DRAW_CALLS, draw_calls);
+}
@@ -0,0 +1,128 @@
+#ifndef SMED_RENDERBATCH_HPP
+#define SMED_RENDERBATCH_HPP
+
+#include <array>
+#include <omega/gfx/shader.hpp>
+#include <omega/gfx/texture/texture.hpp>
+#include <omega/gfx/vertex_array.hpp>
+#include <omega/gfx/vertex_buffer.hpp>
+#include <omega/math/math.hpp>
+#include <omega/util/std.hpp>
+#include <omega/util/types.hpp>
+#include <vector>
+
+#include "smed/font.hpp"
+
+/**
+ * Retained batch for everything the editor draws: glyphs and solid quads are
+ * collected into buckets per (layer, shader, texture) and drawn in as few
+ * calls as the layer order allows, out of a single vertex upload per frame
+ * */
+class RenderBatch {
+  public:
+    // layers are drawn in order, quads within a layer are grouped by
+    // shader and texture, solid quads first
+    enum class Layer : u8 {
+        DOCUMENT = 0,     // document text in world space
+        DOCUMENT_OVERLAY, // cursor and selection on top of the text
+        MINIMAP,          // overview strip covering the document's edge
+        UI,               // screen space labels
+        POPUP_BACKGROUND, // input boxes covering the labels
+        POPUP,            // text inside the input boxes
+        COUNT
+    };
+
+    struct Vertex {
+        omega::math::vec2 pos;
+        omega::math::vec2 tex_coords;
+        omega::math::vec4 color;
+    };
+
+    struct DrawKey {
+        Layer layer;
+        omega::gfx::Shader *shader;
+        omega::gfx::texture::Texture *texture;
+        bool sdf; // texture holds distance fields
+
+        bool operator==(const DrawKey &other) const {
+            return layer == other.layer && shader == other.shader &&
+                   texture == other.texture && sdf == other.sdf;
+        }
+    };
+
+    struct Quad {
+        DrawKey key;
+        Vertex vertices[6];
+    };
+
+    RenderBatch(omega::gfx::Shader *solid_shader);
+
+    void begin();
+    void set_view_proj(Layer layer, const omega::math::mat4 &vp) {
+        view_proj[(u32)layer] = vp;
+    }
+    void push(const Quad &quad);
+    // solid colored rect
+    void rect(Layer layer,
+              const omega::math::rectf &dest,
+              const omega::math::vec4 &color);
+    // textured rect drawn with the given shader, src is normalized
+    void image(Layer layer,
+               omega::gfx::Shader *shader,
+               omega::gfx::texture::Texture *texture,
+               const omega::math::rectf &dest,
+               const omega::math::rectf &src);
+    /**
+     * Builds the quad of a glyph whose pen position (baseline) is at pen.
+     * Returns false for glyphs without a bitmap
+     * */
+    static bool make_glyph(Quad &quad,
+                           Layer layer,
+                           omega::gfx::Shader *shader,
+                           Font *font,
+                           const Glyph &glyph,
+                           omega::math::vec2 pen,
+                           f32 scale_factor,
+                           const omega::math::vec4 &color);
+    // uploads all vertices at once and issues one draw per bucket
+    void end();
+
+    u32 get_draw_calls() const {
+        return draw_calls;
+    }
+
+  private:
+    static void make_vertices(Vertex *vertices,
+                              const omega::math::rectf &dest,
+                              const omega::math::rectf &src,
+                              const omega::math::vec4 &color);
+    std::vector<Vertex> &bucket(const DrawKey &key);
+    // layer, then the shader's rank, then the bucket's age, so the draw
+    // order never depends on where things were allocated
+    u64 sort_key(const DrawKey &key);
+    void reserve(u32 vertex_count);
+
+    struct Bucket {
+        DrawKey key;
+        u64 order;
+        std::vector<Vertex> vertices; // capacity is kept between frames
+    };
+    std::vector<Bucket> buckets;
+    i32 last_bucket = -1; // consecutive quads usually share a bucket
+    u32 buckets_created = 0;
+    // ranked by first use, the solid shader is registered first
+    std::vector<omega::gfx::Shader *> shaders;
+
+    std::array<omega::math::mat4, (u32)Layer::COUNT> view_proj;
+    omega::gfx::Shader *solid_shader = nullptr;
+    // 1x1 white texel, so solid quads go through the text shaders
+    omega::util::sptr<omega::gfx::texture::Texture> white = nullptr;
+
+    std::vector<Vertex> staging;
+    u32 vertex_capacity = 0;
+    omega::util::uptr<omega::gfx::VertexBuffer> vbo = nullptr;
+    omega::util::uptr<omega::gfx::VertexArray> vao = nullptr;
+    u32 draw_calls = 0;
+};
+
+#endif // SMED_RENDERBATCH_HPP
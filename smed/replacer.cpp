@@ -0,0 +1,126 @@
+#include "replacer.hpp"
+
+#include <cctype>
+#include <cstring>
+#include <omega/math/math.hpp>
+
+Replacer::Replacer(const std::string &query,
+                   const std::string &replacement,
+                   bool regex)
+    : query(query), replacement(replacement) {
+    if (!regex || query.empty()) {
+        return;
+    }
+    compiled = omega::util::create_uptr<Regex>(query);
+    for (u32 i = 0; i + 1 < replacement.size(); ++i) {
+        if (replacement[i] == '$' && std::isdigit(replacement[i + 1])) {
+            uses_groups = true;
+        }
+    }
+}
+
+bool Replacer::find(const TextSegments &text, u32 start, Match &match) {
+    if (!is_valid()) {
+        return false;
+    }
+    if (compiled != nullptr) {
+        while (start <= text.length() &&
+               compiled->search(text, start, match)) {
+            if (match.end > match.begin) {
+                return true;
+            }
+            start = match.end + 1;
+        }
+        return false;
+    }
+
+    // memchr for the first byte in each segment, then compare the rest
+    u32 n = query.size();
+    u32 length = text.length();
+    if (n > length) {
+        return false;
+    }
+    for (u32 seg = 0; seg < 2; ++seg) {
+        u32 offset = seg == 0 ? 0 : text.size[0];
+        u32 to = omega::math::min(offset + text.size[seg], length - n + 1);
+        for (u32 from = omega::math::max(start, offset); from < to;) {
+            const char *p = (const char *)std::memchr(
+                text.data[seg] + (from - offset), query[0], to - from);
+            if (p == nullptr) {
+                break;
+            }
+            u32 idx = offset + (p - text.data[seg]);
+            u32 i = 1;
+            while (i < n && text.at(idx + i) == (u8)query[i]) {
+                i++;
+            }
+            if (i == n) {
+                match = {idx, idx + n};
+                return true;
+            }
+            from = idx + 1;
+        }
+    }
+    return false;
+}
+
+void Replacer::expand(const TextSegments &text,
+                      const Match &match,
+                      std::string &out) {
+    if (compiled == nullptr) {
+        out += replacement;
+        return;
+    }
+    if (uses_groups) {
+        compiled->captures(text, match, groups);
+    }
+    for (u32 i = 0; i < replacement.size(); ++i) {
+        char c = replacement[i];
+        char next = i + 1 < replacement.size() ? replacement[i + 1] : '\0';
+        if (c == '$' && next == '$') {
+            out += '$';
+            i++;
+        } else if (c == '$' && std::isdigit(next)) {
+            u32 g = next - '0';
+            if (g < groups.size()) {
+                append(text, groups[g].begin, groups[g].end, out);
+            }
+            i++;
+        } else {
+            out += c;
+        }
+    }
+}
+
+u32 Replacer::replace_all(const TextSegments &text,
+                          std::string &out,
+                          u32 &first,
+                          u32 &last) {
+    u32 count = 0;
+    Match match;
+    first = last = 0;
+    while (find(text, last, match)) {
+        if (count == 0) {
+            first = last = match.begin;
+        }
+        append(text, last, match.begin, out);
+        expand(text, match, out);
+        last = match.end;
+        count++;
+    }
+    return count;
+}
+
+void Replacer::append(const TextSegments &text,
+                      u32 begin,
+                      u32 end,
+                      std::string &out) {
+    if (begin < text.size[0]) {
+        u32 split = omega::math::min(text.size[0], end);
+        out.append(text.data[0] + begin, split - begin);
+        begin = split;
+    }
+    if (begin < end) {
+        out.append(text.data[1] + (begin - text.size[0]), end - begin);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef SMED_REPLACER_HPP
+#define SMED_REPLACER_HPP
+
+#include <omega/util/std.hpp>
+#include <omega/util/types.hpp>
+#include <string>
+#include <vector>
+
+#include "smed/regex.hpp"
+
+/**
+ * Replaces the matches of a literal or regex query in a single pass over the
+ * text. The output is written once, the text between matches is copied
+ * straight from the segments, so replacing every match costs about as much
+ * as copying the text.
+ *
+ * In regex mode $0 to $9 in the replacement insert capture groups and $$ is
+ * a dollar sign. Empty matches are skipped, like in SearchIndex
+ * */
+class Replacer {
+  public:
+    using Match = Regex::Match;
+
+    Replacer(const std::string &query,
+             const std::string &replacement,
+             bool regex);
+
+    bool is_valid() const {
+        return !query.empty() && (compiled == nullptr || compiled->is_valid());
+    }
+
+    // next non-empty match starting at or after start
+    bool find(const TextSegments &text, u32 start, Match &match);
+    // appends the replacement of match to out
+    void expand(const TextSegments &text, const Match &match, std::string &out);
+    /**
+     * Writes text[first, last) with every match replaced into out and
+     * returns the number of matches, first is the start of the first match
+     * and last the end of the last one
+     * */
+    u32 replace_all(const TextSegments &text,
+                    std::string &out,
+                    u32 &first,
+                    u32 &last);
+
+  private:
+    static void append(const TextSegments &text,
+                       u32 begin,
+                       u32 end,
+                       std::string &out);
+
+    std::string query;
+    std::string replacement;
+    omega::util::uptr<Regex> compiled = nullptr; // in regex mode
+    bool uses_groups = false; // whether expanding needs the captures
+    std::vector<Match> groups; // scratch
+};
+
+#endif // SMED_REPLACER_HPP
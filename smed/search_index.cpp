@@ -0,0 +1,141 @@
+#include "search_index.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <omega/math/math.hpp>
+
+void SearchIndex::set_query(GapBuffer &text, const std::string &query) {
+    bool refine = !regex && !this->query.empty() &&
+                  query.starts_with(this->query);
+    this->query = query;
+    compiled = nullptr;
+    if (query.empty()) {
+        matches.clear();
+        return;
+    }
+    if (regex) {
+        compiled = omega::util::create_uptr<Regex>(query);
+        scan_regex(text);
+        return;
+    }
+    // every match of the longer query is a match of the shorter one
+    if (refine) {
+        std::erase_if(matches, [&](const Match &m) {
+            return !matches_at(text, m.begin);
+        });
+        for (Match &m : matches) {
+            m.end = m.begin + query.size();
+        }
+        return;
+    }
+    matches.clear();
+    scan(text, 0, text.length(), matches);
+}
+
+void SearchIndex::set_regex(GapBuffer &text, bool regex) {
+    this->regex = regex;
+    std::string query = std::move(this->query);
+    clear();
+    set_query(text, query);
+}
+
+void SearchIndex::patch(GapBuffer &text, const GapBuffer::Edit &edit) {
+    if (query.empty() || !edit.changed) {
+        return;
+    }
+    if (regex) {
+        scan_regex(text);
+        return;
+    }
+    // matches overlapping the replaced bytes are gone, the ones after it move
+    u32 n = query.size();
+    u32 begin = edit.begin >= n - 1 ? edit.begin - (n - 1) : 0;
+    u32 old_end = edit.end - edit.delta;
+    const auto before = [](const Match &m, u32 idx) { return m.begin < idx; };
+    auto first =
+        std::lower_bound(matches.begin(), matches.end(), begin, before);
+    auto last = std::lower_bound(first, matches.end(), old_end, before);
+    for (auto it = last; it != matches.end(); ++it) {
+        it->begin += edit.delta;
+        it->end += edit.delta;
+    }
+    u32 at = matches.erase(first, last) - matches.begin();
+
+    found.clear();
+    scan(text, begin, omega::math::min(edit.end, text.length()), found);
+    matches.insert(matches.begin() + at, found.begin(), found.end());
+}
+
+u32 SearchIndex::next(u32 idx) const {
+    if (matches.empty()) {
+        return 0;
+    }
+    u32 i = std::lower_bound(matches.begin(),
+                             matches.end(),
+                             idx,
+                             [](const Match &m, u32 idx) {
+                                 return m.begin < idx;
+                             }) -
+            matches.begin();
+    return i == matches.size() ? 0 : i;
+}
+
+bool SearchIndex::matches_at(GapBuffer &text, u32 idx) const {
+    if (idx + query.size() > text.length()) {
+        return false;
+    }
+    for (u32 i = 0; i < query.size(); ++i) {
+        if (text.get(idx + i) != query[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SearchIndex::scan(GapBuffer &text,
+                       u32 begin,
+                       u32 end,
+                       std::vector<Match> &out) {
+    // memchr finds the candidates in each of the two segments around the
+    // gap, matches can still run across it
+    struct Segment {
+        const char *data;
+        u32 offset, size;
+    } segments[] = {{text.head(), 0, text.cursor()},
+                    {text.buff2(), text.cursor(), text.buff2_size()}};
+    for (const auto &segment : segments) {
+        u32 from = omega::math::max(begin, segment.offset);
+        u32 to = omega::math::min(end, segment.offset + segment.size);
+        while (from < to) {
+            const char *p = (const char *)std::memchr(
+                segment.data + (from - segment.offset), query[0], to - from);
+            if (p == nullptr) {
+                break;
+            }
+            u32 idx = segment.offset + (p - segment.data);
+            if (matches_at(text, idx)) {
+                out.push_back({idx, idx + (u32)query.size()});
+            }
+            from = idx + 1;
+        }
+    }
+}
+
+void SearchIndex::scan_regex(GapBuffer &text) {
+    matches.clear();
+    if (!compiled->is_valid()) {
+        return;
+    }
+    TextSegments segments(text);
+    Match match;
+    u32 from = 0;
+    while (from <= text.length() && compiled->search(segments, from, match)) {
+        // empty matches have nothing to highlight, the search moves past them
+        if (match.end > match.begin) {
+            matches.push_back(match);
+            from = match.end;
+        } else {
+            from = match.end + 1;
+        }
+    }
+}
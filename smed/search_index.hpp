@@ -0,0 +1,66 @@
+#ifndef SMED_SEARCHINDEX_HPP
+#define SMED_SEARCHINDEX_HPP
+
+#include <omega/util/std.hpp>
+#include <omega/util/types.hpp>
+#include <string>
+#include <vector>
+
+#include "smed/gap_buffer.hpp"
+#include "smed/regex.hpp"
+
+/**
+ * Sorted ranges of every occurrence of the search query. Extending the
+ * query only filters the current matches, and edits to the text rescan just
+ * the bytes around the edit instead of the whole document.
+ *
+ * In regex mode the query is a Regex and its non-empty matches are found
+ * instead. A regex can look arbitrarily far ahead, so edits rescan the whole
+ * document, which the lazy DFA keeps linear
+ * */
+class SearchIndex {
+  public:
+    using Match = Regex::Match;
+
+    // rescans unless query extends the current one
+    void set_query(GapBuffer &text, const std::string &query);
+    // switches between literal and regex queries and rescans
+    void set_regex(GapBuffer &text, bool regex);
+    // keeps the matches in sync with the edit, call after every edit
+    void patch(GapBuffer &text, const GapBuffer::Edit &edit);
+    // forgets the query, the mode stays
+    void clear() {
+        query.clear();
+        matches.clear();
+        compiled = nullptr;
+    }
+
+    bool is_regex() const {
+        return regex;
+    }
+    // false while the regex doesn't parse
+    bool is_valid() const {
+        return compiled == nullptr || compiled->is_valid();
+    }
+    // sorted by begin and by end
+    const std::vector<Match> &get_matches() const {
+        return matches;
+    }
+    // index of the first match at or after idx, wrapping around to the
+    // first match, matches.size() when there are none
+    u32 next(u32 idx) const;
+
+  private:
+    bool matches_at(GapBuffer &text, u32 idx) const;
+    // appends the matches starting in [begin, end)
+    void scan(GapBuffer &text, u32 begin, u32 end, std::vector<Match> &out);
+    void scan_regex(GapBuffer &text);
+
+    std::string query;
+    bool regex = false;
+    omega::util::uptr<Regex> compiled = nullptr; // of query in regex mode
+    std::vector<Match> matches;
+    std::vector<Match> found; // scratch
+};
+
+#endif // SMED_SEARCHINDEX_HPP
@@ -0,0 +1,613 @@
+#include "symbol_index.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <omega/util/log.hpp>
+#include <string_view>
+
+#include "smed/cache.hpp"
+#include "smed/mapped_file.hpp"
+#include "smed/project_files.hpp"
+
+namespace {
+
+// layout of the cache file, in native byte order: header, root, then per
+// file {u64 content hash, u32 symbol count} and its symbols as
+// {u32 name length, name, u8 kind, u32 line, u32 offset}
+constexpr char cache_magic[4] = {'S', 'M', 'S', 'Y'};
+constexpr u32 cache_version = 1;
+
+struct CacheHeader {
+    char magic[4];
+    u32 version;
+    u32 root_length;
+    u32 file_count;
+};
+
+// tokens looked at after a name for the '{' of a function body
+constexpr u32 max_scan = 4096;
+
+std::string cache_key(const std::string &root) {
+    std::error_code error;
+    return std::filesystem::absolute(root, error).lexically_normal().string();
+}
+
+std::string normal_path(const std::string &path) {
+    return std::filesystem::path(path).lexically_normal().string();
+}
+
+std::string to_lower(std::string s) {
+    for (char &c : s) {
+        c = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    }
+    return s;
+}
+
+u64 content_hash(const char *data, size_t size) {
+    // 0 marks symbols that came from an open buffer
+    u64 hash = std::hash<std::string_view>{}(std::string_view(data, size));
+    return hash == 0 ? 1 : hash;
+}
+
+} // namespace
+
+SymbolIndex::SymbolIndex(ThreadPool &pool) : pool(pool) {
+    workers.resize(pool.size());
+}
+
+void SymbolIndex::build(const std::string &root) {
+    cancel();
+    building = std::make_shared<Build>();
+    building->root = root;
+    building->cancelled = std::make_shared<std::atomic<bool>>(false);
+    load(*building);
+    // the jobs hold on to the build, it outlives being replaced
+    std::shared_ptr<Build> current = building;
+    ProjectWalker::walk(
+        pool,
+        root,
+        current->cancelled,
+        [this, current](u32 worker, const std::string &path) {
+            index_file(*current, worker, path);
+        },
+        [this, current]() { finish(*current); });
+}
+
+void SymbolIndex::cancel() {
+    if (building != nullptr) {
+        *building->cancelled = true;
+        building = nullptr;
+    }
+}
+
+bool SymbolIndex::is_source(const std::string &path) {
+    static const char *extensions[] = {
+        ".c", ".h", ".cc", ".cpp", ".cxx", ".hpp", ".hh", ".hxx", ".inl",
+        ".ipp"};
+    std::string extension = std::filesystem::path(path).extension().string();
+    for (const char *e : extensions) {
+        if (extension == e) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SymbolIndex::extract(const GapBuffer &text,
+                          const std::vector<Token> &tokens,
+                          const LineIndex &lines,
+                          std::vector<Symbol> &out) {
+    const auto offset = [&](u32 i) {
+        return text.get_index_from_pointer(tokens[i].text);
+    };
+    const auto is = [&](u32 i, const char *s) {
+        u32 n = std::strlen(s);
+        if (tokens[i].len != n) {
+            return false;
+        }
+        u32 at = offset(i);
+        for (u32 k = 0; k < n; ++k) {
+            if (text.get(at + k) != s[k]) {
+                return false;
+            }
+        }
+        return true;
+    };
+    const auto add = [&](u32 i, Kind kind, std::string prefix = "") {
+        u32 at = offset(i);
+        out.push_back({prefix + text.substr(at, tokens[i].len),
+                       kind,
+                       lines.line_of(at),
+                       at});
+    };
+
+    // the lexer has no block comments or character literals, whatever is in
+    // them would be taken for code. Continued #define lines neither
+    std::vector<u32> code;
+    code.reserve(tokens.size());
+    u32 length = text.length();
+    for (u32 i = 0; i < tokens.size(); ++i) {
+        const Token &token = tokens[i];
+        u32 at = offset(i);
+        u32 skip_to = 0; // tokens starting before this are skipped
+        if (token.type == TokenType::COMMENT) {
+            continue;
+        }
+        if (token.type == TokenType::PREPROCESSOR) {
+            // #define NAME, there can be spaces around define
+            u32 k = at + 1;
+            while (k < at + token.len && text.get(k) == ' ') {
+                k++;
+            }
+            if (k + 6 < at + token.len && text.compare(k, "define", 6)) {
+                k += 6;
+                while (k < at + token.len && text.get(k) == ' ') {
+                    k++;
+                }
+                u32 name = k;
+                while (k < at + token.len &&
+                       (std::isalnum((u8)text.get(k)) || text.get(k) == '_')) {
+                    k++;
+                }
+                if (k > name) {
+                    out.push_back({text.substr(name, k - name),
+                                   Kind::MACRO,
+                                   lines.line_of(name),
+                                   name});
+                }
+            }
+            u32 end = at + token.len;
+            while (end > at && end < length && text.get(end - 1) == '\\') {
+                u32 line = lines.line_of(end) + 1;
+                end = line < lines.line_count() ? lines.line_end(line) : length;
+            }
+            skip_to = end;
+        } else if (token.len == 1 && text.get(at) == '\'') {
+            u32 k = at + 1 < length && text.get(at + 1) == '\\' ? at + 3
+                                                                 : at + 2;
+            while (k < length && text.get(k) != '\'' && text.get(k) != '\n') {
+                k++;
+            }
+            skip_to = k + 1;
+        } else if (token.len == 1 && text.get(at) == '/' && at + 1 < length &&
+                   text.get(at + 1) == '*') {
+            i32 end = text.search(at + 2, "*/");
+            skip_to = end == -1 ? length : end + 2;
+        } else {
+            code.push_back(i);
+            continue;
+        }
+        while (i + 1 < tokens.size() && offset(i + 1) < skip_to) {
+            i++;
+        }
+    }
+
+    // index into code of the token closing the pair opened at c
+    const auto skip_pair = [&](u32 c, TokenType open, TokenType close) {
+        u32 depth = 0;
+        for (u32 end = omega::math::min((u32)code.size(), c + max_scan);
+             c < end;
+             ++c) {
+            TokenType type = tokens[code[c]].type;
+            if (type == open) {
+                depth++;
+            } else if (type == close && --depth == 0) {
+                return c;
+            }
+        }
+        return (u32)code.size();
+    };
+    // whether the SYMBOL at c starts a function definition, the body's '{'
+    // is put into body
+    const auto is_function = [&](u32 c, u32 &body) {
+        u32 k = skip_pair(c + 1, TokenType::OPEN_PAREN, TokenType::CLOSE_PAREN);
+        bool init_list = false, trailing = false;
+        for (k++; k < code.size() && k < c + max_scan; ++k) {
+            u32 i = code[k];
+            switch (tokens[i].type) {
+                case TokenType::OPEN_CURLY: {
+                    TokenType before = tokens[code[k - 1]].type;
+                    // a member's brace initializer in the init list
+                    if (init_list && (before == TokenType::SYMBOL ||
+                                      is(code[k - 1], ">"))) {
+                        k = skip_pair(
+                            k, TokenType::OPEN_CURLY, TokenType::CLOSE_CURLY);
+                        continue;
+                    }
+                    body = k;
+                    return true;
+                }
+                case TokenType::OPEN_PAREN:
+                    k = skip_pair(
+                        k, TokenType::OPEN_PAREN, TokenType::CLOSE_PAREN);
+                    continue;
+                case TokenType::SEMICOLON:
+                case TokenType::CLOSE_CURLY:
+                    return false;
+                case TokenType::KEYWORD:
+                    continue; // const, noexcept, override...
+                case TokenType::SYMBOL:
+                case TokenType::TYPE:
+                    if (init_list || trailing || is(i, "final") ||
+                        is(i, "override")) {
+                        continue;
+                    }
+                    return false;
+                default:
+                    break;
+            }
+            if (is(i, ":")) {
+                init_list = true;
+            } else if (is(i, ",")) {
+                if (!init_list) {
+                    return false; // more than one declarator
+                }
+            } else if (is(i, "=")) {
+                return false; // = default, = 0, or a variable
+            } else if (is(i, "-")) {
+                trailing = true;
+            }
+        }
+        return false;
+    };
+
+    struct Scope {
+        bool body;    // of a function or an initializer, nothing to find
+        bool typedef_; // the name after the closing '}' is a type
+    };
+    std::vector<Scope> scopes;
+    // at the outermost level or in a namespace or class
+    const auto in_declarations = [&]() {
+        return scopes.empty() || !scopes.back().body;
+    };
+    // state of the statement since the last ';', '{' or '}'
+    bool opens_declarations = false, in_typedef = false;
+    bool typedef_named = false;
+    u32 last_symbol = UINT32_MAX;
+    u32 paren_depth = 0;
+    for (u32 c = 0; c < code.size(); ++c) {
+        u32 i = code[c];
+        TokenType type = tokens[i].type;
+        if (type == TokenType::OPEN_CURLY) {
+            scopes.push_back({!in_declarations() || !opens_declarations,
+                              in_declarations() && in_typedef});
+            opens_declarations = in_typedef = typedef_named = false;
+            last_symbol = UINT32_MAX;
+            paren_depth = 0;
+            continue;
+        }
+        if (type == TokenType::CLOSE_CURLY) {
+            bool typedef_ = !scopes.empty() && scopes.back().typedef_;
+            if (!scopes.empty()) {
+                scopes.pop_back();
+            }
+            opens_declarations = typedef_named = false;
+            in_typedef = typedef_;
+            last_symbol = UINT32_MAX;
+            paren_depth = 0;
+            continue;
+        }
+        if (!in_declarations()) {
+            continue;
+        }
+
+        switch (type) {
+            case TokenType::SEMICOLON:
+                if (in_typedef && last_symbol != UINT32_MAX) {
+                    add(last_symbol, Kind::TYPE);
+                }
+                opens_declarations = in_typedef = typedef_named = false;
+                last_symbol = UINT32_MAX;
+                paren_depth = 0;
+                break;
+            case TokenType::OPEN_PAREN:
+                paren_depth++;
+                break;
+            case TokenType::CLOSE_PAREN:
+                paren_depth -= paren_depth > 0;
+                break;
+            case TokenType::KEYWORD:
+                if (is(i, "namespace") || is(i, "extern")) {
+                    opens_declarations = true;
+                } else if (is(i, "typedef")) {
+                    in_typedef = true;
+                } else if (is(i, "class") || is(i, "struct") ||
+                           is(i, "union") || is(i, "enum")) {
+                    opens_declarations |= !is(i, "enum");
+                    // the last name before the body or the base clause
+                    u32 k = c + 1;
+                    if (is(i, "enum") && k < code.size() &&
+                        is(code[k], "class")) {
+                        c = k++; // enum class
+                    }
+                    u32 name = UINT32_MAX, before = UINT32_MAX;
+                    while (k < code.size() &&
+                           (tokens[code[k]].type == TokenType::SYMBOL ||
+                            is(code[k], "::"))) {
+                        if (tokens[code[k]].type == TokenType::SYMBOL) {
+                            before = name;
+                            name = code[k];
+                        }
+                        k++;
+                    }
+                    if (name != UINT32_MAX && is(name, "final")) {
+                        name = before;
+                    }
+                    if (name != UINT32_MAX && k < code.size() &&
+                        (tokens[code[k]].type == TokenType::OPEN_CURLY ||
+                         is(code[k], ":"))) {
+                        add(name, Kind::TYPE);
+                    }
+                } else if (is(i, "using") && c + 2 < code.size() &&
+                           tokens[code[c + 1]].type == TokenType::SYMBOL &&
+                           is(code[c + 2], "=")) {
+                    add(code[c + 1], Kind::TYPE);
+                }
+                break;
+            case TokenType::SYMBOL: {
+                if (in_typedef) {
+                    // typedef void (*name)(...) has the name first, else
+                    // it's the last one outside of parens
+                    if (c >= 2 && is(code[c - 1], "*") &&
+                        tokens[code[c - 2]].type == TokenType::OPEN_PAREN) {
+                        last_symbol = i;
+                        typedef_named = true;
+                    } else if (paren_depth == 0 && !typedef_named) {
+                        last_symbol = i;
+                    }
+                    break;
+                }
+                u32 body;
+                if (paren_depth == 0 && c + 1 < code.size() &&
+                    tokens[code[c + 1]].type == TokenType::OPEN_PAREN &&
+                    is_function(c, body)) {
+                    bool destructor = c > 0 && is(code[c - 1], "~");
+                    add(i, Kind::FUNCTION, destructor ? "~" : "");
+                    // continue at the body, so it's skipped
+                    c = body - 1;
+                    opens_declarations = false;
+                    paren_depth = 0;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+void SymbolIndex::Table::set(u32 file, std::vector<Symbol> symbols) {
+    File &f = files[file];
+    for (Names::iterator it : f.entries) {
+        names.erase(it);
+    }
+    f.entries.clear();
+    f.entries.reserve(symbols.size());
+    for (Symbol &symbol : symbols) {
+        std::string key = to_lower(symbol.name);
+        f.entries.push_back(
+            names.emplace(std::move(key), Entry{file, std::move(symbol)}));
+    }
+}
+
+void SymbolIndex::update_file(const std::string &path,
+                              std::vector<Symbol> symbols) {
+    std::string key = normal_path(path);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = table.ids.find(key);
+    u32 id = it == table.ids.end() ? (u32)table.files.size() : it->second;
+    if (it == table.ids.end()) {
+        table.files.push_back({key, 0, {}});
+        table.ids.emplace(key, id);
+    }
+    // a build finishing later keeps the buffer's symbols
+    table.files[id].hash = 0;
+    table.set(id, std::move(symbols));
+}
+
+void SymbolIndex::find(const std::string &name,
+                       std::vector<Location> &out) const {
+    out.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto [begin, end] = table.names.equal_range(to_lower(name));
+    for (auto it = begin; it != end; ++it) {
+        if (it->second.symbol.name == name) {
+            out.push_back(
+                {table.files[it->second.file].path, it->second.symbol});
+        }
+    }
+}
+
+void SymbolIndex::search(const std::string &prefix,
+                         u32 max,
+                         std::vector<Location> &out) const {
+    out.clear();
+    std::string lower = to_lower(prefix);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = table.names.lower_bound(lower);
+         it != table.names.end() && out.size() < max &&
+         it->first.compare(0, lower.size(), lower) == 0;
+         ++it) {
+        out.push_back({table.files[it->second.file].path, it->second.symbol});
+    }
+}
+
+void SymbolIndex::index_file(Build &build,
+                             u32 worker,
+                             const std::string &path) {
+    if (!is_source(path)) {
+        return;
+    }
+    MappedFile mapped(path);
+    const char *data = mapped.data();
+    size_t size = mapped.size();
+    if (!mapped.is_open() || size == 0 || size > max_file_size ||
+        std::memchr(data, '\0', std::min<size_t>(size, binary_probe))) {
+        return;
+    }
+    IndexedFile indexed{normal_path(path), content_hash(data, size), {}};
+    auto cached = build.cached.find(indexed.hash);
+    if (cached != build.cached.end()) {
+        indexed.symbols = cached->second;
+    } else {
+        if (workers[worker] == nullptr) {
+            workers[worker] = omega::util::create_uptr<Worker>();
+        }
+        Worker &w = *workers[worker];
+        // the gap buffer wants a terminated string
+        w.text.open(std::string(data, size).c_str());
+        w.lines.rebuild(w.text);
+        w.lexer.retokenize();
+        w.tokens.clear();
+        for (Token token = w.lexer.next(); token.type != TokenType::END;
+             token = w.lexer.next()) {
+            w.tokens.push_back(token);
+        }
+        extract(w.text, w.tokens, w.lines, indexed.symbols);
+    }
+    std::lock_guard<std::mutex> lock(build.mutex);
+    build.indexed.push_back(std::move(indexed));
+}
+
+void SymbolIndex::finish(Build &build) {
+    if (*build.cancelled) {
+        build.done = true;
+        return;
+    }
+    std::sort(build.indexed.begin(),
+              build.indexed.end(),
+              [](const IndexedFile &a, const IndexedFile &b) {
+                  return a.path < b.path;
+              });
+    save(build);
+
+    Table next;
+    for (IndexedFile &indexed : build.indexed) {
+        u32 id = next.files.size();
+        next.files.push_back({indexed.path, indexed.hash, {}});
+        next.ids.emplace(indexed.path, id);
+        next.set(id, std::move(indexed.symbols));
+    }
+    build.indexed.clear();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // the open buffers are newer than what's on disk
+        for (const File &file : table.files) {
+            if (file.hash != 0) {
+                continue;
+            }
+            std::vector<Symbol> symbols;
+            for (Names::iterator it : file.entries) {
+                symbols.push_back(it->second.symbol);
+            }
+            auto it = next.ids.find(file.path);
+            u32 id = it == next.ids.end() ? (u32)next.files.size() : it->second;
+            if (it == next.ids.end()) {
+                next.files.push_back({file.path, 0, {}});
+                next.ids.emplace(file.path, id);
+            }
+            next.files[id].hash = 0;
+            next.set(id, std::move(symbols));
+        }
+        table = std::move(next);
+    }
+    build.done = true;
+}
+
+void SymbolIndex::load(Build &build) {
+    std::string key = cache_key(build.root);
+    MappedFile file(cache_file(key, "symbols"));
+    if (!file.is_open()) {
+        return;
+    }
+    CacheReader reader{file.data(), file.size()};
+    CacheHeader header;
+    if (!reader.read(&header, sizeof(header)) ||
+        std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 ||
+        header.version != cache_version ||
+        header.root_length != key.length()) {
+        return;
+    }
+    const char *cached_root = reader.view(header.root_length);
+    if (cached_root == nullptr ||
+        std::memcmp(cached_root, key.data(), key.length()) != 0) {
+        return;
+    }
+    for (u32 f = 0; f < header.file_count; ++f) {
+        // a symbol is at least its name length, kind, line and offset
+        constexpr size_t symbol_record =
+            sizeof(u32) + sizeof(Kind) + sizeof(u32) + sizeof(u32);
+        u64 hash;
+        u32 count;
+        if (!reader.read(&hash, sizeof(hash)) ||
+            !reader.read(&count, sizeof(count)) ||
+            !reader.fits(count, symbol_record)) {
+            build.cached.clear();
+            return;
+        }
+        std::vector<Symbol> symbols(count);
+        for (Symbol &symbol : symbols) {
+            u32 length = 0;
+            const char *name = nullptr;
+            if (!reader.read(&length, sizeof(length)) ||
+                !(name = reader.view(length)) ||
+                !reader.read(&symbol.kind, sizeof(symbol.kind)) ||
+                !reader.read(&symbol.line, sizeof(symbol.line)) ||
+                !reader.read(&symbol.offset, sizeof(symbol.offset)) ||
+                symbol.kind > Kind::MACRO) {
+                build.cached.clear();
+                return;
+            }
+            symbol.name.assign(name, length);
+        }
+        build.cached.emplace(hash, std::move(symbols));
+    }
+}
+
+void SymbolIndex::save(const Build &build) {
+    std::string key = cache_key(build.root);
+    std::string file = cache_file(key, "symbols");
+    if (file.empty()) {
+        return;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(
+        std::filesystem::path(file).parent_path(), error);
+
+    // write to a temporary first, so a partial file is never mapped
+    std::string tmp = file + ".tmp";
+    std::ofstream of(tmp, std::ios::binary);
+    if (of.fail()) {
+        OMEGA_WARN("Failed to write the symbol index '{}'", tmp);
+        return;
+    }
+    CacheHeader header{};
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.root_length = key.length();
+    header.file_count = build.indexed.size();
+    of.write((const char *)&header, sizeof(header));
+    of.write(key.data(), key.length());
+    for (const IndexedFile &indexed : build.indexed) {
+        u32 count = indexed.symbols.size();
+        of.write((const char *)&indexed.hash, sizeof(indexed.hash));
+        of.write((const char *)&count, sizeof(count));
+        for (const Symbol &symbol : indexed.symbols) {
+            u32 length = symbol.name.size();
+            of.write((const char *)&length, sizeof(length));
+            of.write(symbol.name.data(), length);
+            of.write((const char *)&symbol.kind, sizeof(symbol.kind));
+            of.write((const char *)&symbol.line, sizeof(symbol.line));
+            of.write((const char *)&symbol.offset, sizeof(symbol.offset));
+        }
+    }
+    of.close();
+    if (of.fail()) {
+        std::filesystem::remove(tmp, error);
+        return;
+    }
+    std::filesystem::rename(tmp, file, error);
+}
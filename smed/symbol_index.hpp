@@ -0,0 +1,141 @@
+#ifndef SMED_SYMBOLINDEX_HPP
+#define SMED_SYMBOLINDEX_HPP
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <omega/util/std.hpp>
+#include <omega/util/types.hpp>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "smed/bracket_index.hpp"
+#include "smed/gap_buffer.hpp"
+#include "smed/lexer.hpp"
+#include "smed/line_index.hpp"
+#include "smed/thread_pool.hpp"
+#include "smed/width_index.hpp"
+#include "smed/wrap_layout.hpp"
+
+/**
+ * Function, type and macro definitions of the C and C++ files under the
+ * project root, picked out of the lexer's tokens. The files are lexed on a
+ * thread pool, and the symbols of each file are cached on disk by a hash of
+ * its contents, so only files that changed are lexed again. Open buffers
+ * replace their file's symbols as they are edited.
+ *
+ * Names are kept sorted case-insensitively, so looking one up or listing
+ * the names with a prefix is a binary search
+ * */
+class SymbolIndex {
+  public:
+    enum class Kind : u8 {
+        FUNCTION = 0,
+        TYPE,
+        MACRO
+    };
+
+    struct Symbol {
+        std::string name;
+        Kind kind;
+        u32 line; // 0 based
+        u32 offset;
+    };
+    struct Location {
+        std::string path;
+        Symbol symbol;
+    };
+
+    // pool can be shared, it has to be drained before the index goes away
+    SymbolIndex(ThreadPool &pool);
+    ~SymbolIndex() {
+        cancel();
+    }
+
+    // indexes root in the background, the current symbols stay until the
+    // new ones are complete
+    void build(const std::string &root);
+    void cancel();
+    bool is_building() const {
+        return building != nullptr && !building->done;
+    }
+
+    // C and C++ sources, judged by the extension
+    static bool is_source(const std::string &path);
+    // definitions outside of function bodies, in text order
+    static void extract(const GapBuffer &text,
+                        const std::vector<Token> &tokens,
+                        const LineIndex &lines,
+                        std::vector<Symbol> &out);
+    void update_file(const std::string &path, std::vector<Symbol> symbols);
+
+    // definitions named exactly name
+    void find(const std::string &name, std::vector<Location> &out) const;
+    // at most max definitions whose name starts with prefix, ignoring case
+    void search(const std::string &prefix,
+                u32 max,
+                std::vector<Location> &out) const;
+
+  private:
+    struct Entry {
+        u32 file;
+        Symbol symbol;
+    };
+    using Names = std::multimap<std::string, Entry>; // by lower case name
+    struct File {
+        std::string path;
+        u64 hash; // of the contents the symbols came from, 0 for a buffer
+        std::vector<Names::iterator> entries;
+    };
+    struct Table {
+        std::vector<File> files;
+        std::unordered_map<std::string, u32> ids;
+        Names names;
+
+        void set(u32 file, std::vector<Symbol> symbols);
+    };
+    struct IndexedFile {
+        std::string path;
+        u64 hash;
+        std::vector<Symbol> symbols;
+    };
+    struct Build {
+        std::string root;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+        // symbols of the last build by content hash, read only once loaded
+        std::unordered_map<u64, std::vector<Symbol>> cached;
+        std::mutex mutex;
+        std::vector<IndexedFile> indexed;
+        std::atomic<bool> done{false};
+    };
+    // lexing state of a worker, only touched by that worker
+    struct Worker {
+        GapBuffer text{""};
+        WidthIndex widths;
+        WrapLayout wraps;
+        BracketIndex brackets;
+        LineIndex lines;
+        Lexer lexer{&text, nullptr, &widths, &wraps, &brackets};
+        std::vector<Token> tokens;
+    };
+
+    void index_file(Build &build, u32 worker, const std::string &path);
+    void finish(Build &build);
+
+    static void load(Build &build);
+    static void save(const Build &build);
+
+    static constexpr u32 max_file_size = 16 << 20; // generated files and such
+    static constexpr u32 binary_probe = 8192; // bytes checked for a NUL
+
+    mutable std::mutex mutex; // guards table
+    Table table;
+    std::shared_ptr<Build> building = nullptr;
+    std::vector<omega::util::uptr<Worker>> workers;
+    ThreadPool &pool;
+};
+
+#endif // SMED_SYMBOLINDEX_HPP
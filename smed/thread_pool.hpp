@@ -0,0 +1,145 @@
+#ifndef SMED_THREADPOOL_HPP
+#define SMED_THREADPOOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <omega/util/types.hpp>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads pulling jobs off a shared queue. Jobs get the
+ * index of the worker running them, so callers can keep per worker state
+ * (like FreeType faces) without locking
+ * */
+class ThreadPool {
+  public:
+    using Job = std::function<void(u32 worker)>;
+
+    ThreadPool(u32 count = std::thread::hardware_concurrency()) {
+        count = count == 0 ? 1 : count;
+        for (u32 i = 0; i < count; ++i) {
+            workers.emplace_back([this, i]() { run(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        job_available.notify_all();
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    u32 size() const {
+        return workers.size();
+    }
+
+    void submit(Job job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+            unfinished++;
+        }
+        job_available.notify_one();
+    }
+
+    // blocks until every submitted job has finished, also the ones other
+    // callers submitted. Calling it from a worker never returns, that worker's
+    // own job is unfinished
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        all_done.wait(lock, [this]() { return unfinished == 0; });
+    }
+
+    /**
+     * Runs fn(worker, i) for every i in [0, count) and waits for those only,
+     * other jobs on the pool keep running. Indices are handed out
+     * dynamically, so results should be stored by i. From one of the pool's
+     * own workers everything runs on that worker, waiting for the others
+     * could wait on itself
+     * */
+    void parallel_for(u32 count,
+                      const std::function<void(u32 worker, u32 i)> &fn) {
+        if (count == 0) {
+            return;
+        }
+        if (current_pool == this) {
+            for (u32 i = 0; i < count; ++i) {
+                fn(current_worker, i);
+            }
+            return;
+        }
+        // the jobs reference these, so every one of them has to be done
+        // before returning, not just every index
+        std::atomic<u32> next{0};
+        u32 remaining = std::min(count, size());
+        std::mutex done_mutex;
+        std::condition_variable done;
+        u32 jobs_count = remaining;
+        for (u32 j = 0; j < jobs_count; ++j) {
+            submit([&](u32 worker) {
+                for (u32 i = next++; i < count; i = next++) {
+                    fn(worker, i);
+                }
+                std::lock_guard<std::mutex> lock(done_mutex);
+                if (--remaining == 0) {
+                    done.notify_all();
+                }
+            });
+        }
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done.wait(lock, [&]() { return remaining == 0; });
+    }
+
+  private:
+    void run(u32 worker) {
+        current_pool = this;
+        current_worker = worker;
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                job_available.wait(
+                    lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job(worker);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                unfinished--;
+                if (unfinished == 0) {
+                    all_done.notify_all();
+                }
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    std::mutex mutex;
+    std::condition_variable job_available;
+    std::condition_variable all_done;
+    u32 unfinished = 0;
+    bool stopping = false;
+
+    // the pool and index of the worker running on this thread, if any
+    inline static thread_local const ThreadPool *current_pool = nullptr;
+    inline static thread_local u32 current_worker = 0;
+};
+
+#endif // SMED_THREADPOOL_HPP
@@ -0,0 +1,326 @@
+#include "tile_cache.hpp"
+
+#include <bit>
+#include <cmath>
+#include <omega/gfx/gl.hpp>
+#include <omega/util/log.hpp>
+
+TileCache::TileCache(omega::gfx::Shader *tile_shader)
+    : tile_batch(tile_shader), tile_shader(tile_shader) {
+    tiles.reserve(max_tiles);
+}
+
+TileCache::~TileCache() {
+    for (auto &tile : tiles) {
+        glDeleteFramebuffers(1, &tile.fbo);
+    }
+}
+
+bool TileCache::render(RenderBatch &batch,
+                       BufferRenderer &renderer,
+                       Font *font,
+                       GapBuffer &text,
+                       const std::vector<Token> &tokens,
+                       const Layout &layout,
+                       const omega::scene::OrthographicCamera &camera,
+                       f32 height,
+                       const omega::math::vec4 &color,
+                       const omega::math::vec4 &background,
+                       u64 text_version) {
+    // tiles are rasterized at the screen's resolution, not the camera's
+    i32 viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    f32 pixel_scale = viewport[2] / camera.get_width();
+    f32 world_size = tile_size / pixel_scale;
+    f32 scale = height / font->get_font_size();
+    f32 line_height = font->get_font_height() * scale;
+    i32 max_row = (i32)layout.wraps.row_count() - 1;
+
+    i32 col0 = (i32)std::floor(camera.position.x / world_size);
+    i32 col1 = (i32)std::floor((camera.position.x + camera.get_width()) /
+                               world_size);
+    i32 row0 = (i32)std::floor(camera.position.y / world_size);
+    i32 row1 = (i32)std::floor((camera.position.y + camera.get_height()) /
+                               world_size);
+
+    // rows grow downwards from y = 0, one extra row on each side catches
+    // glyphs overhanging into the tile. Tile rows without text need no tile
+    const auto rows_of = [&](i32 row, i32 &first, i32 &last) {
+        f32 bottom = row * world_size;
+        first = (i32)std::floor(-(bottom + world_size) / line_height) - 1;
+        last = (i32)std::ceil(-bottom / line_height) + 1;
+        if (last < 0 || first > max_row) {
+            return false;
+        }
+        first = omega::math::max(first, 0);
+        last = omega::math::min(last, max_row);
+        return true;
+    };
+
+    // tiles on screen can't be evicted, so a view needing more than the
+    // cache holds, counting the ones other views use this frame, is left to
+    // the caller
+    u32 needed = 0;
+    for (const Tile &tile : tiles) {
+        needed += tile.last_used == frame;
+    }
+    for (i32 row = row0; row <= row1; ++row) {
+        i32 first, last;
+        if (!rows_of(row, first, last)) {
+            continue;
+        }
+        for (i32 col = col0; col <= col1; ++col) {
+            const Tile *tile = find(row, col, height, pixel_scale);
+            needed += tile == nullptr || tile->last_used != frame;
+        }
+    }
+    if (needed > max_tiles) {
+        return false;
+    }
+
+    i32 prev_fbo = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_fbo);
+    bool rebound = false;
+
+    for (i32 row = row0; row <= row1; ++row) {
+        i32 first, last;
+        if (!rows_of(row, first, last)) {
+            continue;
+        }
+        f32 bottom = row * world_size;
+
+        for (i32 col = col0; col <= col1; ++col) {
+            Tile &tile = acquire(row, col, height, pixel_scale);
+            tile.last_used = frame;
+
+            bool moved =
+                tile.first_row != (u32)first || tile.last_row != (u32)last;
+            u64 hash = tile.hash;
+            if (!tile.drawn || moved || tile.text_version != text_version) {
+                hash = hash_rows(text,
+                                  tokens,
+                                  layout,
+                                  first,
+                                  last,
+                                  (col * world_size - line_height) / scale,
+                                  (col + 1) * world_size / scale);
+            }
+            bool stale = !tile.drawn || moved || hash != tile.hash ||
+                         (tile.provisional &&
+                          tile.font_generation != font->get_generation());
+            tile.first_row = first;
+            tile.last_row = last;
+            tile.hash = hash;
+            tile.text_version = text_version;
+
+            if (stale) {
+                draw(tile,
+                     renderer,
+                     font,
+                     text,
+                     tokens,
+                     layout,
+                     height,
+                     world_size,
+                     color,
+                     background);
+                rebound = true;
+            }
+            if (tile.empty) {
+                continue;
+            }
+            // the framebuffer's rows start at the bottom
+            batch.image(RenderBatch::Layer::DOCUMENT,
+                        tile_shader,
+                        tile.texture.get(),
+                        {col * world_size, bottom, world_size, world_size},
+                        {0.0f, 1.0f, 1.0f, -1.0f});
+        }
+    }
+
+    if (rebound) {
+        glBindFramebuffer(GL_FRAMEBUFFER, prev_fbo);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+    return true;
+}
+
+TileCache::Tile *TileCache::find(i32 row,
+                                 i32 col,
+                                 f32 height,
+                                 f32 pixel_scale) {
+    for (Tile &tile : tiles) {
+        if (tile.row == row && tile.col == col && tile.height == height &&
+            tile.pixel_scale == pixel_scale) {
+            return &tile;
+        }
+    }
+    return nullptr;
+}
+
+TileCache::Tile &TileCache::acquire(i32 row,
+                                    i32 col,
+                                    f32 height,
+                                    f32 pixel_scale) {
+    if (Tile *tile = find(row, col, height, pixel_scale)) {
+        return *tile;
+    }
+    i32 lru = -1;
+    for (u32 i = 0; i < tiles.size(); ++i) {
+        const Tile &tile = tiles[i];
+        if (tile.last_used != frame &&
+            (lru == -1 || tile.last_used < tiles[lru].last_used)) {
+            lru = i;
+        }
+    }
+
+    // reuse the framebuffer of the least recently used tile once the cache
+    // is full, render made sure one is off screen
+    if (tiles.size() >= max_tiles) {
+        Tile &tile = tiles[lru];
+        u32 fbo = tile.fbo;
+        auto texture = tile.texture;
+        tile = Tile{};
+        tile.fbo = fbo;
+        tile.texture = texture;
+        tile.row = row;
+        tile.col = col;
+        tile.height = height;
+        tile.pixel_scale = pixel_scale;
+        return tile;
+    }
+
+    Tile &tile = tiles.emplace_back();
+    tile.row = row;
+    tile.col = col;
+    tile.height = height;
+    tile.pixel_scale = pixel_scale;
+
+    u32 id = 0;
+    glGenTextures(1, &id);
+    tile.texture =
+        omega::gfx::texture::Texture::create_wrapper(id, tile_size, tile_size);
+    tile.texture->bind(0);
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 GL_RGBA8,
+                 tile_size,
+                 tile_size,
+                 0,
+                 GL_RGBA,
+                 GL_UNSIGNED_BYTE,
+                 nullptr);
+    // tiles map 1:1 onto screen pixels
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenFramebuffers(1, &tile.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, tile.fbo);
+    glFramebufferTexture2D(
+        GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, id, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        OMEGA_ERROR("Tile framebuffer is incomplete");
+    }
+    return tile;
+}
+
+void TileCache::draw(Tile &tile,
+                     BufferRenderer &renderer,
+                     Font *font,
+                     GapBuffer &text,
+                     const std::vector<Token> &tokens,
+                     const Layout &layout,
+                     f32 height,
+                     f32 world_size,
+                     const omega::math::vec4 &color,
+                     const omega::math::vec4 &background) {
+    glBindFramebuffer(GL_FRAMEBUFFER, tile.fbo);
+    glViewport(0, 0, tile_size, tile_size);
+    // tiles are opaque, so compositing needs no blending tricks
+    omega::gfx::set_clear_color(
+        background.r, background.g, background.b, background.a);
+    omega::gfx::clear_buffer(OMEGA_GL_COLOR_BUFFER_BIT);
+
+    omega::scene::OrthographicCamera tile_camera(
+        0.0f, world_size, 0.0f, world_size, -1.0f, 1.0f);
+    tile_camera.position = {tile.col * world_size, tile.row * world_size, 0.0f};
+    tile_camera.recalculate_view_matrix();
+
+    // glyphs starting left of the tile can still overhang into it
+    f32 x = tile.col * world_size;
+    f32 line_height =
+        font->get_font_height() * (height / font->get_font_size());
+    tile_batch.begin();
+    tile_batch.set_view_proj(RenderBatch::Layer::DOCUMENT,
+                             tile_camera.get_view_projection_matrix());
+    renderer.render(tile_batch,
+                    font,
+                    text,
+                    tokens,
+                    layout,
+                    {0.0f, 0.0f},
+                    height,
+                    color,
+                    tile.first_row,
+                    tile.last_row,
+                    x - line_height,
+                    x + world_size);
+    tile_batch.end();
+
+    tile.drawn = true;
+    tile.empty = tile_batch.get_draw_calls() == 0;
+    tile.provisional = font->has_pending();
+    tile.font_generation = font->get_generation();
+    redrawn++;
+}
+
+u64 TileCache::hash_rows(GapBuffer &text,
+                         const std::vector<Token> &tokens,
+                         const Layout &layout,
+                         u32 first_row,
+                         u32 last_row,
+                         f32 x_min,
+                         f32 x_max) {
+    // FNV-1a
+    u64 hash = 14695981039346656037ull;
+    const auto mix = [&](u64 v) {
+        hash ^= v;
+        hash *= 1099511628211ull;
+    };
+    const auto &wraps = layout.wraps;
+    for (u32 row = first_row; row <= last_row; ++row) {
+        // only the columns inside the tile count, so tiles of very long
+        // lines don't hash the whole line
+        u32 row_start = wraps.row_start(row);
+        u32 row_end = wraps.row_end(row);
+        f32 row_x = wraps.row_x(row);
+        auto from = layout.widths.before_x(
+            row_start, row_end, x_min + row_x, row_x);
+        auto to = layout.widths.before_x(
+            row_start, row_end, x_max + row_x, row_x);
+        // a character is at most 4 bytes
+        u32 end =
+            omega::math::min(row_end, to.idx + WidthIndex::interval * 4);
+        // relative, so edits above the tile don't invalidate it
+        mix(from.idx - row_start);
+        mix(end - from.idx);
+        mix(std::bit_cast<u32>(from.x - row_x));
+        for (u32 i = from.idx; i < end; ++i) {
+            mix((u8)text.get(i));
+        }
+        // token types carry the colors, which can change without the text
+        for (u32 t = BufferRenderer::first_token(tokens, text, from.idx);
+             t < tokens.size();
+             ++t) {
+            u32 idx = text.get_index_from_pointer(tokens[t].text);
+            if (idx > end) {
+                break;
+            }
+            mix(idx - row_start);
+            mix((u64)tokens[t].type);
+        }
+    }
+    return hash;
+}
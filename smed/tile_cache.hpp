@@ -0,0 +1,113 @@
+#ifndef SMED_TILECACHE_HPP
+#define SMED_TILECACHE_HPP
+
+#include <omega/gfx/shader.hpp>
+#include <omega/gfx/texture/texture.hpp>
+#include <omega/math/math.hpp>
+#include <omega/scene/orthographic_camera.hpp>
+#include <omega/util/std.hpp>
+#include <omega/util/types.hpp>
+#include <vector>
+
+#include "smed/buffer_renderer.hpp"
+#include "smed/font.hpp"
+#include "smed/gap_buffer.hpp"
+#include "smed/layout.hpp"
+#include "smed/lexer.hpp"
+#include "smed/render_batch.hpp"
+
+/**
+ * Caches the rasterized document in fixed size offscreen tiles, keyed by
+ * their grid cell (which fixes the row range) and the zoom. Panning only
+ * composites tiles; a tile is drawn again once the text of its rows changes
+ * */
+class TileCache {
+  public:
+    TileCache(omega::gfx::Shader *tile_shader);
+    ~TileCache();
+
+    TileCache(const TileCache &) = delete;
+    TileCache &operator=(const TileCache &) = delete;
+
+    // call once per frame, before the views render
+    void begin_frame() {
+        frame++;
+        redrawn = 0;
+    }
+    /**
+     * Pushes the tiles covering the camera into batch, redrawing the stale
+     * ones first. text_version has to change whenever text or tokens do.
+     * Views of the same document share the tiles. Returns false, pushing
+     * nothing, when the view needs more tiles than the cache holds
+     * */
+    bool render(RenderBatch &batch,
+                BufferRenderer &renderer,
+                Font *font,
+                GapBuffer &text,
+                const std::vector<Token> &tokens,
+                const Layout &layout,
+                const omega::scene::OrthographicCamera &camera,
+                f32 height,
+                const omega::math::vec4 &color,
+                const omega::math::vec4 &background,
+                u64 text_version);
+
+    u32 get_redrawn() const {
+        return redrawn;
+    }
+
+  private:
+    struct Tile {
+        // key
+        i32 row = 0, col = 0;
+        f32 height = 0.0f, pixel_scale = 0.0f;
+
+        u32 fbo = 0;
+        omega::util::sptr<omega::gfx::texture::Texture> texture = nullptr;
+        u32 first_row = 0, last_row = 0;
+        u64 hash = 0;
+        u64 text_version = 0;
+        u64 font_generation = 0;
+        bool drawn = false;
+        bool provisional = false; // drawn with glyphs still being rasterized
+        bool empty = true;
+        u64 last_used = 0;
+    };
+
+    Tile *find(i32 row, i32 col, f32 height, f32 pixel_scale);
+    Tile &acquire(i32 row, i32 col, f32 height, f32 pixel_scale);
+    void draw(Tile &tile,
+              BufferRenderer &renderer,
+              Font *font,
+              GapBuffer &text,
+              const std::vector<Token> &tokens,
+              const Layout &layout,
+              f32 height,
+              f32 world_size,
+              const omega::math::vec4 &color,
+              const omega::math::vec4 &background);
+    /**
+     * Hash of the bytes and token types the tile is drawn from, x_min and
+     * x_max are unscaled
+     * */
+    static u64 hash_rows(GapBuffer &text,
+                         const std::vector<Token> &tokens,
+                         const Layout &layout,
+                         u32 first_row,
+                         u32 last_row,
+                         f32 x_min,
+                         f32 x_max);
+
+    static constexpr u32 tile_size = 512; // pixels
+    static constexpr u32 max_tiles = 64;
+
+    std::vector<Tile> tiles;
+    u64 frame = 0;
+    u32 redrawn = 0;
+
+    // separate batch, so tile contents never mix with the frame's quads
+    RenderBatch tile_batch;
+    omega::gfx::Shader *tile_shader = nullptr;
+};
+
+#endif // SMED_TILECACHE_HPP
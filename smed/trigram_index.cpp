@@ -0,0 +1,530 @@
+#include "trigram_index.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <omega/util/log.hpp>
+
+#include "smed/cache.hpp"
+#include "smed/mapped_file.hpp"
+
+namespace {
+
+// layout of the index file, everything is written in native byte order:
+// header, root, files as {u32 path length, path, i64 mtime, u64 size} with
+// paths relative to the root, the trigram table, then the postings
+constexpr char index_magic[4] = {'S', 'M', 'T', 'G'};
+constexpr u32 index_version = 1;
+
+struct IndexHeader {
+    char magic[4];
+    u32 version;
+    u32 root_length;
+    u32 file_count;
+    u32 trigram_count;
+    u64 postings_size;
+};
+
+void put_varint(std::string &out, u32 value) {
+    while (value >= 0x80) {
+        out += (char)(value | 0x80);
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+std::string cache_key(const std::string &root) {
+    std::error_code error;
+    return std::filesystem::absolute(root, error).lexically_normal().string();
+}
+
+} // namespace
+
+void TrigramIndex::update(const std::string &root) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running == nullptr) {
+        start_update(root);
+    }
+}
+
+std::shared_ptr<TrigramIndex::Update>
+TrigramIndex::start_update(const std::string &root) {
+    if (current == nullptr || current->root != root) {
+        current = load(root);
+    }
+    updating = true;
+    seen.resize(pool.size());
+    auto update = std::make_shared<Update>();
+    update->root = root;
+    update->started = clock::now();
+    update->old = current;
+    update->cancelled = cancelled = std::make_shared<std::atomic<bool>>(false);
+    if (current != nullptr) {
+        update->unchanged.resize(current->files.size(), 0);
+    }
+    running = update;
+    ProjectWalker::walk(
+        pool,
+        root,
+        update->cancelled,
+        [this, update](u32 worker, const std::string &path) {
+            index_file(*update, worker, path);
+        },
+        [this, update]() { finish(*update); });
+    return update;
+}
+
+void TrigramIndex::cancel() {
+    if (cancelled != nullptr) {
+        *cancelled = true;
+    }
+}
+
+void TrigramIndex::candidates(const std::string &root,
+                              const std::vector<std::string> &literals,
+                              std::shared_ptr<std::atomic<bool>> cancelled,
+                              ProjectWalker::FileFn on_file,
+                              std::function<void()> on_done) {
+    auto query = std::make_shared<Query>();
+    query->cancelled = std::move(cancelled);
+    query->on_file = std::move(on_file);
+    query->on_done = std::move(on_done);
+    auto paths = std::make_shared<std::vector<std::string>>();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<Update> update = running;
+        // a query refined right after the last walk doesn't walk again
+        bool fresh = current != nullptr && current->root == root &&
+                     clock::now() - walked < fresh_for;
+        if (update == nullptr && !fresh) {
+            update = start_update(root);
+        } else if (update != nullptr && update->root != root) {
+            // the index is busy with another root, every file is read
+            ProjectWalker::walk(pool,
+                                root,
+                                query->cancelled,
+                                std::move(query->on_file),
+                                std::move(query->on_done));
+            return;
+        }
+        // an update starts from the same snapshot, so the files it finds
+        // changed are exactly the ones the snapshot can be wrong about
+        const Snapshot *old =
+            update != nullptr ? update->old.get() : current.get();
+        if (old != nullptr) {
+            std::vector<u32> ids;
+            if (!find(*old, literals, ids)) {
+                ids.resize(old->files.size());
+                std::iota(ids.begin(), ids.end(), 0);
+            }
+            query->hits.assign(old->files.size(), false);
+            for (u32 id : ids) {
+                query->hits[id] = true;
+                paths->push_back(old->files[id].path);
+            }
+        }
+        if (update != nullptr) {
+            std::lock_guard<std::mutex> update_lock(update->mutex);
+            // the changes read so far, the later ones are passed on as they
+            // come
+            for (const IndexedFile &indexed : update->changed) {
+                if (old != nullptr) {
+                    auto it = old->ids.find(indexed.file.path);
+                    if (it != old->ids.end() && query->hits[it->second]) {
+                        continue; // searched as a hit already
+                    }
+                }
+                paths->push_back(indexed.file.path);
+            }
+            update->queries.push_back(query);
+        }
+        // one for every job, and one for the update
+        query->pending = (paths->size() + batch_size - 1) / batch_size +
+                         (update != nullptr);
+    }
+    if (query->pending == 0) {
+        query->on_done(); // nothing can match
+        return;
+    }
+    for (u32 i = 0; i < paths->size(); i += batch_size) {
+        pool.submit([query, paths, i](u32 worker) {
+            u32 end = std::min<size_t>(i + batch_size, paths->size());
+            for (u32 j = i; j < end && !*query->cancelled; ++j) {
+                query->on_file(worker, (*paths)[j]);
+            }
+            query->finish_job();
+        });
+    }
+}
+
+bool TrigramIndex::find(const Snapshot &snapshot,
+                        const std::vector<std::string> &literals,
+                        std::vector<u32> &ids) {
+    ids.clear();
+    std::vector<u32> trigrams;
+    for (const std::string &literal : literals) {
+        for (u32 i = 0; i + 3 <= literal.size(); ++i) {
+            trigrams.push_back((u8)literal[i] << 16 | (u8)literal[i + 1] << 8 |
+                               (u8)literal[i + 2]);
+        }
+    }
+    if (trigrams.empty()) {
+        return false;
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                   trigrams.end());
+
+    std::vector<const Entry *> lists;
+    for (u32 trigram : trigrams) {
+        auto it = std::lower_bound(
+            snapshot.table.begin(),
+            snapshot.table.end(),
+            trigram,
+            [](const Entry &e, u32 t) { return e.trigram < t; });
+        if (it == snapshot.table.end() || it->trigram != trigram) {
+            return true; // no file has it
+        }
+        lists.push_back(&*it);
+    }
+    // intersect starting from the shortest list, so it only shrinks
+    std::sort(lists.begin(), lists.end(), [](const Entry *a, const Entry *b) {
+        return a->count < b->count;
+    });
+    std::vector<u32> next, both;
+    decode(snapshot, *lists[0], ids);
+    for (u32 i = 1; i < lists.size() && !ids.empty(); ++i) {
+        decode(snapshot, *lists[i], next);
+        both.clear();
+        std::set_intersection(ids.begin(),
+                              ids.end(),
+                              next.begin(),
+                              next.end(),
+                              std::back_inserter(both));
+        ids.swap(both);
+    }
+    return true;
+}
+
+void TrigramIndex::index_file(Update &update,
+                              u32 worker,
+                              const std::string &path) {
+    IndexedFile indexed{{path, 0, 0}, {}};
+    if (!stat_file(path, indexed.file.mtime, indexed.file.size)) {
+        return;
+    }
+    u32 old_id = UINT32_MAX;
+    if (update.old != nullptr) {
+        auto it = update.old->ids.find(path);
+        if (it != update.old->ids.end()) {
+            old_id = it->second;
+            const File &file = update.old->files[old_id];
+            if (file.mtime == indexed.file.mtime &&
+                file.size == indexed.file.size) {
+                update.unchanged[old_id] = 1;
+                return;
+            }
+        }
+    }
+
+    // binary files and files too large to search get no trigrams
+    MappedFile mapped(path);
+    const char *data = mapped.data();
+    size_t size = mapped.size();
+    if (mapped.is_open() && size >= 3 && size <= UINT32_MAX &&
+        !std::memchr(data, '\0', std::min<size_t>(size, binary_probe))) {
+        std::vector<u64> &bits = seen[worker];
+        if (bits.empty()) {
+            bits.resize(trigram_count / 64, 0);
+        }
+        std::vector<u32> &trigrams = indexed.trigrams;
+        u32 trigram = (u8)data[0] << 8 | (u8)data[1];
+        for (size_t i = 2; i < size; ++i) {
+            trigram = (trigram << 8 | (u8)data[i]) & (trigram_count - 1);
+            u64 &word = bits[trigram / 64];
+            u64 bit = (u64)1 << (trigram % 64);
+            if (!(word & bit)) {
+                word |= bit;
+                trigrams.push_back(trigram);
+            }
+        }
+        for (u32 t : trigrams) {
+            bits[t / 64] = 0;
+        }
+        std::sort(trigrams.begin(), trigrams.end());
+    }
+    std::vector<std::shared_ptr<Query>> queries;
+    {
+        std::lock_guard<std::mutex> lock(update.mutex);
+        update.changed.push_back(std::move(indexed));
+        queries = update.queries;
+    }
+    // a hit is searched from the snapshot already, with what it has now
+    for (const auto &query : queries) {
+        if (!*query->cancelled &&
+            (old_id == UINT32_MAX || !query->hits[old_id])) {
+            query->on_file(worker, path);
+        }
+    }
+}
+
+void TrigramIndex::finish(Update &update) {
+    const Snapshot *old = update.old.get();
+    u32 kept = std::count(update.unchanged.begin(), update.unchanged.end(), 1);
+    if (*update.cancelled ||
+        (old != nullptr && update.changed.empty() &&
+         kept == old->files.size())) {
+        complete(update, nullptr);
+        return;
+    }
+
+    // unchanged files keep their order, the changed ones go after them, so
+    // an old posting list stays sorted and the new ids append to it
+    auto next = std::make_shared<Snapshot>();
+    next->root = update.root;
+    std::vector<u32> remap(old == nullptr ? 0 : old->files.size(), UINT32_MAX);
+    for (u32 i = 0; i < remap.size(); ++i) {
+        if (update.unchanged[i]) {
+            remap[i] = next->files.size();
+            next->files.push_back(old->files[i]);
+        }
+    }
+    // queries can still be reading the changed files, they're left as is
+    std::vector<const IndexedFile *> changed;
+    for (const IndexedFile &indexed : update.changed) {
+        changed.push_back(&indexed);
+    }
+    std::sort(changed.begin(),
+              changed.end(),
+              [](const IndexedFile *a, const IndexedFile *b) {
+                  return a->file.path < b->file.path;
+              });
+    std::vector<u64> added; // trigram << 32 | file id
+    for (const IndexedFile *indexed : changed) {
+        u32 id = next->files.size();
+        for (u32 t : indexed->trigrams) {
+            added.push_back((u64)t << 32 | id);
+        }
+        next->files.push_back(indexed->file);
+    }
+    std::sort(added.begin(), added.end());
+    for (u32 i = 0; i < next->files.size(); ++i) {
+        next->ids.emplace(next->files[i].path, i);
+    }
+
+    // merge the old table with the new postings, both sorted by trigram
+    std::vector<u32> ids;
+    size_t a = 0;
+    const Entry *old_entry = old == nullptr ? nullptr : old->table.data();
+    const Entry *old_end =
+        old == nullptr ? nullptr : old_entry + old->table.size();
+    while (old_entry != old_end || a < added.size()) {
+        u32 t = UINT32_MAX;
+        if (old_entry != old_end) {
+            t = old_entry->trigram;
+        }
+        if (a < added.size()) {
+            t = std::min<u32>(t, added[a] >> 32);
+        }
+        ids.clear();
+        if (old_entry != old_end && old_entry->trigram == t) {
+            decode(*old, *old_entry, ids);
+            u32 out = 0;
+            for (u32 id : ids) {
+                if (remap[id] != UINT32_MAX) {
+                    ids[out++] = remap[id];
+                }
+            }
+            ids.resize(out);
+            old_entry++;
+        }
+        for (; a < added.size() && added[a] >> 32 == t; ++a) {
+            ids.push_back((u32)added[a]);
+        }
+        if (ids.empty()) {
+            continue;
+        }
+        next->table.push_back({t, (u32)ids.size(), next->postings.size()});
+        u32 previous = 0;
+        for (u32 id : ids) {
+            put_varint(next->postings, id - previous);
+            previous = id;
+        }
+    }
+
+    save(*next);
+    complete(update, std::move(next));
+}
+
+void TrigramIndex::complete(Update &update,
+                            std::shared_ptr<const Snapshot> next) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (next != nullptr) {
+            current = std::move(next);
+        }
+        if (!*update.cancelled) {
+            walked = update.started;
+        }
+        running = nullptr;
+        updating = false;
+    }
+    // no query can join anymore, and every changed file was passed on
+    std::vector<std::shared_ptr<Query>> queries;
+    {
+        std::lock_guard<std::mutex> lock(update.mutex);
+        queries.swap(update.queries);
+    }
+    for (const auto &query : queries) {
+        query->finish_job();
+    }
+}
+
+std::shared_ptr<const TrigramIndex::Snapshot>
+TrigramIndex::load(const std::string &root) {
+    std::string key = cache_key(root);
+    MappedFile file(cache_file(key, "trigrams"));
+    if (!file.is_open()) {
+        return nullptr;
+    }
+    CacheReader reader{file.data(), file.size()};
+    IndexHeader header;
+    if (!reader.read(&header, sizeof(header)) ||
+        std::memcmp(header.magic, index_magic, sizeof(index_magic)) != 0 ||
+        header.version != index_version ||
+        header.root_length != key.length()) {
+        return nullptr;
+    }
+    // hash collisions are caught by the full root
+    const char *cached_root = reader.view(header.root_length);
+    if (cached_root == nullptr ||
+        std::memcmp(cached_root, key.data(), key.length()) != 0) {
+        return nullptr;
+    }
+
+    // a file record is at least its path length, mtime and size
+    constexpr size_t file_record = sizeof(u32) + sizeof(i64) + sizeof(u64);
+    if (!reader.fits(header.file_count, file_record)) {
+        return nullptr;
+    }
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->root = root;
+    std::filesystem::path base(root);
+    snapshot->files.resize(header.file_count);
+    for (File &f : snapshot->files) {
+        u32 length = 0;
+        const char *path = nullptr;
+        if (!reader.read(&length, sizeof(length)) ||
+            !(path = reader.view(length)) ||
+            !reader.read(&f.mtime, sizeof(f.mtime)) ||
+            !reader.read(&f.size, sizeof(f.size))) {
+            return nullptr;
+        }
+        f.path = (base / std::string(path, length)).string();
+    }
+    if (!reader.fits(header.trigram_count, sizeof(Entry))) {
+        return nullptr;
+    }
+    snapshot->table.resize(header.trigram_count);
+    const char *postings = nullptr;
+    if (!reader.read(snapshot->table.data(),
+                     sizeof(Entry) * header.trigram_count) ||
+        !(postings = reader.view(header.postings_size))) {
+        return nullptr;
+    }
+    for (const Entry &entry : snapshot->table) {
+        if (entry.offset >= header.postings_size) {
+            return nullptr;
+        }
+    }
+    snapshot->postings.assign(postings, header.postings_size);
+    for (u32 i = 0; i < snapshot->files.size(); ++i) {
+        snapshot->ids.emplace(snapshot->files[i].path, i);
+    }
+    return snapshot;
+}
+
+void TrigramIndex::save(const Snapshot &snapshot) {
+    std::string key = cache_key(snapshot.root);
+    std::string file = cache_file(key, "trigrams");
+    if (file.empty()) {
+        return;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(
+        std::filesystem::path(file).parent_path(), error);
+
+    // write to a temporary first, so a partial file is never mapped
+    std::string tmp = file + ".tmp";
+    std::ofstream of(tmp, std::ios::binary);
+    if (of.fail()) {
+        OMEGA_WARN("Failed to write the trigram index '{}'", tmp);
+        return;
+    }
+    IndexHeader header{};
+    std::memcpy(header.magic, index_magic, sizeof(index_magic));
+    header.version = index_version;
+    header.root_length = key.length();
+    header.file_count = snapshot.files.size();
+    header.trigram_count = snapshot.table.size();
+    header.postings_size = snapshot.postings.size();
+    of.write((const char *)&header, sizeof(header));
+    of.write(key.data(), key.length());
+    size_t prefix = (std::filesystem::path(snapshot.root) / "").string().size();
+    for (const File &f : snapshot.files) {
+        u32 length = f.path.size() - prefix;
+        of.write((const char *)&length, sizeof(length));
+        of.write(f.path.data() + prefix, length);
+        of.write((const char *)&f.mtime, sizeof(f.mtime));
+        of.write((const char *)&f.size, sizeof(f.size));
+    }
+    of.write((const char *)snapshot.table.data(),
+             sizeof(Entry) * snapshot.table.size());
+    of.write(snapshot.postings.data(), snapshot.postings.size());
+    of.close();
+    if (of.fail()) {
+        std::filesystem::remove(tmp, error);
+        return;
+    }
+    std::filesystem::rename(tmp, file, error);
+}
+
+void TrigramIndex::decode(const Snapshot &snapshot,
+                          const Entry &entry,
+                          std::vector<u32> &ids) {
+    ids.clear();
+    const u8 *p = (const u8 *)snapshot.postings.data() + entry.offset;
+    const u8 *end = (const u8 *)snapshot.postings.data() +
+                    snapshot.postings.size();
+    u32 id = 0;
+    for (u32 i = 0; i < entry.count && p < end; ++i) {
+        u32 delta = 0;
+        for (u32 shift = 0; p < end && shift < 35; shift += 7) {
+            u8 byte = *p++;
+            delta |= (u32)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        id += delta;
+        if (id >= snapshot.files.size()) {
+            break; // corrupt, keep what's valid
+        }
+        ids.push_back(id);
+    }
+}
+
+bool TrigramIndex::stat_file(const std::string &path, i64 &mtime, u64 &size) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    mtime = (i64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    size = st.st_size;
+    return true;
+}
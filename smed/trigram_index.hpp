@@ -0,0 +1,143 @@
+#ifndef SMED_TRIGRAMINDEX_HPP
+#define SMED_TRIGRAMINDEX_HPP
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <omega/util/types.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "smed/project_files.hpp"
+#include "smed/thread_pool.hpp"
+
+/**
+ * Maps every 3 byte sequence in the files under a project root to the files
+ * containing it, so a search only has to read the files that can match. The
+ * index lives in the cache directory and is brought up to date in the
+ * background, only the files whose mtime or size changed since are read
+ * again. A search follows that update: the files it finds changed are
+ * searched as well, so a stale index makes a search slower but not wrong
+ * */
+class TrigramIndex {
+  public:
+    TrigramIndex(ThreadPool &pool) : pool(pool) {}
+    ~TrigramIndex() {
+        cancel();
+    }
+
+    // loads the cached index of root and refreshes it in the background,
+    // does nothing while a refresh is running
+    void update(const std::string &root);
+    void cancel();
+    bool is_updating() const {
+        return updating;
+    }
+
+    /**
+     * Calls on_file on the pool for every file under root that can contain
+     * all the literals: the ones the index lists for them, then the ones an
+     * update of the index finds changed, as it reads them. Queries share
+     * the running update's walk, and within fresh_for of the last one none
+     * is started. Only literals of at least 3 bytes narrow it down. Returns
+     * right away, on_done runs after the last on_file
+     * */
+    void candidates(const std::string &root,
+                    const std::vector<std::string> &literals,
+                    std::shared_ptr<std::atomic<bool>> cancelled,
+                    ProjectWalker::FileFn on_file,
+                    std::function<void()> on_done);
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    struct File {
+        std::string path; // root joined with the relative path
+        i64 mtime;        // nanoseconds
+        u64 size;
+    };
+    struct Entry {
+        u32 trigram;
+        u32 count;  // files in the posting list
+        u64 offset; // into postings
+    };
+    struct Snapshot {
+        std::string root;
+        std::vector<File> files;
+        std::unordered_map<std::string, u32> ids;
+        std::vector<Entry> table; // sorted by trigram
+        std::string postings;     // varint encoded deltas of file ids
+    };
+    struct IndexedFile {
+        File file;
+        std::vector<u32> trigrams; // sorted, none for binary files
+    };
+    // a candidates call, done once all of its jobs and the update are
+    struct Query {
+        std::vector<bool> hits; // by file id in the update's old snapshot
+        std::shared_ptr<std::atomic<bool>> cancelled;
+        ProjectWalker::FileFn on_file;
+        std::function<void()> on_done;
+        std::atomic<u32> pending{0};
+
+        void finish_job() {
+            if (--pending == 0) {
+                on_done();
+            }
+        }
+    };
+    struct Update {
+        std::string root;
+        clock::time_point started;
+        std::shared_ptr<const Snapshot> old;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+        std::vector<u8> unchanged; // by old file id, set by one worker each
+        std::mutex mutex;
+        std::vector<IndexedFile> changed;
+        // told about every changed file, guarded by mutex
+        std::vector<std::shared_ptr<Query>> queries;
+    };
+
+    // starts updating from current, call with mutex held
+    std::shared_ptr<Update> start_update(const std::string &root);
+    void index_file(Update &update, u32 worker, const std::string &path);
+    void finish(Update &update);
+    // swaps in next unless it's null, then ends the update's queries
+    void complete(Update &update, std::shared_ptr<const Snapshot> next);
+    // ids of the files containing every literal, false when the literals
+    // are too short to tell
+    static bool find(const Snapshot &snapshot,
+                     const std::vector<std::string> &literals,
+                     std::vector<u32> &ids);
+
+    static std::shared_ptr<const Snapshot> load(const std::string &root);
+    static void save(const Snapshot &snapshot);
+    static void decode(const Snapshot &snapshot,
+                       const Entry &entry,
+                       std::vector<u32> &ids);
+    static bool stat_file(const std::string &path, i64 &mtime, u64 &size);
+
+    static constexpr u32 trigram_count = 1 << 24;
+    static constexpr u32 binary_probe = 8192; // bytes checked for a NUL
+
+    static constexpr u32 batch_size = 32; // candidates per job
+    // how long after a walk started the snapshot is taken as current, so
+    // typing a query doesn't walk the project on every key
+    static constexpr clock::duration fresh_for = std::chrono::seconds(1);
+
+    ThreadPool &pool;
+    mutable std::mutex mutex; // guards current and running
+    std::shared_ptr<const Snapshot> current = nullptr;
+    std::shared_ptr<Update> running = nullptr;
+    clock::time_point walked{}; // when the last finished update started
+    std::shared_ptr<std::atomic<bool>> cancelled = nullptr;
+    std::atomic<bool> updating{false};
+    // the trigrams seen in the file a worker is reading, one bit each, only
+    // touched by that worker
+    std::vector<std::vector<u64>> seen;
+};
+
+#endif // SMED_TRIGRAMINDEX_HPP
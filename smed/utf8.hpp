@@ -0,0 +1,89 @@
+#ifndef SMED_UTF8_HPP
+#define SMED_UTF8_HPP
+
+#include <omega/util/types.hpp>
+#include <string>
+
+namespace utf8 {
+
+constexpr u32 replacement_char = 0xFFFD;
+
+inline bool is_continuation(u8 c) {
+    return (c & 0xC0) == 0x80;
+}
+
+// number of bytes in the sequence started by c, 1 for stray bytes
+inline u32 sequence_length(u8 c) {
+    if (c < 0x80) return 1;
+    if ((c & 0xE0) == 0xC0) return 2;
+    if ((c & 0xF0) == 0xE0) return 3;
+    if ((c & 0xF8) == 0xF0) return 4;
+    return 1;
+}
+
+/**
+ * Decode the codepoint starting at byte i, where get(i) returns the i-th byte
+ * and n is the total byte count. Invalid sequences decode to U+FFFD and
+ * consume a single byte
+ * */
+template <typename Get>
+u32 decode(Get get, u32 i, u32 n, u32 &len) {
+    u8 c = get(i);
+    len = sequence_length(c);
+    if (len == 1) {
+        return c < 0x80 ? c : replacement_char;
+    }
+    if (i + len > n) {
+        len = 1;
+        return replacement_char;
+    }
+    u32 codepoint = c & (0x7F >> len);
+    for (u32 k = 1; k < len; ++k) {
+        u8 next = get(i + k);
+        if (!is_continuation(next)) {
+            len = 1;
+            return replacement_char;
+        }
+        codepoint = (codepoint << 6) | (next & 0x3F);
+    }
+    return codepoint;
+}
+
+inline u32 decode(const char *s, u32 i, u32 n, u32 &len) {
+    return decode([s](u32 k) { return (u8)s[k]; }, i, n, len);
+}
+
+/**
+ * Start of the character before byte i, where get(i) returns the i-th byte.
+ * Steps back over at most 3 continuation bytes, as many as a sequence has
+ * */
+template <typename Get>
+u32 prev(Get get, u32 i) {
+    if (i == 0) {
+        return 0;
+    }
+    u32 j = i - 1;
+    while (j > 0 && i - j < 4 && is_continuation(get(j))) {
+        j--;
+    }
+    return j;
+}
+
+// end of the character starting at byte i, n is the total byte count
+template <typename Get>
+u32 next(Get get, u32 i, u32 n) {
+    u32 j = i < n ? i + 1 : n;
+    while (j < n && j - i < 4 && is_continuation(get(j))) {
+        j++;
+    }
+    return j;
+}
+
+// removes the last character of s, not just its last byte
+inline void pop_back(std::string &s) {
+    s.resize(prev([&s](u32 k) { return (u8)s[k]; }, s.size()));
+}
+
+} // namespace utf8
+
+#endif // SMED_UTF8_HPP
@@ -0,0 +1,37 @@
+#ifndef SMED_VIEW_HPP
+#define SMED_VIEW_HPP
+
+#include <omega/gfx/shader.hpp>
+#include <omega/math/math.hpp>
+#include <omega/scene/orthographic_camera.hpp>
+#include <omega/util/std.hpp>
+#include <omega/util/types.hpp>
+
+#include "smed/minimap.hpp"
+#include "smed/render_batch.hpp"
+
+/**
+ * One pane onto the editor's document. Text, tokens and layout are shared
+ * between views, a view only owns its cursor, camera and minimap, so each
+ * extra view costs just the rows it has on screen
+ * */
+struct View {
+    View(omega::gfx::Shader *solid_shader, omega::gfx::Shader *tile_shader)
+        : batch(solid_shader), minimap(tile_shader) {}
+
+    // cursor state, only kept here while another view is active, the
+    // active view's cursor is the gap buffer's
+    u32 cursor = 0;
+    i32 selection_start = -1;
+    i32 vertical_pos = -1;
+
+    // sized to the view's part of the screen
+    omega::util::uptr<omega::scene::OrthographicCamera> camera = nullptr;
+    omega::math::vec2 cursor_pos{0.0f};
+    bool camera_settled = false;
+
+    RenderBatch batch; // drawn into the view's viewport
+    Minimap minimap;
+};
+
+#endif // SMED_VIEW_HPP
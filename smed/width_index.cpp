@@ -0,0 +1,32 @@
+#include "width_index.hpp"
+
+#include <algorithm>
+
+WidthIndex::Checkpoint WidthIndex::before(u32 line_start, u32 idx) const {
+    auto it = std::upper_bound(
+        checkpoints.begin(),
+        checkpoints.end(),
+        idx,
+        [](u32 i, const Checkpoint &c) { return i < c.idx; });
+    if (it == checkpoints.begin() || (it - 1)->idx < line_start) {
+        return {line_start, 0.0f};
+    }
+    return *(it - 1);
+}
+
+WidthIndex::Checkpoint WidthIndex::before_x(u32 start,
+                                            u32 end,
+                                            f32 x,
+                                            f32 start_x) const {
+    const auto by_idx = [](const Checkpoint &c, u32 i) { return c.idx < i; };
+    auto first =
+        std::lower_bound(checkpoints.begin(), checkpoints.end(), start, by_idx);
+    auto last = std::lower_bound(first, checkpoints.end(), end + 1, by_idx);
+    // widths only grow along a line
+    auto it = std::upper_bound(
+        first, last, x, [](f32 v, const Checkpoint &c) { return v < c.x; });
+    if (it == first) {
+        return {start, start_x};
+    }
+    return *(it - 1);
+}
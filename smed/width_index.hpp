@@ -0,0 +1,44 @@
+#ifndef SMED_WIDTHINDEX_HPP
+#define SMED_WIDTHINDEX_HPP
+
+#include <omega/util/types.hpp>
+#include <vector>
+
+/**
+ * Prefix widths sampled every interval columns of each line, recorded while
+ * lexing. Positions inside very long lines are then a binary search plus at
+ * most interval advances away instead of a walk from the line start
+ * */
+class WidthIndex {
+  public:
+    static constexpr u32 interval = 256;
+
+    struct Checkpoint {
+        u32 idx; // first byte of the character the checkpoint starts at
+        f32 x;   // unscaled width from the line start to idx
+    };
+
+    void clear() {
+        checkpoints.clear();
+    }
+    // checkpoints have to be added in text order
+    void add(u32 idx, f32 x) {
+        checkpoints.push_back({idx, x});
+    }
+
+    // closest checkpoint at or before idx on the line starting at line_start
+    Checkpoint before(u32 line_start, u32 idx) const;
+    /**
+     * Closest checkpoint in [start, end] at or left of x, or start itself at
+     * start_x when there is none (rows can start in the middle of a line)
+     * */
+    Checkpoint before_x(u32 start,
+                        u32 end,
+                        f32 x,
+                        f32 start_x = 0.0f) const;
+
+  private:
+    std::vector<Checkpoint> checkpoints; // sorted by idx
+};
+
+#endif // SMED_WIDTHINDEX_HPP
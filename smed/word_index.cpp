@@ -0,0 +1,128 @@
+#include "word_index.hpp"
+
+#include <algorithm>
+
+void WordIndex::rebuild(const GapBuffer &text,
+                        const std::vector<Token> &tokens) {
+    clear();
+    // sorted first, so every distinct word is one insert at the end of the
+    // map rather than a lookup from the root
+    std::vector<std::pair<std::string, u32>> found; // word, index in words
+    for (const Token &token : tokens) {
+        if (token.type == TokenType::SYMBOL) {
+            u32 begin = text.get_index_from_pointer(token.text);
+            found.emplace_back(text.substr(begin, token.len), words.size());
+            words.push_back({begin, (u32)token.len, {}});
+        }
+    }
+    std::sort(found.begin(), found.end());
+    for (u32 i = 0; i < found.size();) {
+        u32 end = i + 1;
+        while (end < found.size() && found[end].first == found[i].first) {
+            end++;
+        }
+        auto it = counts.emplace_hint(
+            counts.end(), std::move(found[i].first), end - i);
+        for (; i < end; ++i) {
+            words[found[i].second].it = it;
+        }
+    }
+}
+
+void WordIndex::patch(const GapBuffer &text,
+                      const std::vector<Token> &tokens,
+                      const GapBuffer::Edit &edit) {
+    if (!edit.changed) {
+        return;
+    }
+    // words ending before the edit were lexed from the same text
+    auto head = std::partition_point(
+        words.begin(), words.end(), [&](const Word &w) {
+            return w.begin + w.len < edit.begin;
+        });
+    auto token = std::partition_point(
+        tokens.begin(), tokens.end(), [&](const Token &t) {
+            return text.get_index_from_pointer(t.text) + t.len < edit.begin;
+        });
+
+    // after the edit, a token starting where an old one started is the
+    // same, and so is everything following it. Only the words up to there
+    // changed
+    u32 old_end = edit.end - edit.delta;
+    auto tail = words.end();
+    next.clear();
+    for (; token != tokens.end(); ++token) {
+        if (token->type != TokenType::SYMBOL) {
+            continue;
+        }
+        u32 begin = text.get_index_from_pointer(token->text);
+        if (begin >= edit.end) {
+            u32 old_begin = begin - edit.delta;
+            auto old = std::partition_point(
+                head, words.end(), [&](const Word &w) {
+                    return w.begin < old_begin;
+                });
+            if (old != words.end() && old->begin == old_begin &&
+                old->begin >= old_end && old->len == token->len) {
+                tail = old;
+                break;
+            }
+        }
+        next.push_back({begin, (u32)token->len, add(text, begin, token->len)});
+    }
+    for (auto it = head; it != tail; ++it) {
+        remove(it->it);
+    }
+    for (auto it = tail; it != words.end(); ++it) {
+        it->begin += edit.delta;
+    }
+    u32 at = words.erase(head, tail) - words.begin();
+    words.insert(words.begin() + at, next.begin(), next.end());
+}
+
+void WordIndex::complete(const std::string &prefix,
+                         u32 max,
+                         std::vector<std::string> &out) const {
+    out.clear();
+    std::vector<Counts::const_iterator> found;
+    for (auto it = counts.upper_bound(prefix);
+         it != counts.end() && found.size() < max_ranked &&
+         it->first.compare(0, prefix.size(), prefix) == 0;
+         ++it) {
+        found.push_back(it);
+    }
+    auto shown = found.begin() + std::min<size_t>(found.size(), max);
+    std::partial_sort(
+        found.begin(),
+        shown,
+        found.end(),
+        [](Counts::const_iterator a, Counts::const_iterator b) {
+            if (a->second != b->second) {
+                return a->second > b->second;
+            }
+            return a->first < b->first;
+        });
+    for (auto it = found.begin(); it != shown; ++it) {
+        out.push_back((*it)->first);
+    }
+}
+
+WordIndex::Counts::iterator WordIndex::add(const GapBuffer &text,
+                                           u32 begin,
+                                           u32 len) {
+    // the word can be split by the gap, it's copied out
+    scratch.resize(len);
+    text.copy_out(begin, begin + len, scratch.data());
+    auto it = counts.find(scratch);
+    if (it == counts.end()) {
+        it = counts.emplace(scratch, 0).first;
+    }
+    it->second++;
+    return it;
+}
+
+void WordIndex::remove(Counts::iterator it) {
+    if (--it->second == 0) {
+        counts.erase(it);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef SMED_WORDINDEX_HPP
+#define SMED_WORDINDEX_HPP
+
+#include <functional>
+#include <map>
+#include <omega/util/types.hpp>
+#include <string>
+#include <vector>
+
+#include "smed/gap_buffer.hpp"
+#include "smed/lexer.hpp"
+
+/**
+ * Every identifier in the buffer with the number of times it occurs, sorted
+ * so the words starting with a prefix are one range, found by a binary
+ * search. An edit only takes out the identifiers whose tokens the relex
+ * changed and adds the new ones, the counts of the rest stay as they are
+ * */
+class WordIndex {
+  public:
+    // forgets the words and takes every SYMBOL token
+    void rebuild(const GapBuffer &text, const std::vector<Token> &tokens);
+    void clear() {
+        counts.clear();
+        words.clear();
+    }
+    // call with the tokens relexed after the edit
+    void patch(const GapBuffer &text,
+               const std::vector<Token> &tokens,
+               const GapBuffer::Edit &edit);
+
+    // at most max words longer than prefix starting with it, the most
+    // frequent first
+    void complete(const std::string &prefix,
+                  u32 max,
+                  std::vector<std::string> &out) const;
+    u32 size() const {
+        return counts.size();
+    }
+
+  private:
+    using Counts = std::map<std::string, u32, std::less<>>;
+    struct Word {
+        u32 begin;
+        u32 len;
+        Counts::iterator it;
+    };
+
+    Counts::iterator add(const GapBuffer &text, u32 begin, u32 len);
+    void remove(Counts::iterator it);
+
+    // a short prefix matches too many words to rank all of them, only the
+    // first ones in order are
+    static constexpr u32 max_ranked = 512;
+
+    Counts counts;
+    std::vector<Word> words; // the buffer's identifiers in text order
+    std::vector<Word> next;  // scratch, the words of the relexed tokens
+    std::string scratch;
+};
+
+#endif // SMED_WORDINDEX_HPP
@@ -0,0 +1,41 @@
+#include "wrap_layout.hpp"
+
+#include <algorithm>
+
+#include "smed/fold_index.hpp"
+
+void WrapLayout::rebuild(const LineIndex &lines, const FoldIndex &folds) {
+    rows.clear();
+    rows.reserve(lines.line_count() + wraps.size());
+    const auto &hidden = folds.get_hidden();
+
+    // both are sorted, so a merge puts the wraps after their line start
+    u32 w = 0;
+    u32 h = 0;
+    for (u32 line = 0; line < lines.line_count(); ++line) {
+        // jump over folded lines along with their wraps
+        if (h < hidden.size() && line == hidden[h].header + 1) {
+            line = hidden[h++].last;
+            u32 end = lines.line_end(line);
+            while (w < wraps.size() && wraps[w].start <= end) {
+                w++;
+            }
+            continue;
+        }
+        u32 end = lines.line_end(line);
+        rows.push_back({lines.line_start(line), end, 0.0f, false});
+        while (w < wraps.size() && wraps[w].start <= end) {
+            rows.back().end = wraps[w].start;
+            rows.push_back(wraps[w++]);
+            rows.back().end = end;
+        }
+    }
+}
+
+u32 WrapLayout::row_of(u32 idx) const {
+    auto it = std::upper_bound(
+        rows.begin(), rows.end(), idx, [](u32 i, const Row &row) {
+            return i < row.start;
+        });
+    return (it - rows.begin()) - 1;
+}
@@ -0,0 +1,75 @@
+#ifndef SMED_WRAPLAYOUT_HPP
+#define SMED_WRAPLAYOUT_HPP
+
+#include <omega/util/types.hpp>
+#include <vector>
+
+#include "smed/line_index.hpp"
+
+class FoldIndex;
+
+/**
+ * Visual rows of the document. The lexer finds the soft wrap points while it
+ * lays out x positions, rebuild merges them with the line starts, so text
+ * indices and rows map onto each other with a binary search. Without
+ * wrapping every line is one row, and lines hidden by folds have none
+ * */
+class WrapLayout {
+  public:
+    // unscaled row width, 0 turns wrapping off
+    void set_width(f32 width) {
+        this->width = width;
+    }
+    f32 get_width() const {
+        return width;
+    }
+    bool is_enabled() const {
+        return width > 0.0f;
+    }
+
+    void clear() {
+        wraps.clear();
+    }
+    // wrap points have to be added in text order
+    void add(u32 idx, f32 x) {
+        wraps.push_back({idx, 0, x, true});
+    }
+    // call once the lexer is done, or after folds changed
+    void rebuild(const LineIndex &lines, const FoldIndex &folds);
+
+    u32 row_count() const {
+        return rows.size();
+    }
+    u32 row_start(u32 row) const {
+        return rows[row].start;
+    }
+    // end of the row's text: where the next row starts when it wraps, the
+    // index of the '\n' or the text length otherwise
+    u32 row_end(u32 row) const {
+        return rows[row].end;
+    }
+    // unscaled x of the row start, relative to its line
+    f32 row_x(u32 row) const {
+        return rows[row].x;
+    }
+    // true when the next row continues this row's line
+    bool wraps_into_next(u32 row) const {
+        return row + 1 < rows.size() && rows[row + 1].wrapped;
+    }
+    // binary search for the row containing idx, the fold's header row for
+    // hidden text
+    u32 row_of(u32 idx) const;
+
+  private:
+    struct Row {
+        u32 start;
+        u32 end;
+        f32 x;
+        bool wrapped; // continues the line of the previous row
+    };
+    std::vector<Row> wraps;
+    std::vector<Row> rows{{0, 0, 0.0f, false}};
+    f32 width = 0.0f;
+};
+
+#endif // SMED_WRAPLAYOUT_HPP